@@ -0,0 +1,6 @@
+#version 460 core
+
+//For depth only passes, where the color writes are off and only the depth of the fragments is needed
+void main()
+{
+}
@@ -0,0 +1,160 @@
+#version 460 core
+
+layout(local_size_x = 64) in; //NOTE: DO NOT UPDATE without changing MultiDrawBatch::cullWorkGroupSize
+
+
+//NOTE: DO NOT UPDATE THIS BLOCK without changing FrameUniforms in Renderer.h
+layout(std140, binding = 0) uniform FrameUniforms
+{
+    mat4 u_viewMatrix;
+    mat4 u_projectionMatrix;
+    mat4 u_projViewMatrix;
+};
+
+//NOTE: DO NOT UPDATE THESE without changing MultiDrawBatch::CullMeshData and the MultiDrawBatch binding constants
+struct CullMeshData
+{
+    vec3 boundsCenter;
+    uint materialIndex;
+    vec3 boundsExtent;
+    uint commandRegion;
+    uint indexCount;
+    uint firstIndex;
+    int baseVertex;
+    uint padding;
+};
+
+//The layout of this struct is dictated by OpenGL, see glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand
+{
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    int baseVertex;
+    uint baseInstance;
+};
+
+layout(std430, binding = 2) readonly buffer CullMeshBlock
+{
+    CullMeshData u_cullMeshes[];
+};
+
+layout(std430, binding = 3) writeonly buffer CulledCommandBlock
+{
+    DrawElementsIndirectCommand u_culledCommands[];
+};
+
+//One count per material, cleared to 0 before the dispatch
+layout(std430, binding = 4) buffer CulledDrawCountBlock
+{
+    uint u_culledDrawCounts[];
+};
+
+//Cleared to 0 before the dispatch, read back for the statistics. Only bound if u_collectStats is set
+layout(std430, binding = 5) buffer CullStatsBlock
+{
+    uint u_numInFrustum;
+    uint u_numVisible;
+};
+
+//NOTE: DO NOT UPDATE the binding without changing HiZBuffer::textureUnit
+layout(binding = 16) uniform sampler2D u_hiZ;
+
+uniform bool u_occlusionCulling;
+uniform bool u_collectStats; //Only with ImGui, see MultiDrawBatch::GetLastCullStats()
+uniform mat4 u_hiZProjViewMatrix; //The matrix that the Hi-Z pyramid was built with, which is the one of the last frame
+
+
+shared vec4 s_frustumPlanes[6];
+
+
+//Tests the box against the Hi-Z pyramid (see HiZBuffer) at the level where it covers at most 2x2 texels
+bool IsOccluded(vec3 boundsCenter, vec3 boundsExtent)
+{
+    vec2 minUV = vec2(1.0);
+    vec2 maxUV = vec2(0.0);
+    float minDepth = 1.0;
+
+    for (uint i = 0u; i < 8u; i++)
+    {
+        vec3 cornerDirection = vec3((i & 1u) != 0u ? 1.0 : -1.0, (i & 2u) != 0u ? 1.0 : -1.0, (i & 4u) != 0u ? 1.0 : -1.0);
+        vec4 clipPosition = u_hiZProjViewMatrix * vec4(boundsCenter + boundsExtent * cornerDirection, 1.0);
+
+        //The box crosses the plane of the camera, so its projection is not bounded by its corners
+        if (clipPosition.w <= 0.0)
+            return false;
+
+        vec3 ndcPosition = clipPosition.xyz / clipPosition.w;
+        minUV = min(minUV, ndcPosition.xy * 0.5 + 0.5);
+        maxUV = max(maxUV, ndcPosition.xy * 0.5 + 0.5);
+        minDepth = min(minDepth, ndcPosition.z * 0.5 + 0.5);
+    }
+
+    minUV = clamp(minUV, 0.0, 1.0);
+    maxUV = clamp(maxUV, 0.0, 1.0);
+
+    vec2 sizeInTexels = (maxUV - minUV) * vec2(textureSize(u_hiZ, 0));
+    int level = int(ceil(log2(max(max(sizeInTexels.x, sizeInTexels.y), 1.0))));
+    level = min(level, textureQueryLevels(u_hiZ) - 1);
+
+    ivec2 levelSize = textureSize(u_hiZ, level);
+    ivec2 firstTexel = min(ivec2(minUV * vec2(levelSize)), levelSize - 1);
+    ivec2 lastTexel = min(ivec2(maxUV * vec2(levelSize)), levelSize - 1);
+
+    float maxDepth = 0.0;
+    for (int y = firstTexel.y; y <= lastTexel.y; y++)
+    {
+        for (int x = firstTexel.x; x <= lastTexel.x; x++)
+            maxDepth = max(maxDepth, texelFetch(u_hiZ, ivec2(x, y), level).r);
+    }
+
+    return minDepth > maxDepth;
+}
+
+
+void main()
+{
+    //The planes are the same for every mesh, so the first 6 invocations of the work group extract one each
+    //Plane 2n is row 3 + row n of the projView matrix and plane 2n + 1 is row 3 - row n (like FrustumCuller)
+    if (gl_LocalInvocationIndex < 6u)
+    {
+        uint row = gl_LocalInvocationIndex / 2u;
+        float direction = (gl_LocalInvocationIndex % 2u == 0u) ? 1.0 : -1.0;
+
+        vec4 row3 = vec4(u_projViewMatrix[0][3], u_projViewMatrix[1][3], u_projViewMatrix[2][3], u_projViewMatrix[3][3]);
+        vec4 rowN = vec4(u_projViewMatrix[0][row], u_projViewMatrix[1][row], u_projViewMatrix[2][row], u_projViewMatrix[3][row]);
+        s_frustumPlanes[gl_LocalInvocationIndex] = row3 + direction * rowN;
+    }
+
+    barrier();
+
+    uint meshIndex = gl_GlobalInvocationID.x;
+    if (meshIndex >= uint(u_cullMeshes.length()))
+        return;
+
+    CullMeshData mesh = u_cullMeshes[meshIndex];
+
+    //The box is outside if its corner furthest along the plane normal is behind the plane (the planes do not need
+    //to be normalized for this)
+    for (int i = 0; i < 6; i++)
+    {
+        vec4 plane = s_frustumPlanes[i];
+        if (dot(plane.xyz, mesh.boundsCenter) + dot(abs(plane.xyz), mesh.boundsExtent) + plane.w < 0.0)
+            return;
+    }
+
+    if (u_collectStats)
+        atomicAdd(u_numInFrustum, 1u);
+
+    if (u_occlusionCulling && IsOccluded(mesh.boundsCenter, mesh.boundsExtent))
+        return;
+
+    if (u_collectStats)
+        atomicAdd(u_numVisible, 1u);
+
+    //baseInstance is the mesh index so that ModelVertex.glsl (INSTANCING) can find the model matrix using gl_BaseInstance
+    uint slot = atomicAdd(u_culledDrawCounts[mesh.materialIndex], 1u);
+    u_culledCommands[mesh.commandRegion + slot] = DrawElementsIndirectCommand(
+        mesh.indexCount, 1u, mesh.firstIndex, mesh.baseVertex, meshIndex
+    );
+}
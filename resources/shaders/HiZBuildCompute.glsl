@@ -0,0 +1,65 @@
+#version 460 core
+
+layout(local_size_x = 8, local_size_y = 8) in; //NOTE: DO NOT UPDATE without changing HiZBuffer::buildWorkGroupSize
+
+
+//NOTE: DO NOT UPDATE the bindings without changing HiZBuffer::textureUnit and HiZBuffer::multisampleTextureUnit
+//Only read for level 0, u_depthMultisample if the depth buffer is multisampled and u_depth otherwise
+layout(binding = 16) uniform sampler2D u_depth;
+layout(binding = 17) uniform sampler2DMS u_depthMultisample;
+
+layout(r32f, binding = 0) readonly uniform image2D u_source; //The level above, not read for level 0
+layout(r32f, binding = 1) writeonly uniform image2D u_destination;
+
+uniform uint u_level;
+uniform int u_numSamples;
+
+
+//The furthest depth of all samples of the pixel, so that level 0 never hides what any of them shows
+float GetFurthestDepth(ivec2 pixel)
+{
+    if (u_numSamples <= 1)
+        return texelFetch(u_depth, pixel, 0).r;
+
+    float furthestDepth = 0.0;
+    for (int i = 0; i < u_numSamples; i++)
+        furthestDepth = max(furthestDepth, texelFetch(u_depthMultisample, pixel, i).r);
+
+    return furthestDepth;
+}
+
+
+void main()
+{
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 size = imageSize(u_destination);
+    if (any(greaterThanEqual(texel, size)))
+        return;
+
+    float maxDepth = 0.0;
+
+    if (u_level == 0u)
+    {
+        //Level 0 is up to 2 times smaller than the screen, but not by a whole number, so every pixel that the texel
+        //overlaps has to be included for the result to stay conservative
+        ivec2 depthSize = u_numSamples > 1 ? textureSize(u_depthMultisample) : textureSize(u_depth, 0);
+        ivec2 first = texel * depthSize / size;
+        ivec2 last = min(((texel + 1) * depthSize + size - 1) / size, depthSize) - 1;
+
+        for (int y = first.y; y <= last.y; y++)
+        {
+            for (int x = first.x; x <= last.x; x++)
+                maxDepth = max(maxDepth, GetFurthestDepth(ivec2(x, y)));
+        }
+    }
+    else
+    {
+        ivec2 sourceTexel = texel * 2;
+        maxDepth = max(
+            max(imageLoad(u_source, sourceTexel).r, imageLoad(u_source, sourceTexel + ivec2(1, 0)).r),
+            max(imageLoad(u_source, sourceTexel + ivec2(0, 1)).r, imageLoad(u_source, sourceTexel + ivec2(1, 1)).r)
+        );
+    }
+
+    imageStore(u_destination, texel, vec4(maxDepth));
+}
@@ -0,0 +1,102 @@
+#version 460 core
+
+layout(local_size_x = 64) in; //NOTE: DO NOT UPDATE without changing ClusteredLights::clusterWorkGroupSize
+
+
+//NOTE: DO NOT UPDATE THESE without changing ClusteredLights
+const uint numClustersX = 16;
+const uint numClustersY = 9;
+const uint numClustersZ = 24;
+const uint numClusters = numClustersX * numClustersY * numClustersZ;
+const uint maxLightsPerCluster = 128;
+
+layout(std140, binding = 1) uniform ClusterUniforms
+{
+    vec2 u_clusterTileSize;
+    float u_clusterSliceScale;
+    float u_clusterSliceBias;
+    vec2 u_inverseProjection;
+    float u_nearPlane;
+    float u_farPlane;
+    uint u_numLights;
+};
+
+struct Light
+{
+    vec3 viewPosition;
+    float radius;
+    vec3 color;
+    float padding;
+};
+
+layout(std430, binding = 6) readonly buffer LightBlock
+{
+    Light u_lights[];
+};
+
+layout(std430, binding = 7) writeonly buffer ClusterLightCountBlock
+{
+    uint u_clusterLightCounts[];
+};
+
+//Every cluster has maxLightsPerCluster indices into u_lights, starting at clusterIndex * maxLightsPerCluster
+layout(std430, binding = 8) writeonly buffer ClusterLightIndexBlock
+{
+    uint u_clusterLightIndices[];
+};
+
+
+//The lights are tested in batches, every invocation of the work group loads one light of the batch
+shared vec4 s_lightSpheres[gl_WorkGroupSize.x];
+
+//The view space depth where a slice starts, the inverse of the slice calculation in ModelFrag.glsl
+float SliceDepth(uint slice)
+{
+    return exp((float(slice) - u_clusterSliceBias) / u_clusterSliceScale);
+}
+
+void main()
+{
+    //x changes the fastest, then y, then the slice
+    uint clusterIndex = gl_GlobalInvocationID.x;
+    uint x = clusterIndex % numClustersX;
+    uint y = clusterIndex / numClustersX % numClustersY;
+    uint slice = clusterIndex / (numClustersX * numClustersY);
+
+    //The bounds of the cluster in view space are the bounds of its tile at the near and far depth of its slice,
+    //as a point at NDC xy and depth d is at xy * d * u_inverseProjection in view space (and at -d in z)
+    vec2 ndcMin = vec2(x, y) / vec2(numClustersX, numClustersY) * 2.0 - 1.0;
+    vec2 ndcMax = vec2(x + 1, y + 1) / vec2(numClustersX, numClustersY) * 2.0 - 1.0;
+    float nearDepth = SliceDepth(slice);
+    float farDepth = SliceDepth(slice + 1);
+
+    vec3 boundsMin = vec3(min(ndcMin * nearDepth, ndcMin * farDepth) * u_inverseProjection, -farDepth);
+    vec3 boundsMax = vec3(max(ndcMax * nearDepth, ndcMax * farDepth) * u_inverseProjection, -nearDepth);
+
+    uint firstIndex = clusterIndex * maxLightsPerCluster;
+    uint count = 0;
+
+    for (uint batchStart = 0; batchStart < u_numLights; batchStart += gl_WorkGroupSize.x)
+    {
+        uint lightIndex = batchStart + gl_LocalInvocationIndex;
+        if (lightIndex < u_numLights)
+            s_lightSpheres[gl_LocalInvocationIndex] = vec4(u_lights[lightIndex].viewPosition, u_lights[lightIndex].radius);
+
+        barrier();
+
+        uint batchSize = min(gl_WorkGroupSize.x, u_numLights - batchStart);
+        for (uint i = 0; i < batchSize && count < maxLightsPerCluster; i++)
+        {
+            //The sphere touches the box if the closest point of the box is inside of it
+            vec4 sphere = s_lightSpheres[i];
+            vec3 offset = clamp(sphere.xyz, boundsMin, boundsMax) - sphere.xyz;
+
+            if (dot(offset, offset) <= sphere.w * sphere.w)
+                u_clusterLightIndices[firstIndex + count++] = batchStart + i;
+        }
+
+        barrier(); //The next batch must not overwrite the lights before every invocation is done with them
+    }
+
+    u_clusterLightCounts[clusterIndex] = count;
+}
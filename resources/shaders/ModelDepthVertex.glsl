@@ -0,0 +1,58 @@
+#version 460 core
+
+//The depth pre-pass version of ModelVertex.glsl, only the position is read and written. It has the same INSTANCING
+//feature key
+layout(location = 0) in vec4 l_position;
+
+//Has to match ModelVertex.glsl exactly, as the lighting pass tests its depth with GL_EQUAL
+invariant gl_Position;
+
+
+//NOTE: DO NOT UPDATE THESE BLOCKS without changing FrameUniforms, ObjectUniforms and MultiDrawBatch::MeshData
+#ifdef INSTANCING
+
+layout(std140, binding = 0) uniform FrameUniforms
+{
+    mat4 u_viewMatrix;
+    mat4 u_projectionMatrix;
+    mat4 u_projViewMatrix;
+};
+
+struct MeshData
+{
+    mat4 modelMatrix;
+    mat3 normalMatrix;
+    uvec4 textureLayers;
+};
+
+layout(std430, binding = 0) readonly buffer MeshDataBlock
+{
+    MeshData u_meshes[];
+};
+
+#else
+
+struct ObjectUniforms
+{
+    mat4 modelMatrix;
+    mat4 MVP;
+    mat3 normalMatrix;
+    uvec4 textureLayers;
+};
+
+layout(std430, binding = 1) readonly buffer ObjectUniformBlock
+{
+    ObjectUniforms u_objects[];
+};
+
+#endif
+
+
+void main()
+{
+#ifdef INSTANCING
+    gl_Position = u_projViewMatrix * u_meshes[gl_BaseInstance + gl_InstanceID].modelMatrix * l_position;
+#else
+    gl_Position = u_objects[gl_BaseInstance].MVP * l_position;
+#endif
+}
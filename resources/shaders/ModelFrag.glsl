@@ -1,81 +1,140 @@
 #version 430
 
+//Feature keys (see ShaderFeature in Shader.h), every combination is compiled as its own program so nothing branches on
+//them at runtime:
+//  LIGHTING: lit by the clustered point lights, otherwise the diffuse texture is drawn as it is (for overlays)
+//  SPECULAR_MAP: the material has a specular texture (see Material::GetShaderFeatures()), otherwise the specular
+//                strength is constant
+
 layout(location = 0) out vec4 l_color;
 
 
 in vec2 v_texCoord;
 in vec3 v_normal;
 in vec3 v_viewSpaceCoord;
-in vec3 v_lightPos;
+flat in uint v_diffuseLayer;
+flat in uint v_specularLayer;
+
+
+//NOTE: DO NOT UPDATE THESE without changing the code in Material class
+//Every texture is a layer of a texture array, the layer comes from the per object data
+uniform sampler2DArray u_textureDiffuse0;
+
+#if defined(LIGHTING) && defined(SPECULAR_MAP)
+uniform sampler2DArray u_textureSpecular0;
+#endif
 
 
-//NOTE: DO NOT UPDATE THESE without changing the code in mesh class
-uniform sampler2D u_textureDiffuse0;
-uniform sampler2D u_textureSpecular0;
+#ifdef LIGHTING
 
-uniform bool u_enableLighting;
-uniform bool u_haveSpecularTexture;
+//NOTE: DO NOT UPDATE THESE without changing ClusteredLights
+const uint numClustersX = 16;
+const uint numClustersY = 9;
+const uint numClustersZ = 24;
+const uint maxLightsPerCluster = 128;
 
+layout(std140, binding = 1) uniform ClusterUniforms
+{
+    vec2 u_clusterTileSize;
+    float u_clusterSliceScale;
+    float u_clusterSliceBias;
+    vec2 u_inverseProjection;
+    float u_nearPlane;
+    float u_farPlane;
+    uint u_numLights;
+};
+
+struct Light
+{
+    vec3 viewPosition;
+    float radius;
+    vec3 color;
+    float padding;
+};
 
-float LightFallOff(float distance)
+layout(std430, binding = 6) readonly buffer LightBlock
 {
-    if (distance > 50) {
-        float divideFactor = abs(1.25 / (55 - distance));
+    Light u_lights[];
+};
 
-        if (divideFactor < 1)
-            divideFactor = 1;
+//Written by LightClusterCompute.glsl
+layout(std430, binding = 7) readonly buffer ClusterLightCountBlock
+{
+    uint u_clusterLightCounts[];
+};
 
-        return (min(500.0 / pow(1.12, distance), 1.5)) / divideFactor;
-    }
-    return min(500.0 / pow(1.12, distance), 1.5);
+layout(std430, binding = 8) readonly buffer ClusterLightIndexBlock
+{
+    uint u_clusterLightIndices[];
+};
+
+
+uint GetClusterIndex()
+{
+    float depth = max(-v_viewSpaceCoord.z, u_nearPlane);
+    uint slice = uint(clamp(log(depth) * u_clusterSliceScale + u_clusterSliceBias, 0.0, float(numClustersZ - 1)));
+    uvec2 tile = min(uvec2(gl_FragCoord.xy / u_clusterTileSize), uvec2(numClustersX - 1, numClustersY - 1));
+
+    return tile.x + tile.y * numClustersX + slice * numClustersX * numClustersY;
+}
+
+//Smoothly reaches 0 at the radius of the light, so the clusters past the radius can leave the light out
+float LightAttenuation(float distance, float radius)
+{
+    float ratio = distance / radius;
+    float window = clamp(1.0 - ratio * ratio * ratio * ratio, 0.0, 1.0);
+    return window * window;
 }
 
+#endif
+
 void main()
 {
-    if (!u_enableLighting)
-    {
-        l_color = texture(u_textureDiffuse0, v_texCoord);
-        return;
-    }
+    l_color = texture(u_textureDiffuse0, vec3(v_texCoord, v_diffuseLayer));
 
+#ifdef LIGHTING
     const float ambientStrength = 0.15;
     const float specularStrength = 0.2;
 
-    float distance = abs(length(v_lightPos - v_viewSpaceCoord));
-    l_color = texture(u_textureDiffuse0, v_texCoord);
-
-    if (distance > 55) {
-        l_color.rgb = l_color.rgb / 8;
-        return; //If the distance is greater than 55, then we can just return immedietly as light will have next to no effect
-    }
-
-    float lightIntensityDiffuse = LightFallOff(distance);
-
     vec3 normal = normalize(v_normal);
-    vec3 lightDir = normalize(v_lightPos - v_viewSpaceCoord);
+
+#ifdef SPECULAR_MAP
+    //The specular texture does not depend on the direction of the light, so it is only read once
+    vec3 specularTexel = texture(u_textureSpecular0, vec3(v_texCoord, v_specularLayer)).rgb * specularStrength;
+#else
     vec3 viewDir = normalize(-v_viewSpaceCoord);
+#endif
 
-    //Abient
-    vec3 ambient = ambientStrength * vec3(1.0, 1.0, 1.0);//TODO: replace vec3 with u_lightColor
+    vec3 lightingResult = vec3(ambientStrength);
 
-    //Diffuse
-    float diff = max(dot(normal, lightDir), 0.0);
-    vec3 diffuse = diff * vec3(1.0, 1.0, 1.0);//TODO: replace vec3 with u_lightColor
+    uint clusterIndex = GetClusterIndex();
+    uint firstIndex = clusterIndex * maxLightsPerCluster;
+    uint numLights = u_clusterLightCounts[clusterIndex];
 
-    //specular
-    vec3 specular;
-    if (u_haveSpecularTexture)
+    for (uint i = 0; i < numLights; i++)
     {
-        specular = texture(u_textureSpecular0, v_texCoord).rgb * vec3(1.0, 1.0, 1.0) * vec3(specularStrength, specularStrength, specularStrength);//TODO: replace first vec3 with u_lightColor
-    }
-    else
-    {
-        vec3 reflectDir = reflect(-lightDir, normal);
-        float spec = pow(max(dot(viewDir, reflectDir), 0.0), 2);
-        specular = (specularStrength * spec) * vec3(1.0, 1.0, 1.0); //TODO: replace vec3 with u_lightColor
-    }
+        Light light = u_lights[u_clusterLightIndices[firstIndex + i]];
+
+        vec3 toLight = light.viewPosition - v_viewSpaceCoord;
+        float distanceSquared = dot(toLight, toLight);
+        if (distanceSquared >= light.radius * light.radius)
+            continue; //The cluster touches the light, but this fragment is outside of it
 
-    vec3 lightingResult = ambient + (diffuse * lightIntensityDiffuse) + specular;
+        float distance = sqrt(distanceSquared);
+        vec3 lightDir = toLight / distance;
+
+        float diffuse = max(dot(normal, lightDir), 0.0);
+
+#ifdef SPECULAR_MAP
+        vec3 specular = specularTexel;
+#else
+        float spec = max(dot(viewDir, reflect(-lightDir, normal)), 0.0);
+        vec3 specular = vec3(specularStrength * spec * spec);
+#endif
+
+        lightingResult += light.color * LightAttenuation(distance, light.radius) * (diffuse + specular);
+    }
 
     l_color = vec4(lightingResult, 1.0) * l_color;
+#endif
 }
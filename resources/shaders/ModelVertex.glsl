@@ -1,4 +1,8 @@
-#version 430 core
+#version 460 core
+
+//Feature keys (see ShaderFeature in Shader.h):
+//  INSTANCING: the per draw data is a MultiDrawBatch::MeshData indexed by gl_BaseInstance + gl_InstanceID, instead of
+//              the ObjectUniforms of Renderer::PushObjectUniforms. Used by MultiDrawBatch and Quads3D::DrawInstanced()
 
 layout(location = 0) in vec4 l_position;
 layout(location = 1) in vec2 l_texCoord;
@@ -8,24 +12,72 @@ layout(location = 2) in vec3 l_normal;
 out vec2 v_texCoord;
 out vec3 v_normal;
 out vec3 v_viewSpaceCoord;
-out vec3 v_lightPos;
+flat out uint v_diffuseLayer;
+flat out uint v_specularLayer;
+
+//The depth pre-pass (ModelDepthVertex.glsl) has to compute exactly the same depth for GL_EQUAL
+invariant gl_Position;
 
 
-uniform mat4 u_MVP;
-uniform mat4 u_viewMatrix;
-uniform mat4 u_modelMatrix;
+//NOTE: DO NOT UPDATE THESE BLOCKS without changing FrameUniforms, ObjectUniforms and MultiDrawBatch::MeshData
+layout(std140, binding = 0) uniform FrameUniforms
+{
+    mat4 u_viewMatrix;
+    mat4 u_projectionMatrix;
+    mat4 u_projViewMatrix;
+};
+
+#ifdef INSTANCING
+
+struct MeshData
+{
+    mat4 modelMatrix;
+    mat3 normalMatrix;
+    uvec4 textureLayers;
+};
+
+//MultiDrawBatch sets gl_BaseInstance to the index of the mesh being drawn (with one instance), and instanced draws
+//such as Quads3D::DrawInstanced() have one MeshData per instance. The binding is MultiDrawBatch::meshDataBinding
+layout(std430, binding = 0) readonly buffer MeshDataBlock
+{
+    MeshData u_meshes[];
+};
+
+#else
+
+struct ObjectUniforms
+{
+    mat4 modelMatrix;
+    mat4 MVP;
+    mat3 normalMatrix;
+    uvec4 textureLayers;
+};
+
+//Indexed by gl_BaseInstance, which Renderer::Draw sets to the draw ID returned by Renderer::PushObjectUniforms
+layout(std430, binding = 1) readonly buffer ObjectUniformBlock
+{
+    ObjectUniforms u_objects[];
+};
 
-uniform vec3 u_lightPos;
-uniform float u_time;
+#endif
 
 
 void main()
 {
-    gl_Position = u_MVP * l_position;
+#ifdef INSTANCING
+    MeshData object = u_meshes[gl_BaseInstance + gl_InstanceID];
+    gl_Position = u_projViewMatrix * object.modelMatrix * l_position;
+#else
+    ObjectUniforms object = u_objects[gl_BaseInstance];
+    gl_Position = object.MVP * l_position;
+#endif
 
     v_texCoord = l_texCoord;
-    v_lightPos = vec3(u_viewMatrix * vec4(u_lightPos, 1.0)); //TODO: We use an uniform for this instead
+    v_diffuseLayer = object.textureLayers.x;
+    v_specularLayer = object.textureLayers.y;
 
-    v_normal = mat3(transpose(inverse(u_viewMatrix * u_modelMatrix))) * l_normal;
-    v_viewSpaceCoord = vec3(u_viewMatrix * u_modelMatrix * l_position);
+    //The normal matrix is world space (computed once per object on the CPU), and the view matrix only rotates and
+    //translates, so its upper 3x3 is already its own inverse transpose
+    v_normal = mat3(u_viewMatrix) * (object.normalMatrix * l_normal);
+    v_viewSpaceCoord = vec3(u_viewMatrix * object.modelMatrix * l_position);
 }
@@ -4,6 +4,7 @@ layout(location = 0) in vec3 l_position;
 layout(location = 1) in vec4 l_color;
 
 uniform mat4 u_MVP;
+uniform vec4 u_color; //The color of the body, multiplied with the colors of its vertices
 
 out vec4 v_color;
 
@@ -12,5 +13,5 @@ void main()
     vec4 position = vec4(l_position, 1.0);
     gl_Position = u_MVP * position;
 
-    v_color = l_color;
+    v_color = l_color * u_color;
 }
@@ -0,0 +1,182 @@
+#include "AABBCullKernel.h"
+
+#include <algorithm>
+
+#ifdef JPH_USE_AVX
+    #include <immintrin.h>
+#endif
+
+void AABBCullKernel::Bounds::Clear()
+{
+    m_centerX.clear();
+    m_centerY.clear();
+    m_centerZ.clear();
+    m_extentX.clear();
+    m_extentY.clear();
+    m_extentZ.clear();
+
+    m_numBoxes = 0;
+}
+
+void AABBCullKernel::Bounds::Reserve(uint numBoxes)
+{
+    uint paddedSize = (numBoxes + boxesPerIteration - 1) / boxesPerIteration * boxesPerIteration;
+
+    m_centerX.reserve(paddedSize);
+    m_centerY.reserve(paddedSize);
+    m_centerZ.reserve(paddedSize);
+    m_extentX.reserve(paddedSize);
+    m_extentY.reserve(paddedSize);
+    m_extentZ.reserve(paddedSize);
+}
+
+uint AABBCullKernel::Bounds::Add(const JPH::AABox &box)
+{
+    //The padding boxes are empty boxes at the origin, Cull() clears their bits
+    if (m_numBoxes % boxesPerIteration == 0)
+    {
+        uint paddedSize = m_numBoxes + boxesPerIteration;
+
+        m_centerX.resize(paddedSize);
+        m_centerY.resize(paddedSize);
+        m_centerZ.resize(paddedSize);
+        m_extentX.resize(paddedSize);
+        m_extentY.resize(paddedSize);
+        m_extentZ.resize(paddedSize);
+    }
+
+    uint index = m_numBoxes++;
+    Set(index, box);
+    return index;
+}
+
+void AABBCullKernel::Bounds::Set(uint index, const JPH::AABox &box)
+{
+    ASSERT_LOG(index < m_numBoxes, "Box index " << index << " is out of range, there are only " << m_numBoxes << " boxes");
+
+    JPH::Vec3 center = box.GetCenter();
+    JPH::Vec3 extent = box.GetExtent();
+
+    m_centerX[index] = center.GetX();
+    m_centerY[index] = center.GetY();
+    m_centerZ[index] = center.GetZ();
+    m_extentX[index] = extent.GetX();
+    m_extentY[index] = extent.GetY();
+    m_extentZ[index] = extent.GetZ();
+}
+
+JPH::AABox AABBCullKernel::Bounds::Get(uint index) const
+{
+    ASSERT_LOG(index < m_numBoxes, "Box index " << index << " is out of range, there are only " << m_numBoxes << " boxes");
+
+    JPH::Vec3 center(m_centerX[index], m_centerY[index], m_centerZ[index]);
+    JPH::Vec3 extent(m_extentX[index], m_extentY[index], m_extentZ[index]);
+    return JPH::AABox(center - extent, center + extent);
+}
+
+/*static*/ void AABBCullKernel::Cull(const Planes &planes, const Bounds &bounds, std::vector<uint64> &outVisibleMask)
+{
+    outVisibleMask.assign(GetMaskSize(bounds.m_numBoxes), 0);
+    CullRange(planes, bounds, 0, bounds.m_numBoxes, outVisibleMask);
+}
+
+/*static*/ void AABBCullKernel::CullRange(
+    const Planes &planes, const Bounds &bounds, uint firstBox, uint numBoxes, std::vector<uint64> &outVisibleMask)
+{
+    ASSERT_LOG(firstBox % 64 == 0, "The first box of a range has to be a multiple of 64, but it is " << firstBox);
+
+    //The arrays are padded, so the range can always be rounded up to a whole iteration
+    uint endPadded = std::min<uint>(firstBox + numBoxes, bounds.m_centerX.size());
+
+    //A box is outside if its corner furthest along the plane normal is behind the plane, which is
+    //dot(normal, center) + dot(abs(normal), extent) + distance < 0. This is the same test as FrustumCuller, without branches
+#ifdef JPH_USE_AVX
+    __m256 planeX[6], planeY[6], planeZ[6], planeW[6];
+    __m256 absPlaneX[6], absPlaneY[6], absPlaneZ[6];
+
+    for (uint i = 0; i < 6; i++)
+    {
+        planeX[i] = _mm256_set1_ps(planes[i].GetX());
+        planeY[i] = _mm256_set1_ps(planes[i].GetY());
+        planeZ[i] = _mm256_set1_ps(planes[i].GetZ());
+        planeW[i] = _mm256_set1_ps(planes[i].GetW());
+
+        absPlaneX[i] = _mm256_set1_ps(std::abs(planes[i].GetX()));
+        absPlaneY[i] = _mm256_set1_ps(std::abs(planes[i].GetY()));
+        absPlaneZ[i] = _mm256_set1_ps(std::abs(planes[i].GetZ()));
+    }
+
+    const __m256 zero = _mm256_setzero_ps();
+
+    for (uint first = firstBox; first < endPadded; first += 8)
+    {
+        __m256 centerX = _mm256_loadu_ps(&bounds.m_centerX[first]);
+        __m256 centerY = _mm256_loadu_ps(&bounds.m_centerY[first]);
+        __m256 centerZ = _mm256_loadu_ps(&bounds.m_centerZ[first]);
+        __m256 extentX = _mm256_loadu_ps(&bounds.m_extentX[first]);
+        __m256 extentY = _mm256_loadu_ps(&bounds.m_extentY[first]);
+        __m256 extentZ = _mm256_loadu_ps(&bounds.m_extentZ[first]);
+
+        __m256 outside = zero;
+        for (uint i = 0; i < 6; i++)
+        {
+            __m256 centerDistance = _mm256_add_ps(
+                _mm256_add_ps(_mm256_mul_ps(centerX, planeX[i]), _mm256_mul_ps(centerY, planeY[i])),
+                _mm256_add_ps(_mm256_mul_ps(centerZ, planeZ[i]), planeW[i])
+            );
+            __m256 radius = _mm256_add_ps(
+                _mm256_add_ps(_mm256_mul_ps(extentX, absPlaneX[i]), _mm256_mul_ps(extentY, absPlaneY[i])),
+                _mm256_mul_ps(extentZ, absPlaneZ[i])
+            );
+
+            outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(centerDistance, radius), zero, _CMP_LT_OQ));
+        }
+
+        uint64 visible = ~static_cast<uint>(_mm256_movemask_ps(outside)) & 0xFF;
+        outVisibleMask[first / 64] |= visible << (first % 64);
+    }
+#else
+    JPH::Vec4 planeX[6], planeY[6], planeZ[6], planeW[6];
+    JPH::Vec4 absPlaneX[6], absPlaneY[6], absPlaneZ[6];
+
+    for (uint i = 0; i < 6; i++)
+    {
+        planeX[i] = JPH::Vec4::sReplicate(planes[i].GetX());
+        planeY[i] = JPH::Vec4::sReplicate(planes[i].GetY());
+        planeZ[i] = JPH::Vec4::sReplicate(planes[i].GetZ());
+        planeW[i] = JPH::Vec4::sReplicate(planes[i].GetW());
+
+        absPlaneX[i] = planeX[i].Abs();
+        absPlaneY[i] = planeY[i].Abs();
+        absPlaneZ[i] = planeZ[i].Abs();
+    }
+
+    const JPH::Vec4 zero = JPH::Vec4::sZero();
+
+    for (uint first = firstBox; first < endPadded; first += 4)
+    {
+        JPH::Vec4 centerX = JPH::Vec4::sLoadFloat4(reinterpret_cast<const JPH::Float4*>(&bounds.m_centerX[first]));
+        JPH::Vec4 centerY = JPH::Vec4::sLoadFloat4(reinterpret_cast<const JPH::Float4*>(&bounds.m_centerY[first]));
+        JPH::Vec4 centerZ = JPH::Vec4::sLoadFloat4(reinterpret_cast<const JPH::Float4*>(&bounds.m_centerZ[first]));
+        JPH::Vec4 extentX = JPH::Vec4::sLoadFloat4(reinterpret_cast<const JPH::Float4*>(&bounds.m_extentX[first]));
+        JPH::Vec4 extentY = JPH::Vec4::sLoadFloat4(reinterpret_cast<const JPH::Float4*>(&bounds.m_extentY[first]));
+        JPH::Vec4 extentZ = JPH::Vec4::sLoadFloat4(reinterpret_cast<const JPH::Float4*>(&bounds.m_extentZ[first]));
+
+        JPH::UVec4 outside = JPH::UVec4::sZero();
+        for (uint i = 0; i < 6; i++)
+        {
+            JPH::Vec4 distance = centerX * planeX[i] + centerY * planeY[i] + centerZ * planeZ[i] + planeW[i] +
+                extentX * absPlaneX[i] + extentY * absPlaneY[i] + extentZ * absPlaneZ[i];
+
+            outside = JPH::UVec4::sOr(outside, JPH::Vec4::sLess(distance, zero));
+        }
+
+        uint64 visible = ~static_cast<uint>(outside.GetTrues()) & 0xF;
+        outVisibleMask[first / 64] |= visible << (first % 64);
+    }
+#endif
+
+    //Clear the bits of the padding boxes
+    if (endPadded == bounds.m_centerX.size() && bounds.m_numBoxes % 64 != 0)
+        outVisibleMask.back() &= (uint64(1) << (bounds.m_numBoxes % 64)) - 1;
+}
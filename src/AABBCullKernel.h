@@ -0,0 +1,68 @@
+#ifndef AABBCULLKERNEL_H
+#define AABBCULLKERNEL_H
+
+#include "Util.h"
+
+#include <Jolt/Geometry/AABox.h>
+
+#include <array>
+#include <vector>
+
+/*
+ * Frustum culling for many axis aligned boxes at once. The boxes are stored as a structure of arrays (one array for
+ * each axis of the centers and extents), so Cull() can test 8 boxes per iteration with AVX, or 4 with the SSE/NEON of
+ * JPH::Vec4 when AVX is not enabled.
+ *
+ * The result is a bitmask instead of a list of IDs: bit i % 64 of word i / 64 is set if box i is visible.
+ */
+class AABBCullKernel
+{
+public:
+    static constexpr uint boxesPerIteration = 8; //The arrays are padded to this, even when only 4 are tested at a time
+
+    //Planes as (normal, distance), with the normals pointing into the frustum. They do not need to be normalized
+    using Planes = std::array<JPH::Vec4, 6>;
+
+    class Bounds
+    {
+    private:
+        std::vector<float> m_centerX;
+        std::vector<float> m_centerY;
+        std::vector<float> m_centerZ;
+        std::vector<float> m_extentX;
+        std::vector<float> m_extentY;
+        std::vector<float> m_extentZ;
+
+        uint m_numBoxes = 0;
+
+        friend class AABBCullKernel;
+
+    public:
+        void Clear();
+        void Reserve(uint numBoxes);
+
+        //Returns the index of the box, which is its bit in the visibility mask
+        uint Add(const JPH::AABox& box);
+        void Set(uint index, const JPH::AABox& box);
+        JPH::AABox Get(uint index) const;
+
+        uint GetNumBoxes() const { return m_numBoxes; }
+    };
+
+    //outVisibleMask is resized to GetMaskSize(bounds.GetNumBoxes()), the bits past the last box are always 0
+    static void Cull(const Planes& planes, const Bounds& bounds, std::vector<uint64>& outVisibleMask);
+
+    /**
+     * Cull() of numBoxes boxes starting at firstBox, so the boxes can be split over multiple threads. outVisibleMask must
+     * already be GetMaskSize(bounds.GetNumBoxes()) words of zeros, and firstBox a multiple of 64 (and numBoxes too, apart
+     * from the last range), so that no two ranges write to the same word
+     */
+    static void CullRange(const Planes& planes, const Bounds& bounds, uint firstBox, uint numBoxes, std::vector<uint64>& outVisibleMask);
+
+    static uint GetMaskSize(uint numBoxes) { return (numBoxes + 63) / 64; }
+    static bool IsVisible(const std::vector<uint64>& visibleMask, uint index) { return visibleMask[index / 64] >> (index % 64) & 1; }
+};
+
+
+
+#endif //AABBCULLKERNEL_H
@@ -0,0 +1,118 @@
+#include "Buffer.h"
+
+Buffer::Buffer(uint target)
+	:	m_rendererID(0),
+		m_target(target),
+		m_size(0)
+{}
+
+Buffer::Buffer(uint target, const void* data, uint size, uint usage)
+	:	m_rendererID(0),
+		m_target(target),
+		m_size(0)
+{
+	Init(data, size, usage);
+}
+
+Buffer::Buffer(Buffer&& other) noexcept
+	:	m_rendererID(other.m_rendererID),
+		m_target(other.m_target),
+		m_size(other.m_size)
+{
+	other.m_rendererID = 0;
+	other.m_size = 0;
+}
+
+Buffer::~Buffer()
+{
+	glDeleteBuffers(1, &m_rendererID);
+	m_rendererID = 0;
+}
+
+void Buffer::Init(const void* data, uint size, uint usage)
+{
+	if (m_rendererID == 0)
+		glGenBuffers(1, &m_rendererID);
+
+	m_size = size;
+	glBindBuffer(m_target, m_rendererID);
+	glBufferData(m_target, size, data, usage);
+}
+
+void Buffer::InitStorage(const void* data, uint size, uint flags)
+{
+	ASSERT_LOG(m_rendererID == 0, "Immutable buffer storage can only be created once");
+	glGenBuffers(1, &m_rendererID);
+
+	m_size = size;
+	glBindBuffer(m_target, m_rendererID);
+	glBufferStorage(m_target, size, data, flags);
+}
+
+void* Buffer::Map(uint offset, uint size, uint access) const
+{
+	glBindBuffer(m_target, m_rendererID);
+	return glMapBufferRange(m_target, offset, size, access);
+}
+
+void Buffer::Bind() const
+{
+	glBindBuffer(m_target, m_rendererID);
+}
+
+void Buffer::Unbind() const
+{
+	glBindBuffer(m_target, 0);
+}
+
+void Buffer::BindBase(uint index) const
+{
+	glBindBufferBase(m_target, index, m_rendererID);
+}
+
+void Buffer::BindBase(uint target, uint index) const
+{
+	glBindBufferBase(target, index, m_rendererID);
+}
+
+void Buffer::BindRange(uint index, uint offset, uint size) const
+{
+	glBindBufferRange(m_target, index, m_rendererID, offset, size);
+}
+
+void Buffer::BindRange(uint target, uint index, uint offset, uint size) const
+{
+	glBindBufferRange(target, index, m_rendererID, offset, size);
+}
+
+void Buffer::SetData(const void* data, uint size, uint usage /* = GL_STREAM_DRAW */)
+{
+	if (m_rendererID == 0 || size > m_size)
+	{
+		Init(data, size, usage);
+		return;
+	}
+
+	//Orphan the old storage (same size so the driver can hand us a fresh block) and then upload
+	Bind();
+	glBufferData(m_target, m_size, nullptr, usage);
+	glBufferSubData(m_target, 0, size, data);
+}
+
+void Buffer::ChangeData(const void* newData, uint size, uint offset /* = 0 */)
+{
+	Bind();
+	glBufferSubData(m_target, offset, size, newData);
+}
+
+void Buffer::Clear()
+{
+	glBindBuffer(m_target, m_rendererID);
+	glClearBufferData(m_target, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+}
+
+void Buffer::GetData(void* data, uint size, uint offset /* = 0 */) const
+{
+	ASSERT_LOG(offset + size <= m_size, "Reading past the end of the buffer: " << offset + size << " > " << m_size);
+	glGetNamedBufferSubData(m_rendererID, offset, size, data);
+}
@@ -0,0 +1,64 @@
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include "Util.h"
+
+/*
+ * A generic OpenGL buffer object for the targets that do not have their own class (VertexBuffer and IndexBuffer do).
+ * This is used for shader storage buffers, uniform buffers and indirect draw buffers.
+ */
+class Buffer
+{
+private:
+	uint m_rendererID;
+	uint m_target;
+	uint m_size;
+
+public:
+	explicit Buffer(uint target);
+	Buffer(uint target, const void* data, uint size, uint usage = GL_STATIC_DRAW);
+
+	Buffer(const Buffer&) = delete; //No copying!!! Leads to us after free issues
+	Buffer& operator=(const Buffer&) = delete;
+
+	Buffer(Buffer&& other) noexcept;
+
+	~Buffer();
+
+	void Init(const void* data, uint size, uint usage = GL_STATIC_DRAW); //For delayed initialization
+
+	//Creates immutable storage (glBufferStorage). flags are the GL_MAP_*_BIT / GL_DYNAMIC_STORAGE_BIT flags
+	void InitStorage(const void* data, uint size, uint flags);
+
+	//Maps a range of the buffer. For persistent mappings the pointer stays valid until the buffer is destroyed
+	void* Map(uint offset, uint size, uint access) const;
+
+	void Bind() const;
+	void Unbind() const;
+
+	//Binds the buffer to an indexed binding point (only valid for uniform, shader storage, atomic counter and transform feedback buffers)
+	void BindBase(uint index) const;
+	void BindBase(uint target, uint index) const;
+	void BindRange(uint index, uint offset, uint size) const;
+	void BindRange(uint target, uint index, uint offset, uint size) const;
+
+	/*
+	 * Replaces the data in the buffer. If size is larger than the current size, the buffer is reallocated,
+	 * otherwise the old storage is orphaned so that we do not have to wait for the GPU to finish using it.
+	 */
+	void SetData(const void* data, uint size, uint usage = GL_STREAM_DRAW);
+	void ChangeData(const void* newData, uint size, uint offset = 0);
+
+	//Sets the whole buffer to 0 on the GPU, the size must be a multiple of 4
+	void Clear();
+
+	//Copies data out of the buffer. This waits for the GPU to finish writing to it, so only use it for small buffers
+	void GetData(void* data, uint size, uint offset = 0) const;
+
+	uint GetRendererID() const { return m_rendererID; }
+	uint GetSize() const { return m_size; }
+};
+
+
+
+#endif //BUFFER_H
@@ -0,0 +1,83 @@
+#include "ClusteredLights.h"
+
+#include <cmath>
+#include <cstring>
+
+ClusteredLights::ClusteredLights()
+	:	m_clusterLightCountBuffer(GL_SHADER_STORAGE_BUFFER),
+		m_clusterLightIndexBuffer(GL_SHADER_STORAGE_BUFFER)
+{
+	m_lights.reserve(maxLights);
+	m_gpuLights.reserve(maxLights);
+
+	//Only the compute shader writes these, and only the fragment shader reads them
+	m_clusterLightCountBuffer.Init(nullptr, numClusters * sizeof(uint), GL_DYNAMIC_COPY);
+	m_clusterLightIndexBuffer.Init(nullptr, numClusters * maxLightsPerCluster * sizeof(uint), GL_DYNAMIC_COPY);
+}
+
+void ClusteredLights::AddLight(const PointLight &light)
+{
+	if (m_lights.size() == maxLights)
+	{
+		std::cout << "[WARNING, ClusteredLights.cpp, AddLight] More than " << maxLights << " lights, the rest are ignored" << std::endl;
+		return;
+	}
+
+	m_lights.push_back(light);
+}
+
+void ClusteredLights::Update(
+	Renderer &renderer, Shader &clusterShader, const JPH::Mat44 &viewMatrix, const JPH::Mat44 &projectionMatrix,
+	int screenWidth, int screenHeight)
+{
+	m_gpuLights.clear();
+	for (const PointLight& light : m_lights)
+	{
+		GPULight& gpuLight = m_gpuLights.emplace_back();
+		(viewMatrix * light.position).StoreFloat3(&gpuLight.viewPosition);
+		gpuLight.radius = light.radius;
+		(light.color * light.intensity).StoreFloat3(&gpuLight.color);
+		gpuLight.padding = 0.0f;
+	}
+
+	//sPerspective puts range = far / (near - far) in (2, 2) and range * near in (2, 3)
+	float range = projectionMatrix(2, 2);
+	float nearPlane = projectionMatrix(2, 3) / range;
+	float farPlane = projectionMatrix(2, 3) / (1.0f + range);
+	float logDepthRange = std::log(farPlane / nearPlane);
+
+	ClusterUniforms uniforms{};
+	uniforms.tileSizeX = static_cast<float>(screenWidth) / numClustersX;
+	uniforms.tileSizeY = static_cast<float>(screenHeight) / numClustersY;
+	uniforms.sliceScale = numClustersZ / logDepthRange;
+	uniforms.sliceBias = -(numClustersZ * std::log(nearPlane)) / logDepthRange;
+	uniforms.inverseProjectionX = 1.0f / projectionMatrix(0, 0);
+	uniforms.inverseProjectionY = 1.0f / projectionMatrix(1, 1);
+	uniforms.nearPlane = nearPlane;
+	uniforms.farPlane = farPlane;
+	uniforms.numLights = m_gpuLights.size();
+
+	//A new copy every frame, as the GPU may still be reading the lights of the last frames
+	StreamBuffer& streamBuffer = renderer.GetStreamBuffer();
+	uint lightsSize = std::max<uint>(m_gpuLights.size(), 1) * sizeof(GPULight); //A bound range cannot be empty
+
+	StreamBuffer::Allocation lightsAllocation = streamBuffer.Allocate(lightsSize, renderer.GetStorageOffsetAlignment());
+	StreamBuffer::Allocation uniformsAllocation =
+		streamBuffer.Allocate(sizeof(ClusterUniforms), renderer.GetUniformOffsetAlignment());
+	ASSERT_LOG(
+		lightsAllocation.data != nullptr && uniformsAllocation.data != nullptr,
+		"The stream buffer is full, increase Renderer::streamBufferRegionSize"
+	);
+
+	if (!m_gpuLights.empty())
+		std::memcpy(lightsAllocation.data, m_gpuLights.data(), m_gpuLights.size() * sizeof(GPULight));
+	std::memcpy(uniformsAllocation.data, &uniforms, sizeof(ClusterUniforms));
+
+	streamBuffer.GetBuffer().BindRange(GL_UNIFORM_BUFFER, clusterUniformsBinding, uniformsAllocation.offset, sizeof(ClusterUniforms));
+	streamBuffer.GetBuffer().BindRange(GL_SHADER_STORAGE_BUFFER, lightsBinding, lightsAllocation.offset, lightsSize);
+	m_clusterLightCountBuffer.BindBase(clusterLightCountsBinding);
+	m_clusterLightIndexBuffer.BindBase(clusterLightIndicesBinding);
+
+	//Every cluster writes its own count and its own region of the index buffer, so nothing has to be cleared first
+	renderer.DispatchCompute(clusterShader, numClusters / clusterWorkGroupSize, 1, 1, GL_SHADER_STORAGE_BARRIER_BIT);
+}
@@ -0,0 +1,111 @@
+#ifndef CLUSTEREDLIGHTS_H
+#define CLUSTEREDLIGHTS_H
+
+#include "Util.h"
+
+#include "Buffer.h"
+#include "Renderer.h"
+#include "Shader.h"
+
+#include <vector>
+
+/*
+ * Clustered forward lighting. The view frustum is split into a grid of clusters (froxels): numClustersX by numClustersY
+ * tiles on the screen, each cut into numClustersZ slices in depth. The slices get exponentially thicker with distance,
+ * so that the clusters stay roughly as deep as they are wide.
+ *
+ * Every frame the lights are written in view space into the renderer's stream buffer, and a compute shader (LightClusterCompute.glsl) lists the lights
+ * whose sphere touches each cluster. ModelFrag.glsl finds the cluster of a fragment from gl_FragCoord and its depth, and
+ * only loops over the lights in that cluster, so the cost of a pixel depends on the lights near it instead of on how many
+ * lights there are in total.
+ */
+class ClusteredLights
+{
+public:
+	//NOTE: DO NOT UPDATE THESE without changing LightClusterCompute.glsl and ModelFrag.glsl
+	static constexpr uint numClustersX = 16;
+	static constexpr uint numClustersY = 9;
+	static constexpr uint numClustersZ = 24;
+	static constexpr uint numClusters = numClustersX * numClustersY * numClustersZ;
+	static constexpr uint maxLightsPerCluster = 128; //Any more lights that touch a cluster are left out of it
+	static constexpr uint clusterWorkGroupSize = 64;
+
+	static_assert(numClusters % clusterWorkGroupSize == 0, "The clusters are dispatched in whole work groups");
+
+	static constexpr uint clusterUniformsBinding = 1; //Uniform buffer binding point
+	static constexpr uint lightsBinding = 6; //Shader storage buffer binding points
+	static constexpr uint clusterLightCountsBinding = 7;
+	static constexpr uint clusterLightIndicesBinding = 8;
+
+	static constexpr uint maxLights = 4096;
+
+	struct PointLight
+	{
+		JPH::Vec3 position; //World space
+		float radius; //The light fades out to nothing at this distance
+		JPH::Vec3 color;
+		float intensity;
+	};
+
+private:
+	//NOTE: DO NOT UPDATE without changing the Light struct in LightClusterCompute.glsl and ModelFrag.glsl
+	struct GPULight
+	{
+		JPH::Float3 viewPosition;
+		float radius;
+		JPH::Float3 color; //Multiplied by the intensity
+		float padding;
+	};
+
+	static_assert(sizeof(GPULight) == 32, "GPULight must match the std430 layout of the Light struct");
+
+	//NOTE: DO NOT UPDATE without changing the ClusterUniforms block in LightClusterCompute.glsl and ModelFrag.glsl
+	struct ClusterUniforms
+	{
+		float tileSizeX; //In pixels
+		float tileSizeY;
+		float sliceScale; //The slice at a view space depth is log(depth) * sliceScale + sliceBias
+		float sliceBias;
+		float inverseProjectionX; //1 / projectionMatrix(0, 0), turns NDC x times depth into view space x
+		float inverseProjectionY;
+		float nearPlane;
+		float farPlane;
+		uint numLights;
+		uint padding[3];
+	};
+
+	static_assert(sizeof(ClusterUniforms) == 48, "ClusterUniforms must match the std140 layout of the ClusterUniforms block");
+
+	std::vector<PointLight> m_lights;
+	std::vector<GPULight> m_gpuLights; //Kept around so that we do not allocate every frame
+
+	//The lights and the cluster uniforms are allocated from Renderer::GetStreamBuffer() every frame
+	Buffer m_clusterLightCountBuffer;
+	Buffer m_clusterLightIndexBuffer;
+
+public:
+	ClusteredLights();
+
+	ClusteredLights(const ClusteredLights&) = delete;
+	ClusteredLights& operator=(const ClusteredLights&) = delete;
+
+	//The lights are added again every frame, so that lights that only last a moment (such as muzzle flashes) are easy
+	void Clear() { m_lights.clear(); }
+	void AddLight(const PointLight& light);
+
+	uint GetNumLights() const { return m_lights.size(); }
+
+	/*
+	 * Uploads the lights in the view space of viewMatrix, and assigns them to the clusters with clusterShader
+	 * (LightClusterCompute.glsl). Call this once the lights for the frame are added and before anything lit is drawn.
+	 * The projection must be a perspective projection like JPH::Mat44::sPerspective makes
+	 */
+	void Update(
+		Renderer& renderer, Shader& clusterShader, const JPH::Mat44& viewMatrix, const JPH::Mat44& projectionMatrix,
+		int screenWidth, int screenHeight
+	);
+};
+
+
+
+#endif //CLUSTEREDLIGHTS_H
@@ -0,0 +1,493 @@
+#include "CompressedTexture.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace
+{
+	//See https://learn.microsoft.com/en-us/windows/win32/direct3ddds/dx-graphics-dds-reference
+	constexpr uint32 ddsMagic = 0x20534444; //"DDS "
+
+	constexpr uint32 MakeFourCC(char a, char b, char c, char d)
+	{
+		return static_cast<uint32>(a) | static_cast<uint32>(b) << 8 | static_cast<uint32>(c) << 16 | static_cast<uint32>(d) << 24;
+	}
+
+	struct DDSPixelFormat
+	{
+		uint32 size;
+		uint32 flags;
+		uint32 fourCC;
+		uint32 rgbBitCount;
+		uint32 rBitMask, gBitMask, bBitMask, aBitMask;
+	};
+
+	struct DDSHeader
+	{
+		uint32 size;
+		uint32 flags;
+		uint32 height;
+		uint32 width;
+		uint32 pitchOrLinearSize;
+		uint32 depth;
+		uint32 mipMapCount;
+		uint32 reserved1[11];
+		DDSPixelFormat pixelFormat;
+		uint32 caps, caps2, caps3, caps4;
+		uint32 reserved2;
+	};
+
+	struct DDSHeaderDX10
+	{
+		uint32 dxgiFormat;
+		uint32 resourceDimension;
+		uint32 miscFlag;
+		uint32 arraySize;
+		uint32 miscFlags2;
+	};
+
+	static_assert(sizeof(DDSHeader) == 124, "DDSHeader must match the size of the header in the file");
+	static_assert(sizeof(DDSHeaderDX10) == 20, "DDSHeaderDX10 must match the size of the header in the file");
+
+	constexpr uint32 ddsFlagCaps = 0x1, ddsFlagHeight = 0x2, ddsFlagWidth = 0x4, ddsFlagPixelFormat = 0x1000;
+	constexpr uint32 ddsFlagMipMapCount = 0x20000, ddsFlagLinearSize = 0x80000;
+	constexpr uint32 ddsPixelFormatFourCC = 0x4;
+	constexpr uint32 ddsCapsComplex = 0x8, ddsCapsTexture = 0x1000, ddsCapsMipMap = 0x400000;
+	constexpr uint32 ddsDimensionTexture2D = 3;
+	constexpr uint32 ddsCaps2Cubemap = 0x200;
+
+	//DXGI_FORMAT values. sRGB variants are loaded as linear, because the uncompressed textures are linear (GL_RGBA8) too
+	constexpr uint32 dxgiBC1 = 71, dxgiBC1sRGB = 72;
+	constexpr uint32 dxgiBC3 = 77, dxgiBC3sRGB = 78;
+	constexpr uint32 dxgiBC5 = 83;
+	constexpr uint32 dxgiBC7 = 98, dxgiBC7sRGB = 99;
+
+	//See https://registry.khronos.org/KTX/specs/2.0/ktxspec.v2.html
+	constexpr uint8 ktx2Identifier[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+	//The 64 bit offsets are not 8 byte aligned in the file
+	#pragma pack(push, 1)
+	struct KTX2Header
+	{
+		uint32 vkFormat;
+		uint32 typeSize;
+		uint32 pixelWidth;
+		uint32 pixelHeight;
+		uint32 pixelDepth;
+		uint32 layerCount;
+		uint32 faceCount;
+		uint32 levelCount;
+		uint32 supercompressionScheme;
+
+		uint32 dfdByteOffset, dfdByteLength;
+		uint32 kvdByteOffset, kvdByteLength;
+		uint64 sgdByteOffset, sgdByteLength;
+	};
+	#pragma pack(pop)
+
+	struct KTX2LevelIndex
+	{
+		uint64 byteOffset;
+		uint64 byteLength;
+		uint64 uncompressedByteLength;
+	};
+
+	static_assert(sizeof(KTX2Header) == 68, "KTX2Header must match the size of the header in the file");
+
+	//VkFormat values
+	constexpr uint32 vkBC1RGB = 131, vkBC1RGBsRGB = 132, vkBC1RGBA = 133, vkBC1RGBAsRGB = 134;
+	constexpr uint32 vkBC3 = 137, vkBC3sRGB = 138;
+	constexpr uint32 vkBC5 = 141;
+	constexpr uint32 vkBC7 = 145, vkBC7sRGB = 146;
+
+	bool ConvertDXGIFormat(uint32 dxgiFormat, CompressedTexture::Format& outFormat)
+	{
+		switch (dxgiFormat)
+		{
+			case dxgiBC1: case dxgiBC1sRGB: outFormat = CompressedTexture::Format::bc1; return true;
+			case dxgiBC3: case dxgiBC3sRGB: outFormat = CompressedTexture::Format::bc3; return true;
+			case dxgiBC5:                   outFormat = CompressedTexture::Format::bc5; return true;
+			case dxgiBC7: case dxgiBC7sRGB: outFormat = CompressedTexture::Format::bc7; return true;
+			default: return false;
+		}
+	}
+
+	bool ConvertVkFormat(uint32 vkFormat, CompressedTexture::Format& outFormat)
+	{
+		switch (vkFormat)
+		{
+			case vkBC1RGB: case vkBC1RGBsRGB: case vkBC1RGBA: case vkBC1RGBAsRGB:
+				outFormat = CompressedTexture::Format::bc1; return true;
+			case vkBC3: case vkBC3sRGB: outFormat = CompressedTexture::Format::bc3; return true;
+			case vkBC5:                 outFormat = CompressedTexture::Format::bc5; return true;
+			case vkBC7: case vkBC7sRGB: outFormat = CompressedTexture::Format::bc7; return true;
+			default: return false;
+		}
+	}
+
+	uint32 ConvertToDXGIFormat(CompressedTexture::Format format)
+	{
+		switch (format)
+		{
+			case CompressedTexture::Format::bc1: return dxgiBC1;
+			case CompressedTexture::Format::bc3: return dxgiBC3;
+			case CompressedTexture::Format::bc5: return dxgiBC5;
+			case CompressedTexture::Format::bc7: return dxgiBC7;
+			default: return 0;
+		}
+	}
+
+	//Every block is a single endpoint with all indices pointing at it, so these decode to a solid colour
+	constexpr uint8 placeholderRGBA8[4] = {128, 128, 128, 255};
+	constexpr uint8 placeholderBC1[8] = {0x10, 0x84, 0x10, 0x84, 0, 0, 0, 0}; //Both endpoints RGB565 (16, 32, 16)
+	constexpr uint8 placeholderBC3[16] = {0xFF, 0xFF, 0, 0, 0, 0, 0, 0, 0x10, 0x84, 0x10, 0x84, 0, 0, 0, 0};
+	constexpr uint8 placeholderBC5[16] = {0x80, 0x80, 0, 0, 0, 0, 0, 0, 0x80, 0x80, 0, 0, 0, 0, 0, 0};
+	//Mode 6 with 7 bit endpoints of 64 (RGB) and 127 (A), and both p-bits set, which decodes to (129, 129, 129, 255)
+	constexpr uint8 placeholderBC7[16] = {0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0xFF, 0xFF, 0x01, 0, 0, 0, 0, 0, 0, 0};
+}
+
+/*static*/ bool CompressedTexture::ReadInfo(const std::string& path, Info& outInfo)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+
+	if (path.ends_with(".ktx2"))
+		return ReadKTX2(file, path, outInfo, nullptr);
+
+	return ReadDDS(file, path, outInfo, nullptr);
+}
+
+/*static*/ bool CompressedTexture::Load(const std::string& path, Info& outInfo, std::vector<uint8>& outLevels)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+	{
+		std::cerr << "[ERROR, CompressedTexture.cpp, Load] Failed to open compressed texture with path: \"" << path << "\"" << std::endl;
+		return false;
+	}
+
+	if (path.ends_with(".ktx2"))
+		return ReadKTX2(file, path, outInfo, &outLevels);
+
+	return ReadDDS(file, path, outInfo, &outLevels);
+}
+
+/*static*/ bool CompressedTexture::ReadDDS(std::ifstream& file, const std::string& path, Info& outInfo, std::vector<uint8>* outLevels)
+{
+	uint32 magic = 0;
+	DDSHeader header{};
+	file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+	if (!file || magic != ddsMagic || header.size != sizeof(DDSHeader))
+	{
+		std::cerr << "[ERROR, CompressedTexture.cpp, ReadDDS] \"" << path << "\" is not a DDS file" << std::endl;
+		return false;
+	}
+
+	if (!(header.pixelFormat.flags & ddsPixelFormatFourCC) || (header.caps2 & ddsCaps2Cubemap) || header.depth > 1)
+	{
+		std::cerr << "[ERROR, CompressedTexture.cpp, ReadDDS] \"" << path << "\" is not a block compressed 2D texture" << std::endl;
+		return false;
+	}
+
+	bool knownFormat = false;
+	switch (header.pixelFormat.fourCC)
+	{
+		case MakeFourCC('D', 'X', '1', '0'):
+		{
+			DDSHeaderDX10 headerDX10{};
+			file.read(reinterpret_cast<char*>(&headerDX10), sizeof(headerDX10));
+
+			knownFormat = file && headerDX10.resourceDimension == ddsDimensionTexture2D && headerDX10.arraySize <= 1 &&
+				ConvertDXGIFormat(headerDX10.dxgiFormat, outInfo.format);
+			break;
+		}
+		case MakeFourCC('D', 'X', 'T', '1'): outInfo.format = Format::bc1; knownFormat = true; break;
+		case MakeFourCC('D', 'X', 'T', '5'): outInfo.format = Format::bc3; knownFormat = true; break;
+		case MakeFourCC('A', 'T', 'I', '2'):
+		case MakeFourCC('B', 'C', '5', 'U'): outInfo.format = Format::bc5; knownFormat = true; break;
+		default: break;
+	}
+
+	if (!knownFormat)
+	{
+		std::cerr << "[ERROR, CompressedTexture.cpp, ReadDDS] \"" << path << "\" uses an unsupported format, only BC1, BC3, BC5 and BC7 are supported" << std::endl;
+		return false;
+	}
+
+	outInfo.width = static_cast<int>(header.width);
+	outInfo.height = static_cast<int>(header.height);
+	outInfo.numLevels = (header.flags & ddsFlagMipMapCount) ? std::max(header.mipMapCount, 1u) : 1;
+
+	if (outLevels == nullptr)
+		return true;
+
+	//The levels are stored one after the other right after the header, which is exactly how we keep them
+	outLevels->resize(GetMipChainSize(outInfo.format, outInfo.width, outInfo.height, outInfo.numLevels));
+	file.read(reinterpret_cast<char*>(outLevels->data()), static_cast<std::streamsize>(outLevels->size()));
+
+	if (!file)
+	{
+		std::cerr << "[ERROR, CompressedTexture.cpp, ReadDDS] \"" << path << "\" is truncated" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+/*static*/ bool CompressedTexture::ReadKTX2(std::ifstream& file, const std::string& path, Info& outInfo, std::vector<uint8>* outLevels)
+{
+	uint8 identifier[sizeof(ktx2Identifier)];
+	KTX2Header header{};
+	file.read(reinterpret_cast<char*>(identifier), sizeof(identifier));
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+	if (!file || std::memcmp(identifier, ktx2Identifier, sizeof(ktx2Identifier)) != 0)
+	{
+		std::cerr << "[ERROR, CompressedTexture.cpp, ReadKTX2] \"" << path << "\" is not a KTX2 file" << std::endl;
+		return false;
+	}
+
+	//Supercompressed (basis universal or zstd) files would have to be transcoded first, which is what the cooker is for
+	if (header.supercompressionScheme != 0 || header.pixelDepth > 1 || header.layerCount > 1 || header.faceCount != 1)
+	{
+		std::cerr << "[ERROR, CompressedTexture.cpp, ReadKTX2] \"" << path << "\" is not a plain 2D texture without supercompression" << std::endl;
+		return false;
+	}
+
+	if (!ConvertVkFormat(header.vkFormat, outInfo.format))
+	{
+		std::cerr << "[ERROR, CompressedTexture.cpp, ReadKTX2] \"" << path << "\" uses an unsupported format, only BC1, BC3, BC5 and BC7 are supported" << std::endl;
+		return false;
+	}
+
+	outInfo.width = static_cast<int>(header.pixelWidth);
+	outInfo.height = static_cast<int>(header.pixelHeight);
+	outInfo.numLevels = std::max(header.levelCount, 1u);
+
+	if (outLevels == nullptr)
+		return true;
+
+	std::vector<KTX2LevelIndex> levelIndex(outInfo.numLevels);
+	file.read(reinterpret_cast<char*>(levelIndex.data()), static_cast<std::streamsize>(levelIndex.size() * sizeof(KTX2LevelIndex)));
+
+	//Unlike DDS, the smallest level comes first in the file, so every level is read into its place separately
+	outLevels->resize(GetMipChainSize(outInfo.format, outInfo.width, outInfo.height, outInfo.numLevels));
+
+	uint64 offset = 0;
+	int width = outInfo.width;
+	int height = outInfo.height;
+
+	for (uint level = 0; level < outInfo.numLevels && file; level++)
+	{
+		uint64 levelSize = GetLevelSize(outInfo.format, width, height);
+		if (levelIndex[level].byteLength != levelSize)
+		{
+			std::cerr << "[ERROR, CompressedTexture.cpp, ReadKTX2] Level " << level << " of \"" << path << "\" has the wrong size" << std::endl;
+			return false;
+		}
+
+		file.seekg(static_cast<std::streamoff>(levelIndex[level].byteOffset));
+		file.read(reinterpret_cast<char*>(outLevels->data() + offset), static_cast<std::streamsize>(levelSize));
+
+		offset += levelSize;
+		width = std::max(width / 2, 1);
+		height = std::max(height / 2, 1);
+	}
+
+	if (!file)
+	{
+		std::cerr << "[ERROR, CompressedTexture.cpp, ReadKTX2] \"" << path << "\" is truncated" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+/*static*/ bool CompressedTexture::WriteDDS(const std::string& path, const Info& info, const std::vector<uint8>& levels)
+{
+	ASSERT_LOG(info.format != Format::rgba8, "Only block compressed textures can be written to DDS files");
+	ASSERT_LOG(levels.size() == GetMipChainSize(info.format, info.width, info.height, info.numLevels), "Level data does not match the texture info");
+
+	DDSHeader header{};
+	header.size = sizeof(DDSHeader);
+	header.flags = ddsFlagCaps | ddsFlagHeight | ddsFlagWidth | ddsFlagPixelFormat | ddsFlagMipMapCount | ddsFlagLinearSize;
+	header.height = info.height;
+	header.width = info.width;
+	header.pitchOrLinearSize = GetLevelSize(info.format, info.width, info.height);
+	header.mipMapCount = info.numLevels;
+	header.pixelFormat.size = sizeof(DDSPixelFormat);
+	header.pixelFormat.flags = ddsPixelFormatFourCC;
+	header.pixelFormat.fourCC = MakeFourCC('D', 'X', '1', '0');
+	header.caps = ddsCapsTexture | (info.numLevels > 1 ? ddsCapsComplex | ddsCapsMipMap : 0);
+
+	DDSHeaderDX10 headerDX10{};
+	headerDX10.dxgiFormat = ConvertToDXGIFormat(info.format);
+	headerDX10.resourceDimension = ddsDimensionTexture2D;
+	headerDX10.arraySize = 1;
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	file.write(reinterpret_cast<const char*>(&ddsMagic), sizeof(ddsMagic));
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(&headerDX10), sizeof(headerDX10));
+	file.write(reinterpret_cast<const char*>(levels.data()), static_cast<std::streamsize>(levels.size()));
+
+	return static_cast<bool>(file);
+}
+
+/*static*/ std::string CompressedTexture::FindCookedPath(const std::string& sourcePath)
+{
+	std::error_code error;
+	std::filesystem::path source(sourcePath);
+
+	for (const char* extension : {".ktx2", ".dds"})
+	{
+		std::filesystem::path cooked = source;
+		cooked.replace_extension(extension);
+
+		if (!std::filesystem::exists(cooked, error))
+			continue;
+
+		//A cooked texture that is older than its source is out of date, so it is better to load the source
+		if (std::filesystem::exists(source, error) &&
+			std::filesystem::last_write_time(cooked, error) < std::filesystem::last_write_time(source, error))
+		{
+			std::cout << "[WARNING, CompressedTexture.cpp, FindCookedPath] \"" << cooked.string() << "\" is older than \""
+				<< sourcePath << "\", rerun the texture cooker" << std::endl;
+			continue;
+		}
+
+		return cooked.string();
+	}
+
+	return {};
+}
+
+/*static*/ uint CompressedTexture::GetGLInternalFormat(Format format)
+{
+	switch (format)
+	{
+		case Format::rgba8: return GL_RGBA8;
+		case Format::bc1:   return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+		case Format::bc3:   return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		case Format::bc5:   return GL_COMPRESSED_RG_RGTC2;
+		case Format::bc7:   return GL_COMPRESSED_RGBA_BPTC_UNORM;
+	}
+
+	ASSERT_LOG(false, "Unknown texture format: " << static_cast<int>(format));
+	return GL_RGBA8;
+}
+
+/*static*/ uint CompressedTexture::GetBlockSize(Format format)
+{
+	switch (format)
+	{
+		case Format::rgba8: return 4;
+		case Format::bc1:   return 8;
+		case Format::bc3:
+		case Format::bc5:
+		case Format::bc7:   return 16;
+	}
+
+	ASSERT_LOG(false, "Unknown texture format: " << static_cast<int>(format));
+	return 4;
+}
+
+/*static*/ uint64 CompressedTexture::GetLevelSize(Format format, int width, int height)
+{
+	if (format == Format::rgba8)
+		return static_cast<uint64>(width) * height * 4;
+
+	//Blocks are always 4x4, even for levels that are smaller than that
+	uint64 blocksWide = std::max((width + 3) / 4, 1);
+	uint64 blocksHigh = std::max((height + 3) / 4, 1);
+	return blocksWide * blocksHigh * GetBlockSize(format);
+}
+
+/*static*/ uint64 CompressedTexture::GetMipChainSize(Format format, int width, int height, uint numLevels)
+{
+	uint64 totalSize = 0;
+
+	for (uint level = 0; level < numLevels; level++)
+	{
+		totalSize += GetLevelSize(format, width, height);
+		width = std::max(width / 2, 1);
+		height = std::max(height / 2, 1);
+	}
+
+	return totalSize;
+}
+
+/*static*/ const char* CompressedTexture::FormatToString(Format format)
+{
+	switch (format)
+	{
+		case Format::rgba8: return "RGBA8";
+		case Format::bc1:   return "BC1";
+		case Format::bc3:   return "BC3";
+		case Format::bc5:   return "BC5";
+		case Format::bc7:   return "BC7";
+	}
+
+	return "Unknown";
+}
+
+/*static*/ const uint8* CompressedTexture::GetPlaceholderBlock(Format format)
+{
+	switch (format)
+	{
+		case Format::rgba8: return placeholderRGBA8;
+		case Format::bc1:   return placeholderBC1;
+		case Format::bc3:   return placeholderBC3;
+		case Format::bc5:   return placeholderBC5;
+		case Format::bc7:   return placeholderBC7;
+	}
+
+	ASSERT_LOG(false, "Unknown texture format: " << static_cast<int>(format));
+	return placeholderRGBA8;
+}
+
+/*static*/ void CompressedTexture::GenerateMipChain(std::vector<uint8>& pixels, int width, int height, uint numLevels)
+{
+	pixels.resize(GetMipChainSize(Format::rgba8, width, height, numLevels));
+
+	uint64 srcOffset = 0;
+	for (uint level = 1; level < numLevels; level++)
+	{
+		int dstWidth = std::max(width / 2, 1);
+		int dstHeight = std::max(height / 2, 1);
+		uint64 dstOffset = srcOffset + static_cast<uint64>(width) * height * 4;
+
+		const uint8* src = pixels.data() + srcOffset;
+		uint8* dst = pixels.data() + dstOffset;
+
+		for (int y = 0; y < dstHeight; y++)
+		{
+			//Clamped so that odd (or 1 pixel) dimensions still work
+			int y0 = std::min(y * 2, height - 1);
+			int y1 = std::min(y * 2 + 1, height - 1);
+
+			for (int x = 0; x < dstWidth; x++)
+			{
+				int x0 = std::min(x * 2, width - 1);
+				int x1 = std::min(x * 2 + 1, width - 1);
+
+				for (int c = 0; c < 4; c++)
+				{
+					uint sum = src[(y0 * width + x0) * 4 + c] + src[(y0 * width + x1) * 4 + c] +
+						src[(y1 * width + x0) * 4 + c] + src[(y1 * width + x1) * 4 + c];
+
+					dst[(y * dstWidth + x) * 4 + c] = static_cast<uint8>((sum + 2) / 4);
+				}
+			}
+		}
+
+		srcOffset = dstOffset;
+		width = dstWidth;
+		height = dstHeight;
+	}
+}
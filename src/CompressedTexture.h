@@ -0,0 +1,67 @@
+#ifndef COMPRESSEDTEXTURE_H
+#define COMPRESSEDTEXTURE_H
+
+#include "Util.h"
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+/*
+ * Reading (DDS and KTX2) and writing (DDS) of block compressed textures that already contain their whole mip chain.
+ * These are made offline by the texture cooker (tools/TextureCooker), so that at runtime the blocks only have to be
+ * copied into the texture, instead of decoding a png/jpeg and building the mip chain on every load.
+ *
+ * Level data is always kept as every mip level one after the other, starting with level 0, which is also how the
+ * TextureLoader expects uncompressed images to be laid out.
+ */
+class CompressedTexture
+{
+public:
+	enum class Format : uint8
+	{
+		rgba8 = 0, //Not compressed, this is what png/jpeg textures are decoded to
+		bc1,       //RGB, 8 bytes per block
+		bc3,       //RGBA, 16 bytes per block
+		bc5,       //RG, 16 bytes per block (normal maps)
+		bc7        //RGBA, 16 bytes per block (higher quality than bc1/bc3)
+	};
+
+	struct Info
+	{
+		Format format = Format::rgba8;
+		int width = 0;
+		int height = 0;
+		uint numLevels = 0;
+	};
+
+	//Only reads the header
+	static bool ReadInfo(const std::string& path, Info& outInfo);
+	static bool Load(const std::string& path, Info& outInfo, std::vector<uint8>& outLevels);
+
+	//Always writes the DX10 extended header, as the legacy header has no way of describing BC7
+	static bool WriteDDS(const std::string& path, const Info& info, const std::vector<uint8>& levels);
+
+	//Returns the path of the cooked version of a png/jpeg texture (same name, .ktx2 or .dds), or empty if there is none
+	static std::string FindCookedPath(const std::string& sourcePath);
+
+	static uint GetGLInternalFormat(Format format);
+	static uint GetBlockSize(Format format); //In bytes, for rgba8 this is the size of one pixel
+	static uint64 GetLevelSize(Format format, int width, int height);
+	static uint64 GetMipChainSize(Format format, int width, int height, uint numLevels);
+	static const char* FormatToString(Format format);
+
+	//One block (or pixel for rgba8) of mid grey, this is what texture array layers hold until their image is loaded
+	static const uint8* GetPlaceholderBlock(Format format);
+
+	//Builds the mip chain of an RGBA8 image with a box filter, pixels must already hold level 0
+	static void GenerateMipChain(std::vector<uint8>& pixels, int width, int height, uint numLevels);
+
+private:
+	static bool ReadDDS(std::ifstream& file, const std::string& path, Info& outInfo, std::vector<uint8>* outLevels);
+	static bool ReadKTX2(std::ifstream& file, const std::string& path, Info& outInfo, std::vector<uint8>* outLevels);
+};
+
+
+
+#endif //COMPRESSEDTEXTURE_H
@@ -7,148 +7,32 @@
 DynamicModel::DynamicModel(Renderer& renderer, const std::string &sceneFilepath, Physics &physics, FrustumCuller& frustumCuller) :
     StaticModel(renderer, sceneFilepath, physics, frustumCuller, false)
 {
-    //All of the code is the exact same as StaticModel but we must override all methods so that we can all our ProcessMesh function, which is actually new code
-    //this is because we cant call subclass methods from the superclass
-
-    //TODO: BIGGEST HACK OF ALL TIME. If the number of textures exceeds this
-    //then all textures for this model break as the memory of the vector gets reallocated, and so the pointers become invalid
-    //We could heap allocated the textures using unique_pointer but that adds double indirection so this should be good enough
-    m_loadedTextures.reserve(500);
-    Assimp::Importer importer;
-    const aiScene* scene = importer.ReadFile(
-        sceneFilepath,
-        aiProcess_Triangulate | aiProcess_FlipUVs |
-        aiProcess_GenNormals | aiProcess_JoinIdenticalVertices |
-        aiProcess_FindDegenerates | aiProcess_FindInvalidData |
-        aiProcess_OptimizeMeshes
-    );
-
-    ASSERT_LOG(
-        !(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode),
-        "Error with loading model:" << importer.GetErrorString() << " with path " << sceneFilepath
-    );
-
-    DynamicModel::ProcessNode(scene->mRootNode, scene, sceneFilepath.substr(0, sceneFilepath.find_last_of('/')), JPH::Mat44::sIdentity());
+    //The StaticModel constructor does not load the scene, because the virtual call to AddMesh would not reach our version from there
+    LoadScene(sceneFilepath, physicsPostProcessFlags);
 }
 
 DynamicModel::DynamicModel(Renderer &renderer, const std::string &sceneFilepath, Physics &physics, FrustumCuller& frustumCuller, const JPH::Mat44 &transform):
     StaticModel(renderer, sceneFilepath, physics, frustumCuller, false)
 {
-    //All of the code is the exact same as StaticModel but we must override all methods so that we can all our ProcessMesh function, which is actually new code
-    //this is because we cant call subclass methods from the superclass
-
-    //TODO: BIGGEST HACK OF ALL TIME. If the number of textures exceeds this
-    //then all textures for this model break as the memory of the vector gets reallocated, and so the pointers become invalid
-    //We could heap allocated the textures using unique_pointer but that adds double indirection so this should be good enough
-    m_loadedTextures.reserve(500);
-    Assimp::Importer importer;
-    const aiScene* scene = importer.ReadFile(
-        sceneFilepath,
-        aiProcess_Triangulate | aiProcess_FlipUVs |
-        aiProcess_GenNormals | aiProcess_JoinIdenticalVertices |
-        aiProcess_FindDegenerates | aiProcess_FindInvalidData |
-        aiProcess_OptimizeMeshes
-    );
-
-    ASSERT_LOG(
-        !(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode),
-        "Error with loading model:" << importer.GetErrorString() << " with path " << sceneFilepath
-    );
-
-    DynamicModel::ProcessNode(scene->mRootNode, scene, sceneFilepath.substr(0, sceneFilepath.find_last_of('/')), transform);
+    //The StaticModel constructor does not load the scene, because the virtual call to AddMesh would not reach our version from there
+    LoadScene(sceneFilepath, physicsPostProcessFlags, transform);
 }
 
-void DynamicModel::ProcessNode(aiNode *node, const aiScene *scene, const std::string &directory, const JPH::Mat44& parentTransformation)
+void DynamicModel::AddMesh(
+    std::span<const vertexUVNormalPacked> vertices, std::span<const uint> indices, const MeshLods& lods,
+    const std::vector<const Texture*> &textures, bool doubleSided, const JPH::Mat44 &transform)
 {
-    m_meshes.reserve(m_meshes.size() + node->mNumMeshes);
-
-    aiMatrix4x4 aiLocal = node->mTransformation;
-    JPH::Mat44 local = ConvertAssimpMatrix(aiLocal);
-    JPH::Mat44 globalTransform = parentTransformation * local;
-
-    for (int i = 0; i < node->mNumMeshes; i++)
-    {
-        aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
-
-        std::vector<vertexUVNormal> vertices;
-        std::vector<uint> indices;
-        std::vector<const Texture*> textures;
-
-        DynamicModel::ProcessMesh(mesh, scene, directory, vertices, indices, textures, globalTransform);
-
-        Error error;
-        m_meshes.emplace_back(vertices, indices, textures, globalTransform, error);
-
-        HANDLE_ERROR(error,
-            ASSERT_LOG(false, "Unable to process a mesh. Canceling Mesh processing.");
-        );
-    }
-
-    for(unsigned int i = 0; i < node->mNumChildren; i++)
-    {
-        DynamicModel::ProcessNode(node->mChildren[i], scene, directory, globalTransform);
-    }
-}
-
-void DynamicModel::ProcessMesh(aiMesh *mesh, const aiScene *scene, const std::string &directory,
-    std::vector<vertexUVNormal> &outVertices, std::vector<uint> &outIndices, std::vector<const Texture *> &outTextures,
-    JPH::Mat44 &transform)
-{
-    aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-
-    outVertices.reserve(mesh->mNumVertices);
-    //Roughly preallocate some memory so that lots of tiny allocations are not made, and then we later reduce size to fit
-    outIndices.reserve(mesh->mFaces[0].mNumIndices * 2);
-    outTextures.reserve(material->GetTextureCount(aiTextureType_DIFFUSE) + material->GetTextureCount(aiTextureType_SPECULAR));
-
-    std::vector<JPH::Vec3> positions;
-
-    for (uint i = 0; i < mesh->mNumVertices; i++)
-    {
-        vertexUVNormal vertex{};
-        vertex.posX = mesh->mVertices[i].x;
-        vertex.posY = mesh->mVertices[i].y;
-        vertex.posZ = mesh->mVertices[i].z;
-
-        vertex.normalX = mesh->mNormals[i].x;
-        vertex.normalY = mesh->mNormals[i].y;
-        vertex.normalZ = mesh->mNormals[i].z;
-
-        if (mesh->mTextureCoords[0])
-        {
-            vertex.texcoordX = mesh->mTextureCoords[0][i].x;
-            vertex.texcoordY = mesh->mTextureCoords[0][i].y;
-        }
-
-        positions.emplace_back(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
-        outVertices.push_back(vertex);
-    }
-
-    for(uint i = 0; i < mesh->mNumFaces; i++)
-    {
-        aiFace face = mesh->mFaces[i];
-        for(uint j = 0; j < face.mNumIndices; j++)
-            outIndices.emplace_back(face.mIndices[j]);
-    }
-
-    outIndices.shrink_to_fit();
+    std::span<const uint> fullIndices = lods.GetIndices(indices, 0); //The physics bodies use the full mesh
 
     //This is an awful, horrendous way of getting rid of 2 specific meshes that I do not want. However, this is the easiest
     //way without having to learn blender to edit the mesh.
     //TODO: Use blender to get rid of these 2 meshes instead of this horrible method
-    if (outIndices.size() == 216)
-    {
-        outVertices.clear();
-        outIndices.clear();
-        outTextures.clear();
-
+    if (fullIndices.size() == 216)
         return;
-    }
 
-    m_objects.emplace_back(PhysicsObjectFactory::ConstructDynamicMesh(1000, m_physics, positions, outIndices, transform));
+    m_objects.emplace_back(PhysicsObjectFactory::ConstructDynamicMesh(1000, m_physics, GetPositions(vertices), fullIndices, transform));
 
-    LoadMaterialTextures(material, aiTextureType_DIFFUSE, Texture::TextureType::diffuse, directory, outTextures);
-    LoadMaterialTextures(material, aiTextureType_SPECULAR, Texture::TextureType::specular, directory, outTextures);
+    Model::AddMesh(vertices, indices, lods, textures, doubleSided, transform);
 }
 
 
@@ -6,15 +6,10 @@
 class DynamicModel : public StaticModel
 {
 private:
-    //ProcessNode function is the same as the StaticModel version but we need to call DynamicModel::ProcessMesh so this function also has to exist
-    void ProcessNode(aiNode *node, const aiScene *scene, const std::string &directory, const JPH::Mat44& parentTransformation) override;
-
-    void ProcessMesh(
-        aiMesh* mesh, const aiScene* scene, const std::string &directory,
-        std::vector<vertexUVNormal> &outVertices,
-        std::vector<uint> &outIndices,
-        std::vector<const Texture*> &outTextures,
-        JPH::Mat44 &transform
+    //Same as StaticModel::AddMesh but the physics bodies are dynamic, and the meshes are not added to the multi draw batch
+    void AddMesh(
+        std::span<const vertexUVNormalPacked> vertices, std::span<const uint> indices, const MeshLods& lods,
+        const std::vector<const Texture*>& textures, bool doubleSided, const JPH::Mat44& transform
     ) override;
 
 public:
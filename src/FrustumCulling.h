@@ -2,99 +2,42 @@
 #define FRUSTUMCULLING_H
 
 #include "Util.h"
-#include "JPHImpls.h"
+#include "AABBCullKernel.h"
 
 #include <vector>
 #include <array>
-#include <memory>
 #include <Jolt/Jolt.h>
-#include <Jolt/RegisterTypes.h>
-#include <Jolt/Core/Factory.h>
-#include <Jolt/Core/TempAllocator.h>
-#include <Jolt/Core/JobSystemThreadPool.h>
-#include <Jolt/Physics/PhysicsSettings.h>
-#include <Jolt/Physics/PhysicsSystem.h>
-#include <Jolt/Physics/Body/BodyCreationSettings.h>
-#include <Jolt/Physics/Body/BodyActivationListener.h>
+#include <Jolt/Core/JobSystem.h>
+#include <Jolt/Physics/Body/Body.h>
+#include <Jolt/Physics/Body/BodyLock.h>
+#include <Jolt/Physics/Body/BodyLockInterface.h>
 #include <Jolt/Physics/Collision/Shape/ConvexHullShape.h>
-#include <Jolt/Physics/Collision/Shape/BoxShape.h>
 #include <Jolt/Physics/Collision/CollisionCollectorImpl.h>
-#include <Jolt/Physics/Collision/ShapeCast.h>
+#include <Jolt/Physics/Collision/CollisionDispatch.h>
+#include <Jolt/Physics/Collision/CollideShape.h>
+#include <Jolt/Physics/Collision/BroadPhase/BroadPhaseQuery.h>
 #include <Jolt/Geometry/AABox.h>
+#include <Jolt/Geometry/OrientedBox.h>
 
+/*
+ * Frustum culling against the planes of the camera frustum. This holds nothing but the frustum of the last call, it has
+ * no physics world or threads of its own: the bodies come from the caller's physics system, and GetVisibleMask() can
+ * split its work over the caller's job system.
+ */
 class FrustumCuller {
 private:
-    JPH::JobSystemThreadPool m_jobSystem;
-    JPH::PhysicsSystem m_physicsSystem;
-    JPHImpls::BPLayerInterfaceImpl m_broadPhaseLayerInterface;
-    JPHImpls::ObjectVsBroadPhaseLayerFilterImpl m_objectVsBroadPhaseLayerFilter;
-    JPHImpls::ObjectLayerPairCollisionFilterImpl m_objectLayerPairCollisionFilter;
-
-    JPH::RefConst<JPH::ConvexHullShape> m_frustumShape;
-    std::vector<JPH::Vec3> m_frustumVertices;
+    static constexpr uint boxesPerJob = 4096; // GetVisibleMask() only uses the job system with more boxes than this
+
+    JPH::RefConst<JPH::ConvexHullShape> m_frustumShape; // Only built when Util::options.preciseShapeCulling is enabled
+    std::array<JPH::Vec3, 8> m_frustumVertices;
     std::array<JPH::Vec4, 6> m_frustumPlanes;
 
-    // Extract frustum planes from view-projection matrix
     void ExtractFrustumPlanes(const JPH::Mat44& viewProjMatrix) {
-        m_frustumPlanes[0] = JPH::Vec4(
-            viewProjMatrix(3, 0) + viewProjMatrix(0, 0),
-            viewProjMatrix(3, 1) + viewProjMatrix(0, 1),
-            viewProjMatrix(3, 2) + viewProjMatrix(0, 2),
-            viewProjMatrix(3, 3) + viewProjMatrix(0, 3)
-        );
-
-        m_frustumPlanes[1] = JPH::Vec4(
-            viewProjMatrix(3, 0) - viewProjMatrix(0, 0),
-            viewProjMatrix(3, 1) - viewProjMatrix(0, 1),
-            viewProjMatrix(3, 2) - viewProjMatrix(0, 2),
-            viewProjMatrix(3, 3) - viewProjMatrix(0, 3)
-        );
-
-        m_frustumPlanes[2] = JPH::Vec4(
-            viewProjMatrix(3, 0) + viewProjMatrix(1, 0),
-            viewProjMatrix(3, 1) + viewProjMatrix(1, 1),
-            viewProjMatrix(3, 2) + viewProjMatrix(1, 2),
-            viewProjMatrix(3, 3) + viewProjMatrix(1, 3)
-        );
-
-        m_frustumPlanes[3] = JPH::Vec4(
-            viewProjMatrix(3, 0) - viewProjMatrix(1, 0),
-            viewProjMatrix(3, 1) - viewProjMatrix(1, 1),
-            viewProjMatrix(3, 2) - viewProjMatrix(1, 2),
-            viewProjMatrix(3, 3) - viewProjMatrix(1, 3)
-        );
-
-        m_frustumPlanes[4] = JPH::Vec4(
-            viewProjMatrix(3, 0) + viewProjMatrix(2, 0),
-            viewProjMatrix(3, 1) + viewProjMatrix(2, 1),
-            viewProjMatrix(3, 2) + viewProjMatrix(2, 2),
-            viewProjMatrix(3, 3) + viewProjMatrix(2, 3)
-        );
-
-        m_frustumPlanes[5] = JPH::Vec4(
-            viewProjMatrix(3, 0) - viewProjMatrix(2, 0),
-            viewProjMatrix(3, 1) - viewProjMatrix(2, 1),
-            viewProjMatrix(3, 2) - viewProjMatrix(2, 2),
-            viewProjMatrix(3, 3) - viewProjMatrix(2, 3)
-        );
-
-        for (auto& plane : m_frustumPlanes)
-        {
-            JPH::Vec3 normal(plane.GetX(), plane.GetY(), plane.GetZ());
-            float length = normal.Length();
-
-            if (length > 1e-6f)
-            {
-                normal /= length;
-                float distance = plane.GetW() / length;
-                plane = JPH::Vec4(normal.GetX(), normal.GetY(), normal.GetZ(), distance);
-            }
-        }
+        m_frustumPlanes = ComputeFrustumPlanes(viewProjMatrix);
     }
 
-    std::vector<JPH::Vec3> ExtractFrustumVertices(const JPH::Mat44& viewMatrix, const JPH::Mat44& projMatrix) {
-        std::vector<JPH::Vec3> vertices;
-        vertices.reserve(8);
+    std::array<JPH::Vec3, 8> ExtractFrustumVertices(const JPH::Mat44& viewMatrix, const JPH::Mat44& projMatrix) {
+        std::array<JPH::Vec3, 8> vertices;
 
         JPH::Mat44 viewProj = projMatrix * viewMatrix;
         JPH::Mat44 invViewProj = viewProj.Inversed();
@@ -111,22 +54,18 @@ private:
         }};
 
         // Transform NDC vertices to world space
-        for (const auto& ndcVertex : ndcVertices) {
-            JPH::Vec4 worldVertex = invViewProj * ndcVertex;
+        for (size_t i = 0; i < ndcVertices.size(); i++) {
+            JPH::Vec4 worldVertex = invViewProj * ndcVertices[i];
             if (abs(worldVertex.GetW()) > 1e-6f) {
                 worldVertex /= worldVertex.GetW(); // Perspective divide
             }
-            vertices.push_back(JPH::Vec3(worldVertex.GetX(), worldVertex.GetY(), worldVertex.GetZ()));
+            vertices[i] = JPH::Vec3(worldVertex.GetX(), worldVertex.GetY(), worldVertex.GetZ());
         }
 
         return vertices;
     }
 
-    JPH::RefConst<JPH::ConvexHullShape> CreateFrustumShape(const std::vector<JPH::Vec3>& vertices) {
-        if (vertices.size() < 4) {
-            return nullptr;
-        }
-
+    JPH::RefConst<JPH::ConvexHullShape> CreateFrustumShape(const std::array<JPH::Vec3, 8>& vertices) {
         JPH::ConvexHullShapeSettings settings(vertices.data(), (int)vertices.size());
         settings.mMaxConvexRadius = 0.0f;
 
@@ -142,6 +81,63 @@ private:
         );
     }
 
+    // Precise shape-based culling, against the actual shape of the body instead of its bounds
+    bool IsShapeVisible(const JPH::Body& body) const {
+        if (!m_frustumShape) {
+            return true;
+        }
+
+        const JPH::Shape* bodyShape = body.GetShape();
+        if (!bodyShape) {
+            return true;
+        }
+
+        JPH::CollideShapeSettings settings;
+        settings.mMaxSeparationDistance = 0.0f;
+        settings.mBackFaceMode = JPH::EBackFaceMode::CollideWithBackFaces; // Mesh triangles facing away are still visible
+
+        JPH::AnyHitCollisionCollector<JPH::CollideShapeCollector> collector;
+
+        // The hull is built from world space vertices, but shapes are placed by their center of mass
+        JPH::CollisionDispatch::sCollideShapeVsShape(
+            m_frustumShape,
+            bodyShape,
+            JPH::Vec3::sReplicate(1.0f),
+            JPH::Vec3::sReplicate(1.0f),
+            JPH::Mat44::sTranslation(m_frustumShape->GetCenterOfMass()),
+            body.GetCenterOfMassTransform(),
+            JPH::SubShapeIDCreator(),
+            JPH::SubShapeIDCreator(),
+            settings,
+            collector
+        );
+
+        return collector.HadHit();
+    }
+
+    void UpdateFrustum(const JPH::Mat44& viewMatrix, const JPH::Mat44& projMatrix) {
+        JPH::Mat44 viewProj = projMatrix * viewMatrix;
+        ExtractFrustumPlanes(viewProj);
+
+        m_frustumVertices = ExtractFrustumVertices(viewMatrix, projMatrix);
+
+        // Building the hull is expensive, and the plane tests do not need it
+        if (Util::options.preciseShapeCulling) {
+            m_frustumShape = CreateFrustumShape(m_frustumVertices);
+        } else {
+            m_frustumShape = nullptr;
+        }
+    }
+
+public:
+    static constexpr int numQuerySlices = 4; // How many oriented boxes QueryFrustum() covers the frustum with
+
+    // Sets the planes that IsAABBVisible() tests against, for testing boxes one at a time without culling anything first
+    void SetFrustumPlanes(const JPH::Mat44& viewProjMatrix) {
+        ExtractFrustumPlanes(viewProjMatrix);
+    }
+
+    // Tests against the planes of the last frustum that was culled against
     bool IsAABBVisible(const JPH::AABox& aabb) const {
         JPH::Vec3 center = aabb.GetCenter();
         JPH::Vec3 extents = aabb.GetExtent();
@@ -177,58 +173,72 @@ private:
         return true;
     }
 
-    // Precise shape-based culling
-    // Does not work for now because no bodies were added to the physics system
-    bool IsShapeVisible(const JPH::Body& body) const {
-        if (!m_frustumShape) {
-            return true;
-        }
+    // IsAABBVisible() on the bounds of the body, and then IsShapeVisible() if Util::options.preciseShapeCulling is enabled
+    bool IsBodyVisible(const JPH::Body& body) const {
+        return IsAABBVisible(body.GetWorldSpaceBounds()) && IsShapeVisible(body);
+    }
 
-        JPH::Mat44 bodyTransform = body.GetWorldTransform();
-        JPH::RefConst<JPH::Shape> bodyShape = body.GetShape();
+    // Extract frustum planes from view-projection matrix, the normals point into the frustum
+    static std::array<JPH::Vec4, 6> ComputeFrustumPlanes(const JPH::Mat44& viewProjMatrix) {
+        std::array<JPH::Vec4, 6> frustumPlanes;
 
-        if (!bodyShape) {
-            return true;
-        }
+        frustumPlanes[0] = JPH::Vec4(
+            viewProjMatrix(3, 0) + viewProjMatrix(0, 0),
+            viewProjMatrix(3, 1) + viewProjMatrix(0, 1),
+            viewProjMatrix(3, 2) + viewProjMatrix(0, 2),
+            viewProjMatrix(3, 3) + viewProjMatrix(0, 3)
+        );
 
-        JPH::CollideShapeSettings settings;
-        settings.mMaxSeparationDistance = 0.0f;
-        settings.mActiveEdgeMode = JPH::EActiveEdgeMode::CollideOnlyWithActive;
+        frustumPlanes[1] = JPH::Vec4(
+            viewProjMatrix(3, 0) - viewProjMatrix(0, 0),
+            viewProjMatrix(3, 1) - viewProjMatrix(0, 1),
+            viewProjMatrix(3, 2) - viewProjMatrix(0, 2),
+            viewProjMatrix(3, 3) - viewProjMatrix(0, 3)
+        );
 
-        JPH::AllHitCollisionCollector<JPH::CollideShapeCollector> collector;
+        frustumPlanes[2] = JPH::Vec4(
+            viewProjMatrix(3, 0) + viewProjMatrix(1, 0),
+            viewProjMatrix(3, 1) + viewProjMatrix(1, 1),
+            viewProjMatrix(3, 2) + viewProjMatrix(1, 2),
+            viewProjMatrix(3, 3) + viewProjMatrix(1, 3)
+        );
 
-        const JPH::NarrowPhaseQuery& narrowPhase = m_physicsSystem.GetNarrowPhaseQuery();
+        frustumPlanes[3] = JPH::Vec4(
+            viewProjMatrix(3, 0) - viewProjMatrix(1, 0),
+            viewProjMatrix(3, 1) - viewProjMatrix(1, 1),
+            viewProjMatrix(3, 2) - viewProjMatrix(1, 2),
+            viewProjMatrix(3, 3) - viewProjMatrix(1, 3)
+        );
 
-        narrowPhase.CollideShape(
-            m_frustumShape,
-            JPH::Vec3::sReplicate(1.0f),
-            JPH::Mat44::sIdentity(),
-            settings,
-            bodyTransform.GetTranslation(),
-            collector
+        frustumPlanes[4] = JPH::Vec4(
+            viewProjMatrix(3, 0) + viewProjMatrix(2, 0),
+            viewProjMatrix(3, 1) + viewProjMatrix(2, 1),
+            viewProjMatrix(3, 2) + viewProjMatrix(2, 2),
+            viewProjMatrix(3, 3) + viewProjMatrix(2, 3)
         );
 
-        return collector.HadHit();
-    }
+        frustumPlanes[5] = JPH::Vec4(
+            viewProjMatrix(3, 0) - viewProjMatrix(2, 0),
+            viewProjMatrix(3, 1) - viewProjMatrix(2, 1),
+            viewProjMatrix(3, 2) - viewProjMatrix(2, 2),
+            viewProjMatrix(3, 3) - viewProjMatrix(2, 3)
+        );
 
-    void UpdateFrustum(const JPH::Mat44& viewMatrix, const JPH::Mat44& projMatrix) {
-        JPH::Mat44 viewProj = projMatrix * viewMatrix;
-        ExtractFrustumPlanes(viewProj);
+        for (auto& plane : frustumPlanes)
+        {
+            JPH::Vec3 normal(plane.GetX(), plane.GetY(), plane.GetZ());
+            float length = normal.Length();
 
-        m_frustumVertices = ExtractFrustumVertices(viewMatrix, projMatrix);
-        m_frustumShape = CreateFrustumShape(m_frustumVertices);
-    }
+            if (length > 1e-6f)
+            {
+                normal /= length;
+                float distance = plane.GetW() / length;
+                plane = JPH::Vec4(normal.GetX(), normal.GetY(), normal.GetZ(), distance);
+            }
+        }
+    
 
-public:
-    FrustumCuller() :
-        m_jobSystem(
-            1024,
-            std::clamp((int)std::thread::hardware_concurrency() / 2, 1, 12) + 2,
-            std::clamp((int)std::thread::hardware_concurrency() / 2, 1, 12)
-        )
-    {
-        m_physicsSystem.Init(8192, 0, 8192, 2048, m_broadPhaseLayerInterface,
-                           m_objectVsBroadPhaseLayerFilter, m_objectLayerPairCollisionFilter);
+        return frustumPlanes;
     }
 
     std::vector<JPH::BodyID> GetVisibleBodies(
@@ -236,50 +246,102 @@ public:
         const std::vector<JPH::BodyID>& allBodies,
         const JPH::Mat44& viewMatrix,
         const JPH::Mat44& projectionMatrix
+    ) {
+        std::vector<JPH::BodyID> visibleBodies;
+        GetVisibleBodies(bodyInterface, allBodies, viewMatrix, projectionMatrix, visibleBodies);
+        return visibleBodies;
+    }
+
+    // Tests every box in bounds at once with AABBCullKernel, bit i of outVisibleMask is set if box i is visible
+    // This needs no body locks, so it is much faster than GetVisibleBodies() for bounds that are kept up to date separately.
+    // With a job system (such as the one of Physics) large bounds are split into jobs, which this waits for
+    void GetVisibleMask(
+        const AABBCullKernel::Bounds& bounds,
+        const JPH::Mat44& viewMatrix,
+        const JPH::Mat44& projectionMatrix,
+        std::vector<uint64>& outVisibleMask,
+        JPH::JobSystem* jobSystem = nullptr
+    ) {
+        ExtractFrustumPlanes(projectionMatrix * viewMatrix);
+
+        uint numBoxes = bounds.GetNumBoxes();
+        if (!jobSystem || numBoxes <= boxesPerJob) {
+            AABBCullKernel::Cull(m_frustumPlanes, bounds, outVisibleMask);
+            return;
+        }
+
+        outVisibleMask.assign(AABBCullKernel::GetMaskSize(numBoxes), 0);
+
+        JPH::JobSystem::Barrier* barrier = jobSystem->CreateBarrier();
+        for (uint firstBox = 0; firstBox < numBoxes; firstBox += boxesPerJob) {
+            JPH::JobHandle job = jobSystem->CreateJob("FrustumCull", JPH::Color::sGreen, [&, firstBox]() {
+                AABBCullKernel::CullRange(m_frustumPlanes, bounds, firstBox, boxesPerJob, outVisibleMask);
+            });
+            barrier->AddJob(job);
+        }
+
+        jobSystem->WaitForJobs(barrier);
+        jobSystem->DestroyBarrier(barrier);
+    }
+
+    // Finds the bodies near the frustum by querying the broadphase tree, so the cost depends on how many bodies are near
+    // the frustum rather than on how many there are in total. Jolt has no frustum query (and its tree walk is private),
+    // so the tree is queried with oriented boxes that tightly cover slices of the frustum. The collector should test each
+    // body with IsBodyVisible() (or IsAABBVisible()), and has to handle duplicates, as a body can be in more than one slice.
+    void QueryFrustum(
+        const JPH::BroadPhaseQuery& broadPhaseQuery,
+        const JPH::Mat44& viewMatrix,
+        const JPH::Mat44& projectionMatrix,
+        JPH::CollideShapeBodyCollector& ioCollector
     ) {
         UpdateFrustum(viewMatrix, projectionMatrix);
 
-        std::vector<JPH::BodyID> visibleBodies;
-        std::vector<JPH::BodyID> aabbCandidates;
+        // The columns are the axes of the camera in world space, the boxes are aligned with them
+        JPH::Mat44 cameraRotation = viewMatrix.GetRotation().Transposed3x3();
 
-        visibleBodies.reserve(allBodies.size());
-        aabbCandidates.reserve(allBodies.size());
+        for (int slice = 0; slice < numQuerySlices; slice++) {
+            float nearFraction = static_cast<float>(slice) / numQuerySlices;
+            float farFraction = static_cast<float>(slice + 1) / numQuerySlices;
 
-        for (const JPH::BodyID& bodyID : allBodies) {
-            JPH::BodyLockRead lock(bodyInterface, bodyID);
-            if (!lock.Succeeded()) {
-                continue;
+            // The corners of the slice are on the edges from the near corners (0 to 3) to the far corners (4 to 7)
+            JPH::AABox cameraSpaceBox;
+            for (int corner = 0; corner < 4; corner++) {
+                JPH::Vec3 nearCorner = m_frustumVertices[corner];
+                JPH::Vec3 edge = m_frustumVertices[corner + 4] - nearCorner;
+
+                cameraSpaceBox.Encapsulate(cameraRotation.Multiply3x3Transposed(nearCorner + edge * nearFraction));
+                cameraSpaceBox.Encapsulate(cameraRotation.Multiply3x3Transposed(nearCorner + edge * farFraction));
             }
 
-            const JPH::Body& body = lock.GetBody();
-            JPH::AABox worldAABB = body.GetWorldSpaceBounds();
+            JPH::Mat44 orientation = cameraRotation;
+            orientation.SetTranslation(cameraRotation.Multiply3x3(cameraSpaceBox.GetCenter()));
 
-            // Test AABB against frustum planes
-            if (IsAABBVisible(worldAABB)) {
-                aabbCandidates.push_back(bodyID);
-            }
+            broadPhaseQuery.CollideOrientedBox(JPH::OrientedBox(orientation, cameraSpaceBox.GetExtent()), ioCollector);
         }
+    }
 
-        // For now, just return AABB candidates (disable shape testing until it is working)
-        return aabbCandidates;
+    // Same as above, but writes into outVisibleBodies so that it can be reused every frame without allocating
+    void GetVisibleBodies(
+        const JPH::BodyLockInterfaceLocking& bodyInterface,
+        const std::vector<JPH::BodyID>& allBodies,
+        const JPH::Mat44& viewMatrix,
+        const JPH::Mat44& projectionMatrix,
+        std::vector<JPH::BodyID>& outVisibleBodies
+    ) {
+        UpdateFrustum(viewMatrix, projectionMatrix);
+
+        outVisibleBodies.clear();
 
-        // Phase 2: Precise shape-based culling on AABB candidates
-        /*for (const JPH::BodyID& bodyID : aabbCandidates) {
+        for (const JPH::BodyID& bodyID : allBodies) {
             JPH::BodyLockRead lock(bodyInterface, bodyID);
             if (!lock.Succeeded()) {
                 continue;
             }
 
-            const JPH::Body& body = lock.GetBody();
-
-            // Perform precise shape-based culling
-            bool isShapeVisible = IsShapeVisible(body);
-            if (isShapeVisible) {
-                visibleBodies.push_back(bodyID);
+            if (IsBodyVisible(lock.GetBody())) {
+                outVisibleBodies.push_back(bodyID);
             }
         }
-
-        return visibleBodies;*/
     }
 };
 
@@ -0,0 +1,59 @@
+#include "GpuTimer.h"
+
+GpuTimer::GpuTimer()
+{
+	glCreateQueries(GL_TIME_ELAPSED, numQueries, m_queries);
+}
+
+GpuTimer::~GpuTimer()
+{
+	glDeleteQueries(numQueries, m_queries);
+}
+
+void GpuTimer::Begin(uint tag /* = 0 */)
+{
+	ASSERT_LOG(!m_running, "GpuTimer::Begin() was called twice without End()");
+
+	//Beginning a query throws away its old result, so this is all that is needed to drop it
+	if (m_numPending == numQueries)
+	{
+		m_oldest = (m_oldest + 1) % numQueries;
+		m_numPending--;
+	}
+
+	uint index = (m_oldest + m_numPending) % numQueries;
+	m_tags[index] = tag;
+
+	glBeginQuery(GL_TIME_ELAPSED, m_queries[index]);
+	m_running = true;
+}
+
+void GpuTimer::End()
+{
+	ASSERT_LOG(m_running, "GpuTimer::End() was called without Begin()");
+
+	glEndQuery(GL_TIME_ELAPSED);
+	m_running = false;
+	m_numPending++;
+}
+
+bool GpuTimer::PopResult(Result& outResult)
+{
+	if (m_numPending == 0)
+		return false;
+
+	int available = 0;
+	glGetQueryObjectiv(m_queries[m_oldest], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available)
+		return false;
+
+	GLuint64 nanoseconds = 0;
+	glGetQueryObjectui64v(m_queries[m_oldest], GL_QUERY_RESULT, &nanoseconds);
+
+	outResult.ms = nanoseconds / 1'000'000.0;
+	outResult.tag = m_tags[m_oldest];
+
+	m_oldest = (m_oldest + 1) % numQueries;
+	m_numPending--;
+	return true;
+}
@@ -0,0 +1,50 @@
+#ifndef GPUTIMER_H
+#define GPUTIMER_H
+
+#include "Util.h"
+
+/*
+ * Measures how long the GPU takes to run the commands between Begin() and End(), with GL_TIME_ELAPSED queries.
+ *
+ * The result of a query is only ready once the GPU gets to it, which is usually a frame or two after End(), so the
+ * queries are kept in a ring and read back with PopResult() once they are done. Nothing ever waits for the GPU. If every
+ * query is still pending when Begin() is called, the oldest one is dropped.
+ *
+ * Only one GL_TIME_ELAPSED query can be running at a time, so timers must not be nested.
+ */
+class GpuTimer
+{
+public:
+	static constexpr uint numQueries = 4;
+
+	struct Result
+	{
+		double ms;
+		uint tag; //What was passed to Begin(), so results can be told apart after what is being timed changes
+	};
+
+private:
+	uint m_queries[numQueries];
+	uint m_tags[numQueries];
+
+	uint m_oldest = 0;
+	uint m_numPending = 0; //Ended, but not popped yet
+	bool m_running = false;
+
+public:
+	GpuTimer();
+	~GpuTimer();
+
+	GpuTimer(const GpuTimer&) = delete; //No copying!!! Leads to use after free issues
+	GpuTimer& operator=(const GpuTimer&) = delete;
+
+	void Begin(uint tag = 0);
+	void End();
+
+	//Returns the results in the order they were timed, each one only once. Returns false if the oldest one is not ready yet
+	bool PopResult(Result& outResult);
+};
+
+
+
+#endif //GPUTIMER_H
@@ -0,0 +1,142 @@
+#include "HiZBuffer.h"
+
+#include <bit>
+
+HiZBuffer::HiZBuffer()
+	:	m_depthTexture(0),
+		m_depthFramebuffer(0),
+		m_pyramidTexture(0),
+		m_screenWidth(0),
+		m_screenHeight(0),
+		m_width(0),
+		m_height(0),
+		m_numLevels(0),
+		m_numSamples(1),
+		m_projViewMatrix(JPH::Mat44::sIdentity()),
+		m_valid(false)
+{
+}
+
+HiZBuffer::~HiZBuffer()
+{
+	Destroy();
+}
+
+void HiZBuffer::Create(int screenWidth, int screenHeight)
+{
+	Destroy();
+
+	m_screenWidth = screenWidth;
+	m_screenHeight = screenHeight;
+
+	//Blitting between multisampled buffers copies the samples, as long as both have the same number of them
+	m_numSamples = GetDefaultFramebufferSamples();
+	if (m_numSamples > 1)
+	{
+		glCreateTextures(GL_TEXTURE_2D_MULTISAMPLE, 1, &m_depthTexture);
+		glTextureStorage2DMultisample(
+			m_depthTexture, m_numSamples, GetDefaultFramebufferDepthFormat(), screenWidth, screenHeight, GL_TRUE
+		);
+	}
+	else
+	{
+		glCreateTextures(GL_TEXTURE_2D, 1, &m_depthTexture);
+		glTextureStorage2D(m_depthTexture, 1, GetDefaultFramebufferDepthFormat(), screenWidth, screenHeight);
+		glTextureParameteri(m_depthTexture, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTextureParameteri(m_depthTexture, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	}
+
+	glCreateFramebuffers(1, &m_depthFramebuffer);
+	glNamedFramebufferTexture(m_depthFramebuffer, GL_DEPTH_ATTACHMENT, m_depthTexture, 0);
+	ASSERT_LOG(
+		glCheckNamedFramebufferStatus(m_depthFramebuffer, GL_DRAW_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE,
+		"The Hi-Z depth framebuffer is not complete"
+	);
+
+	m_width = static_cast<int>(std::bit_floor(static_cast<uint>(screenWidth)));
+	m_height = static_cast<int>(std::bit_floor(static_cast<uint>(screenHeight)));
+	m_numLevels = std::bit_width(static_cast<uint>(std::max(m_width, m_height)));
+
+	glCreateTextures(GL_TEXTURE_2D, 1, &m_pyramidTexture);
+	glTextureStorage2D(m_pyramidTexture, m_numLevels, GL_R32F, m_width, m_height);
+	glTextureParameteri(m_pyramidTexture, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTextureParameteri(m_pyramidTexture, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+}
+
+void HiZBuffer::Destroy()
+{
+	glDeleteFramebuffers(1, &m_depthFramebuffer);
+	glDeleteTextures(1, &m_depthTexture);
+	glDeleteTextures(1, &m_pyramidTexture);
+
+	m_depthFramebuffer = 0;
+	m_depthTexture = 0;
+	m_pyramidTexture = 0;
+	m_valid = false;
+}
+
+/*static*/ uint HiZBuffer::GetDefaultFramebufferDepthFormat()
+{
+	int depthBits = 0, stencilBits = 0;
+	glGetNamedFramebufferAttachmentParameteriv(0, GL_DEPTH, GL_FRAMEBUFFER_ATTACHMENT_DEPTH_SIZE, &depthBits);
+	glGetNamedFramebufferAttachmentParameteriv(0, GL_STENCIL, GL_FRAMEBUFFER_ATTACHMENT_STENCIL_SIZE, &stencilBits);
+
+	if (stencilBits > 0)
+		return depthBits > 24 ? GL_DEPTH32F_STENCIL8 : GL_DEPTH24_STENCIL8;
+
+	if (depthBits > 24)
+		return GL_DEPTH_COMPONENT32F;
+
+	return depthBits > 16 ? GL_DEPTH_COMPONENT24 : GL_DEPTH_COMPONENT16;
+}
+
+/*static*/ int HiZBuffer::GetDefaultFramebufferSamples()
+{
+	int numSamples = 0;
+	glGetNamedFramebufferParameteriv(0, GL_SAMPLES, &numSamples);
+	return std::max(numSamples, 1);
+}
+
+void HiZBuffer::Build(Renderer &renderer, Shader &buildShader, const JPH::Mat44 &projViewMatrix, int screenWidth, int screenHeight)
+{
+	if (screenWidth != m_screenWidth || screenHeight != m_screenHeight || m_pyramidTexture == 0)
+		Create(screenWidth, screenHeight);
+
+	glBlitNamedFramebuffer(
+		0, m_depthFramebuffer,
+		0, 0, screenWidth, screenHeight,
+		0, 0, screenWidth, screenHeight,
+		GL_DEPTH_BUFFER_BIT, GL_NEAREST
+	);
+
+	renderer.BindTexture(m_numSamples > 1 ? multisampleTextureUnit : textureUnit, m_depthTexture);
+	buildShader.SetUniform("u_numSamples"_uniform, m_numSamples);
+
+	for (uint level = 0; level < m_numLevels; level++)
+	{
+		//Level 0 reads the depth texture, every other level reads the one above it
+		if (level > 0)
+			glBindImageTexture(0, m_pyramidTexture, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+		glBindImageTexture(1, m_pyramidTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+		buildShader.SetUniform("u_level"_uniform, level);
+
+		uint levelWidth = std::max(m_width >> level, 1);
+		uint levelHeight = std::max(m_height >> level, 1);
+		renderer.DispatchCompute(
+			buildShader,
+			(levelWidth + buildWorkGroupSize - 1) / buildWorkGroupSize,
+			(levelHeight + buildWorkGroupSize - 1) / buildWorkGroupSize,
+			1,
+			GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT
+		);
+	}
+
+	m_projViewMatrix = projViewMatrix;
+	m_valid = true;
+}
+
+void HiZBuffer::Bind(Renderer &renderer) const
+{
+	renderer.BindTexture(textureUnit, m_pyramidTexture);
+}
@@ -0,0 +1,77 @@
+#ifndef HIZBUFFER_H
+#define HIZBUFFER_H
+
+#include "Util.h"
+
+#include "Renderer.h"
+#include "Shader.h"
+
+/*
+ * A hierarchical depth buffer (Hi-Z pyramid) for occlusion culling. Every mip level holds the furthest depth of the 2x2
+ * texels below it, so a box can be tested for occlusion with a few texel reads at the level where it covers 2x2 texels:
+ * if the nearest point of the box is further away than the furthest depth there, something in front of it hides it.
+ *
+ * Build() copies the depth buffer of the default framebuffer once the scene is drawn, and the pyramid is tested against
+ * in the next frame, using the matrix it was built with, so the cull never waits for the depth of the frame it is culling.
+ * The cost is that a mesh that comes out from behind an occluder shows up one frame late.
+ *
+ * A multisampled depth buffer is copied with all of its samples, and level 0 takes the furthest of them. Resolving it
+ * first would keep one sample per pixel, which at the edges of an occluder can be nearer than what the pixel also shows.
+ *
+ * Level 0 is the largest power of two that fits in the screen, so every level is exactly half the size of the one above.
+ */
+class HiZBuffer
+{
+private:
+	uint m_depthTexture; //In the format (and with the samples) of the default framebuffer, as blitting depth requires that
+	uint m_depthFramebuffer;
+	uint m_pyramidTexture;
+
+	int m_screenWidth, m_screenHeight;
+	int m_width, m_height;
+	uint m_numLevels;
+	int m_numSamples; //Of the default framebuffer, 1 if it is not multisampled
+
+	JPH::Mat44 m_projViewMatrix;
+	bool m_valid;
+
+	void Create(int screenWidth, int screenHeight);
+	void Destroy();
+
+	static uint GetDefaultFramebufferDepthFormat();
+	static int GetDefaultFramebufferSamples();
+
+public:
+	static constexpr uint textureUnit = 16; //NOTE: DO NOT UPDATE without changing HiZBuildCompute.glsl and FrustumCullCompute.glsl
+	static constexpr uint multisampleTextureUnit = 17; //NOTE: DO NOT UPDATE without changing HiZBuildCompute.glsl
+	static constexpr uint buildWorkGroupSize = 8; //NOTE: DO NOT UPDATE without changing HiZBuildCompute.glsl
+
+	HiZBuffer();
+	~HiZBuffer();
+
+	HiZBuffer(const HiZBuffer&) = delete; //No copying!!! Leads to use after free issues
+	HiZBuffer& operator=(const HiZBuffer&) = delete;
+
+	/*
+	 * Copies the depth buffer of the default framebuffer (which must have been drawn with projViewMatrix) and builds the
+	 * pyramid from it with buildShader (HiZBuildCompute.glsl). The textures are recreated if the screen size changed.
+	 */
+	void Build(Renderer& renderer, Shader& buildShader, const JPH::Mat44& projViewMatrix, int screenWidth, int screenHeight);
+
+	//For when the depth buffer stops matching the scene (such as when occlusion culling is turned off and on again)
+	void Invalidate() { m_valid = false; }
+
+	//Binds the pyramid to textureUnit
+	void Bind(Renderer& renderer) const;
+
+	bool IsValid() const { return m_valid; }
+	const JPH::Mat44& GetProjViewMatrix() const { return m_projViewMatrix; }
+	uint GetRendererID() const { return m_pyramidTexture; }
+	int GetWidth() const { return m_width; }
+	int GetHeight() const { return m_height; }
+	uint GetNumLevels() const { return m_numLevels; }
+};
+
+
+
+#endif //HIZBUFFER_H
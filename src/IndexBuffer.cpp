@@ -1,14 +1,14 @@
 #include "IndexBuffer.h"
 #include <GL/glew.h>
 
+#include <limits>
+#include <vector>
+
 IndexBuffer::IndexBuffer() {}
 
 IndexBuffer::IndexBuffer(const uint* indicies, uint count)
 {
- 	m_Count = count;
-	glGenBuffers(1, &m_RendererID);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_RendererID);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, count * sizeof(uint), indicies, GL_STATIC_DRAW);
+	Init(indicies, count);
 }
 
 void IndexBuffer::Init(const uint* indicies, uint count)
@@ -16,12 +16,25 @@ void IndexBuffer::Init(const uint* indicies, uint count)
 	m_Count = count;
 	glGenBuffers(1, &m_RendererID);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_RendererID);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, count * sizeof(uint), indicies, GL_STATIC_DRAW);
+
+	uint maxIndex = count == 0 ? 0 : *std::max_element(indicies, indicies + count);
+
+	if (maxIndex > std::numeric_limits<uint16>::max())
+	{
+		m_Type = GL_UNSIGNED_INT;
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, count * sizeof(uint), indicies, GL_STATIC_DRAW);
+		return;
+	}
+
+	m_Type = GL_UNSIGNED_SHORT;
+	std::vector<uint16> shortIndices(indicies, indicies + count);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, count * sizeof(uint16), shortIndices.data(), GL_STATIC_DRAW);
 }
 
 IndexBuffer::IndexBuffer(IndexBuffer &&other) noexcept
 	:	m_RendererID(other.m_RendererID),
-		m_Count(other.m_Count)
+		m_Count(other.m_Count),
+		m_Type(other.m_Type)
 {
 	other.m_RendererID = 0;
 	other.m_Count = 0;
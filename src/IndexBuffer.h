@@ -4,10 +4,15 @@
 #include "Util.h"
 
 
+/*
+ * The indices are stored as 16 bit (GL_UNSIGNED_SHORT) when every index fits, which is when the mesh has fewer than 65536
+ * vertices, and as 32 bit otherwise. Draws have to use GetType() rather than assuming GL_UNSIGNED_INT.
+ */
 class IndexBuffer {
 private:
-	uint m_RendererID;
-	uint m_Count;
+	uint m_RendererID = 0;
+	uint m_Count = 0;
+	uint m_Type = GL_UNSIGNED_INT;
 
 public:
 
@@ -26,6 +31,8 @@ public:
 	void Unbind();
 
 	uint GetCount() const { return m_Count; }
+	uint GetType() const { return m_Type; } //GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+	uint GetIndexSize() const { return m_Type == GL_UNSIGNED_SHORT ? sizeof(uint16) : sizeof(uint32); }
 };
 
 
@@ -0,0 +1,78 @@
+#include "Material.h"
+
+#include <map>
+
+Material::Material(const std::vector<const Texture*> &textures, bool doubleSided)
+{
+    Init(textures, doubleSided);
+}
+
+void Material::Init(const std::vector<const Texture*> &textures, bool doubleSided)
+{
+    uint diffuseNum = 0;
+    uint specularNum = 0;
+
+    m_bindings.clear();
+    m_bindings.reserve(textures.size());
+    m_hasSpecularTexture = false;
+    m_textureLayers = JPH::UVec4::sZero();
+    m_doubleSided = doubleSided;
+
+    std::vector<uint> textureArrayIDs;
+    textureArrayIDs.reserve(textures.size());
+
+    for (uint i = 0; i < textures.size(); i++)
+    {
+        Texture::TextureType texType = textures[i]->GetType();
+        ASSERT_LOG(texType != Texture::TextureType::unknown, "Texture has not been initialized!");
+
+        if (texType == Texture::TextureType::diffuse)
+        {
+            ASSERT_LOG(diffuseNum < maxTexturesPerType, "Too many diffuse textures in one material");
+            if (diffuseNum == 0)
+                m_textureLayers.SetX(textures[i]->GetLayer());
+
+            m_bindings.push_back({textures[i], i, diffuseUniforms[diffuseNum++]});
+        }
+        else if (texType == Texture::TextureType::specular)
+        {
+            ASSERT_LOG(specularNum < maxTexturesPerType, "Too many specular textures in one material");
+            if (specularNum == 0)
+                m_textureLayers.SetY(textures[i]->GetLayer());
+
+            m_bindings.push_back({textures[i], i, specularUniforms[specularNum++]});
+            m_hasSpecularTexture = true;
+        }
+
+        textureArrayIDs.push_back(textures[i]->GetRendererID());
+    }
+
+    m_sortID = FindSortID(textureArrayIDs, doubleSided);
+}
+
+/*static*/ uint Material::FindSortID(const std::vector<uint> &textureArrayIDs, bool doubleSided)
+{
+    //Only used at load time, so a map is fine here
+    static std::map<std::pair<std::vector<uint>, bool>, uint> sortIDs;
+
+    return sortIDs.try_emplace({textureArrayIDs, doubleSided}, sortIDs.size()).first->second;
+}
+
+void Material::Bind(Renderer &renderer, Shader &shader) const
+{
+    renderer.SetCullFace(Util::options.backFaceCulling && !m_doubleSided);
+
+    //The depth only shaders do not have any samplers
+    if (!renderer.IsColorWriteEnabled())
+        return;
+
+    for (const TextureBinding& binding : m_bindings)
+    {
+        //The shaders only sample the first texture of each type, the rest have no sampler to bind to
+        if (!shader.HasUniform(binding.uniform))
+            continue;
+
+        renderer.BindTexture(binding.unit, *binding.texture);
+        shader.SetUniform(binding.uniform, binding.unit);
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include "Util.h"
+
+#include "Renderer.h"
+#include "Shader.h"
+#include "Texture.h"
+
+#include <vector>
+
+/*
+ * The textures of a mesh resolved once into a binding table (texture, sampler unit, uniform), so that binding a
+ * material does not need to build uniform names or look anything up by string.
+ *
+ * Textures are layers of texture arrays, so only the arrays are bound here. The layers are per draw data
+ * (see GetTextureLayers()), which lets meshes whose textures are in the same arrays share one binding.
+ *
+ * Closed meshes are drawn with back face culling (with Util::options.backFaceCulling), double sided ones (such as
+ * leaves or flat signs that are seen from both sides) are not.
+ */
+class Material
+{
+public:
+    //NOTE: DO NOT UPDATE THESE without changing the sampler uniforms in ModelFrag.glsl
+    static constexpr uint maxTexturesPerType = 4;
+
+    static constexpr UniformID diffuseUniforms[maxTexturesPerType] = {
+        "u_textureDiffuse0"_uniform, "u_textureDiffuse1"_uniform, "u_textureDiffuse2"_uniform, "u_textureDiffuse3"_uniform
+    };
+
+    static constexpr UniformID specularUniforms[maxTexturesPerType] = {
+        "u_textureSpecular0"_uniform, "u_textureSpecular1"_uniform, "u_textureSpecular2"_uniform, "u_textureSpecular3"_uniform
+    };
+
+private:
+    struct TextureBinding
+    {
+        const Texture* texture; //Points into the textures stored by the Model class
+        uint unit;
+        UniformID uniform;
+    };
+
+    std::vector<TextureBinding> m_bindings;
+    bool m_hasSpecularTexture = false;
+
+    JPH::UVec4 m_textureLayers = JPH::UVec4::sZero();
+
+    bool m_doubleSided = false;
+
+    uint m_sortID = 0; //Materials that bind exactly the same texture arrays and culling share a sort ID
+
+    //Returns the sort ID for this state, giving it a new one if it has not been seen before
+    static uint FindSortID(const std::vector<uint>& textureArrayIDs, bool doubleSided);
+
+public:
+    Material() = default;
+    Material(const std::vector<const Texture*>& textures, bool doubleSided);
+    void Init(const std::vector<const Texture*>& textures, bool doubleSided);
+
+    /*
+     * Sets the face culling, binds the textures and sets the sampler uniforms. The shader should already be bound, and
+     * be the variant for GetShaderFeatures(). Textures whose sampler the shader does not declare are skipped. While
+     * color writes are off (a depth only pass, see Renderer::SetColorWrite()) only the culling is set
+     */
+    void Bind(Renderer& renderer, Shader& shader) const;
+
+    //The shader features this material needs on top of the ones of the shader it is drawn with, see Shader::GetVariant()
+    uint32 GetShaderFeatures() const { return m_hasSpecularTexture ? ShaderFeature::specularMap : ShaderFeature::none; }
+
+    uint GetSortID() const { return m_sortID; }
+    bool IsDoubleSided() const { return m_doubleSided; }
+
+    //x is the layer of the first diffuse texture, y is the layer of the first specular texture
+    JPH::UVec4 GetTextureLayers() const { return m_textureLayers; }
+};
+
+
+
+#endif //MATERIAL_H
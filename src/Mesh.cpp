@@ -1,19 +1,27 @@
 #include "Mesh.h"
 
-Mesh::Mesh(const std::vector<vertexUVNormal> &vertices, const std::vector<uint> &indices, const std::vector<const Texture*>& textures, const JPH::Mat44& modelMatrix, Error &error)
+#include <algorithm>
+
+Mesh::Mesh(std::span<const vertexUVNormalPacked> vertices, std::span<const uint> indices, const MeshLods& lods, const std::vector<const Texture*>& textures, bool doubleSided, const JPH::Mat44& modelMatrix, Error &error)
 {
-    Init(vertices, indices, textures, modelMatrix, error);
+    Init(vertices, indices, lods, textures, doubleSided, modelMatrix, error);
 }
 
-void Mesh::Init(const std::vector<vertexUVNormal> &vertices, const std::vector<uint> &indices, const std::vector<const Texture*> &textures, const JPH::Mat44& modelMatrix, Error& error)
+void Mesh::Init(std::span<const vertexUVNormalPacked> vertices, std::span<const uint> indices, const MeshLods& lods, const std::vector<const Texture*> &textures, bool doubleSided, const JPH::Mat44& modelMatrix, Error& error)
 {
-    m_textures = textures;
+    m_material.Init(textures, doubleSided);
     m_modelMatrix = modelMatrix;
+    m_lods = lods;
+    m_currentLod = 0;
+
+    JPH::AABox bounds = ComputeBounds(vertices);
+    m_boundsCenter = bounds.GetCenter();
+    m_boundsRadius = bounds.GetExtent().Length();
 
     VertexBufferLayout layout;
     layout.Push<float>(3); //pos
-    layout.Push<float>(2); //uv
-    layout.Push<float>(3); //normals
+    layout.Push<HalfFloat>(2); //uv
+    layout.Push<Int2_10_10_10Rev>(4); //normals
 
     m_vao.Bind();
 
@@ -26,83 +34,61 @@ void Mesh::Init(const std::vector<vertexUVNormal> &vertices, const std::vector<u
 
 void Mesh::Draw(Renderer& renderer, Shader& shader, const JPH::Mat44 &projViewMatrix)
 {
-    //TODO: Figure out how much of this we can do at init time instead of in the draw call
-    uint diffuseNum = 0;
-    uint specularNum = 0;
-
-    for (uint i = 0; i < m_textures.size(); i++)
-    {
-        std::string texUniformNum;
-        Texture::TextureType texType = m_textures[i]->GetType();
-
-        if (texType == Texture::TextureType::diffuse)
-        {
-            texUniformNum = std::to_string(diffuseNum++);
-        }
-        else if (texType == Texture::TextureType::specular)
-        {
-            texUniformNum = std::to_string(specularNum++);
-            shader.SetUniform("u_haveSpecularTexture", true);
-        }
-
-        ASSERT_LOG(texType != Texture::TextureType::unknown, "Texture has not been initialized!");
-
-        std::string name; //All appending and reserving is done specifically to reduce heap allocations
-        name.reserve(49);
-        name += "u_texture";
-        name += Texture::ConvertTextureTypeToString(texType);
-        name += texUniformNum;
-
-        m_textures[i]->Bind(i);
-        shader.SetUniform(name, i);
-    }
-
-    shader.SetUniform("u_MVP", projViewMatrix * m_modelMatrix);
-    shader.SetUniform("u_modelMatrix", m_modelMatrix);
-
-    renderer.Draw(m_vao, m_ibo);
-
-    shader.SetUniform("u_haveSpecularTexture", false);
+    Submit(renderer, shader, m_modelMatrix, projViewMatrix);
 }
 
 void Mesh::Draw(Renderer &renderer, Shader &shader, const JPH::Mat44 &projViewMatrix, const JPH::Mat44 &modelMatrix)
 {
-    //TODO: Figure out how much of this we can do at init time instead of in the draw call
-    uint diffuseNum = 0;
-    uint specularNum = 0;
-
-    for (uint i = 0; i < m_textures.size(); i++)
-    {
-        std::string texUniformNum;
-        Texture::TextureType texType = m_textures[i]->GetType();
-
-        if (texType == Texture::TextureType::diffuse)
-        {
-            texUniformNum = std::to_string(diffuseNum++);
-        }
-        else if (texType == Texture::TextureType::specular)
-        {
-            texUniformNum = std::to_string(specularNum++);
-            shader.SetUniform("u_haveSpecularTexture", true);
-        }
-
-        ASSERT_LOG(texType != Texture::TextureType::unknown, "Texture has not been initialized!");
-
-        std::string name; //All appending and reserving is done specifically to reduce heap allocations
-        name.reserve(49);
-        name += "u_texture";
-        name += Texture::ConvertTextureTypeToString(texType);
-        name += texUniformNum;
-
-        m_textures[i]->Bind(i);
-        shader.SetUniform(name, i);
-    }
-
-    JPH::Mat44 modelMatrixCombined = modelMatrix * m_modelMatrix;
-    shader.SetUniform("u_MVP", projViewMatrix * modelMatrixCombined);
-    shader.SetUniform("u_modelMatrix", modelMatrixCombined);
-
-    renderer.Draw(m_vao, m_ibo);
-
-    shader.SetUniform("u_haveSpecularTexture", false);
+    Submit(renderer, shader, modelMatrix * m_modelMatrix, projViewMatrix);
+}
+
+void Mesh::Submit(Renderer &renderer, Shader &shader, const JPH::Mat44 &modelMatrix, const JPH::Mat44 &projViewMatrix)
+{
+    uint drawID = renderer.PushObjectUniforms(modelMatrix, projViewMatrix * modelMatrix, m_material.GetTextureLayers());
+
+    //The camera looks down -Z in view space
+    JPH::Vec3 viewSpaceCenter = renderer.GetFrameUniforms().viewMatrix * (modelMatrix * m_boundsCenter);
+    float viewDepth = -viewSpaceCenter.GetZ();
+
+    uint lod = SelectLod(modelMatrix, renderer.GetFrameUniforms(), viewDepth);
+    renderer.GetRenderQueue().Push(
+        RenderPass::opaque, shader, m_material, m_vao, m_ibo, m_lods.firstIndex[lod], m_lods.indexCount[lod], drawID, viewDepth
+    );
+}
+
+uint Mesh::SelectLod(const JPH::Mat44 &modelMatrix, const FrameUniforms &frameUniforms, float viewDepth)
+{
+    if (!Util::options.meshLods)
+        return m_currentLod = 0;
+
+    //The model matrix can scale the mesh, the largest scale keeps the error from being underestimated
+    float scale = std::max({modelMatrix.GetAxisX().Length(), modelMatrix.GetAxisY().Length(), modelMatrix.GetAxisZ().Length()});
+
+    float nearestDepth = viewDepth - m_boundsRadius * scale;
+    if (nearestDepth <= 0.0f)
+        return m_currentLod = 0; //The camera is (nearly) inside of the mesh
+
+    //How many pixels one unit of model space covers at the nearest point
+    float pixelsPerUnit = scale * frameUniforms.projectionMatrix(1, 1) * 0.5f * Util::options.scrHeight / nearestDepth;
+    float maxError = Util::options.lodErrorPixels;
+
+    uint level = m_currentLod;
+    while (level + 1 < m_lods.numLevels && m_lods.error[level + 1] * pixelsPerUnit <= maxError)
+        level++;
+    while (level > 0 && m_lods.error[level] * pixelsPerUnit > maxError * (1.0f + lodHysteresis))
+        level--;
+
+    return m_currentLod = level;
+}
+
+/*static*/ JPH::AABox Mesh::ComputeBounds(std::span<const vertexUVNormalPacked> vertices)
+{
+    if (vertices.empty())
+        return JPH::AABox(JPH::Vec3::sZero(), 0.0f);
+
+    JPH::AABox bounds;
+    for (const vertexUVNormalPacked& vertex : vertices)
+        bounds.Encapsulate(JPH::Vec3(vertex.posX, vertex.posY, vertex.posZ));
+
+    return bounds;
 }
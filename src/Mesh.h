@@ -3,42 +3,66 @@
 
 #include "Util.h"
 
+#include "Material.h"
+#include "MeshSimplifier.h"
 #include "Renderer.h"
 #include "Shader.h"
 #include "Texture.h"
 #include "VertexArray.h"
 
+#include <Jolt/Geometry/AABox.h>
+
+#include <span>
+
 class Mesh
 {
-    std::vector<const Texture*> m_textures; //These are pointers into the larger array (stored in Model class) for each model
+    Material m_material; //Holds pointers into the larger array of textures (stored in Model class) for each model
 
     VertexArray m_vao;
     VertexBuffer m_vbo;
 
-    //TODO: Make Mesh choose uint32 or unit16 at runtime to save memory, and update ProcessMesh function to match
-    //Also update IndexBuffer to be able to do this
-    IndexBuffer m_ibo;
+    IndexBuffer m_ibo; //16 bit when the mesh has fewer than 65536 vertices, holds every level of detail
+
+    MeshLods m_lods;
+    uint m_currentLod = 0; //The level drawn last, see SelectLod()
 
     JPH::Mat44 m_modelMatrix;
+    JPH::Vec3 m_boundsCenter; //In model space, used to sort draws by depth
+    float m_boundsRadius; //In model space, around m_boundsCenter
+
+    void Submit(Renderer& renderer, Shader& shader, const JPH::Mat44& modelMatrix, const JPH::Mat44& projViewMatrix);
+
+    /**
+     * Picks the coarsest level of detail whose error (MeshLods::error) is at most Util::options.lodErrorPixels pixels on
+     * screen, at the nearest point of the bounds. So that the level does not flicker back and forth when the mesh is
+     * right at the distance where it switches, a finer level is only picked again once the error is lodHysteresis above the limit
+     */
+    uint SelectLod(const JPH::Mat44& modelMatrix, const FrameUniforms& frameUniforms, float viewDepth);
 
 public:
+    static constexpr float lodHysteresis = 0.25f;
 
     Mesh() = default;
+
+    //indices holds the triangles of every level of detail in lods
     Mesh(
-        const std::vector<vertexUVNormal>& vertices, const std::vector<uint>& indices,
-        const std::vector<const Texture*>& textures, const JPH::Mat44& modelMatrix, Error& error
+        std::span<const vertexUVNormalPacked> vertices, std::span<const uint> indices, const MeshLods& lods,
+        const std::vector<const Texture*>& textures, bool doubleSided, const JPH::Mat44& modelMatrix, Error& error
     );
-    void Init(const std::vector<vertexUVNormal>& vertices, const std::vector<uint>& indices,
-        const std::vector<const Texture*>& textures, const JPH::Mat44& modelMatrix, Error& error
+    void Init(std::span<const vertexUVNormalPacked> vertices, std::span<const uint> indices, const MeshLods& lods,
+        const std::vector<const Texture*>& textures, bool doubleSided, const JPH::Mat44& modelMatrix, Error& error
     );
 
     /*
-     * Draws the meshes. The shader should already be bound as this method is intended to be called in a loop.
-     * The other uniforms like u_MVP and u_viewMatrix should also already be set.
+     * Pushes the mesh into the renderer's render queue, so it is drawn when the queue is flushed.
+     * The frame uniforms (Renderer::SetFrameUniforms) should already be set.
      * The model matrix parameter is to allow updating of the model at runtime
      */
     void Draw(Renderer& renderer, Shader& shader, const JPH::Mat44 &projViewMatrix);
     void Draw(Renderer& renderer, Shader& shader, const JPH::Mat44 &projViewMatrix, const JPH::Mat44 &modelMatrix);
+
+    //The bounds of the vertex positions, an empty box at the origin if there are no vertices
+    static JPH::AABox ComputeBounds(std::span<const vertexUVNormalPacked> vertices);
 };
 
 
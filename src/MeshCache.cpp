@@ -0,0 +1,373 @@
+#include "MeshCache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <sstream>
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+//NOTE: DO NOT UPDATE any of these without incrementing MeshCache::version
+struct MeshCache::FileHeader
+{
+    uint32 magic;
+    uint32 version;
+    uint32 postProcessFlags;
+    uint32 vertexSize;
+
+    uint64 sourceSize;
+    int64 sourceWriteTime;
+
+    uint32 numMeshes;
+    uint32 numTextures;
+    uint64 numVertices;
+    uint64 numIndices;
+    uint64 stringsSize;
+
+    //From the start of the file
+    uint64 meshesOffset;
+    uint64 texturesOffset;
+    uint64 stringsOffset;
+    uint64 verticesOffset;
+    uint64 indicesOffset;
+};
+
+struct MeshCache::MeshRecord
+{
+    JPH::Float4 transform[4]; //Columns
+    uint32 firstVertex;
+    uint32 numVertices;
+    uint32 firstIndex;
+    uint32 numIndices;
+    uint32 firstTexture;
+    uint32 numDiffuseTextures;
+    uint32 numSpecularTextures;
+    uint32 numLodLevels;
+    uint32 lodFirstIndex[MeshLods::maxLevels]; //Relative to firstIndex
+    uint32 lodIndexCount[MeshLods::maxLevels];
+    float lodError[MeshLods::maxLevels];
+    uint32 doubleSided; //0 or 1
+};
+
+struct MeshCache::TextureRecord
+{
+    uint32 nameOffset; //Into the strings block
+    uint32 nameLength;
+};
+
+namespace
+{
+    //Every block starts on a 16 byte boundary, so that everything in the mapping is properly aligned
+    uint64 AlignOffset(uint64 offset)
+    {
+        return (offset + 15) & ~static_cast<uint64>(15);
+    }
+}
+
+MeshCache::Builder::Builder() = default;
+MeshCache::Builder::~Builder() = default;
+
+void MeshCache::Builder::AddMesh(
+    std::span<const vertexUVNormalPacked> vertices, std::span<const uint> indices, const MeshLods &lods,
+    const JPH::Mat44 &transform, bool doubleSided,
+    const std::vector<std::string> &diffuseTextures, const std::vector<std::string> &specularTextures)
+{
+    MeshRecord record{};
+    transform.StoreFloat4x4(record.transform);
+    record.firstVertex = m_vertices.size();
+    record.numVertices = vertices.size();
+    record.firstIndex = m_indices.size();
+    record.numIndices = indices.size();
+    record.firstTexture = m_textureNames.size();
+    record.numDiffuseTextures = diffuseTextures.size();
+    record.numSpecularTextures = specularTextures.size();
+    record.numLodLevels = lods.numLevels;
+    record.doubleSided = doubleSided;
+
+    for (uint level = 0; level < MeshLods::maxLevels; level++)
+    {
+        record.lodFirstIndex[level] = lods.firstIndex[level];
+        record.lodIndexCount[level] = lods.indexCount[level];
+        record.lodError[level] = lods.error[level];
+    }
+
+    m_meshes.push_back(record);
+    m_vertices.insert(m_vertices.end(), vertices.begin(), vertices.end());
+    m_indices.insert(m_indices.end(), indices.begin(), indices.end());
+    m_textureNames.insert(m_textureNames.end(), diffuseTextures.begin(), diffuseTextures.end());
+    m_textureNames.insert(m_textureNames.end(), specularTextures.begin(), specularTextures.end());
+}
+
+std::vector<uint8> MeshCache::Builder::Serialize(const SourceStamp &sourceStamp, uint postProcessFlags) const
+{
+    std::vector<TextureRecord> textureRecords;
+    std::string strings;
+    textureRecords.reserve(m_textureNames.size());
+
+    for (const std::string& name : m_textureNames)
+    {
+        textureRecords.push_back({static_cast<uint32>(strings.size()), static_cast<uint32>(name.size())});
+        strings += name;
+    }
+
+    FileHeader header{};
+    header.magic = magic;
+    header.version = version;
+    header.postProcessFlags = postProcessFlags;
+    header.vertexSize = sizeof(vertexUVNormalPacked);
+    header.sourceSize = sourceStamp.size;
+    header.sourceWriteTime = sourceStamp.writeTime;
+    header.numMeshes = m_meshes.size();
+    header.numTextures = textureRecords.size();
+    header.numVertices = m_vertices.size();
+    header.numIndices = m_indices.size();
+    header.stringsSize = strings.size();
+
+    header.meshesOffset = AlignOffset(sizeof(FileHeader));
+    header.texturesOffset = AlignOffset(header.meshesOffset + m_meshes.size() * sizeof(MeshRecord));
+    header.stringsOffset = AlignOffset(header.texturesOffset + textureRecords.size() * sizeof(TextureRecord));
+    header.verticesOffset = AlignOffset(header.stringsOffset + strings.size());
+    header.indicesOffset = AlignOffset(header.verticesOffset + m_vertices.size() * sizeof(vertexUVNormalPacked));
+
+    std::vector<uint8> data(header.indicesOffset + m_indices.size() * sizeof(uint));
+    std::memcpy(data.data(), &header, sizeof(header));
+    std::memcpy(data.data() + header.meshesOffset, m_meshes.data(), m_meshes.size() * sizeof(MeshRecord));
+    std::memcpy(data.data() + header.texturesOffset, textureRecords.data(), textureRecords.size() * sizeof(TextureRecord));
+    std::memcpy(data.data() + header.stringsOffset, strings.data(), strings.size());
+    std::memcpy(data.data() + header.verticesOffset, m_vertices.data(), m_vertices.size() * sizeof(vertexUVNormalPacked));
+    std::memcpy(data.data() + header.indicesOffset, m_indices.data(), m_indices.size() * sizeof(uint));
+
+    return data;
+}
+
+MeshCache::~MeshCache()
+{
+    Unmap();
+}
+
+bool MeshCache::Open(const std::string &cachePath, const SourceStamp &expectedStamp, uint expectedFlags)
+{
+    Unmap();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(cachePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER fileSize{};
+    GetFileSizeEx(file, &fileSize);
+
+    //The view keeps the file and the mapping object alive, so the handles can be closed right away
+    HANDLE mapping = fileSize.QuadPart > 0 ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+    m_mapping = mapping != nullptr ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+
+    if (mapping != nullptr)
+        CloseHandle(mapping);
+    CloseHandle(file);
+
+    if (m_mapping == nullptr)
+        return false;
+
+    m_size = fileSize.QuadPart;
+#else
+    int file = open(cachePath.c_str(), O_RDONLY);
+    if (file < 0)
+        return false;
+
+    struct stat fileStat{};
+    void* mapping = MAP_FAILED;
+    if (fstat(file, &fileStat) == 0 && fileStat.st_size > 0)
+        mapping = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+
+    close(file); //The mapping keeps the file alive
+
+    if (mapping == MAP_FAILED)
+        return false;
+
+    m_mapping = mapping;
+    m_size = fileStat.st_size;
+#endif
+
+    m_data = static_cast<const uint8*>(m_mapping);
+
+    if (!Validate(expectedStamp, expectedFlags))
+    {
+        Unmap();
+        return false;
+    }
+
+    return true;
+}
+
+void MeshCache::Open(std::vector<uint8> &&data)
+{
+    Unmap();
+
+    m_ownedData = std::move(data);
+    m_data = m_ownedData.data();
+    m_size = m_ownedData.size();
+
+    ASSERT_LOG(Validate({GetHeader().sourceSize, GetHeader().sourceWriteTime}, GetHeader().postProcessFlags), "Mesh cache data from the Builder is invalid");
+}
+
+void MeshCache::Unmap()
+{
+    if (m_mapping != nullptr)
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(m_mapping);
+#else
+        munmap(m_mapping, m_size);
+#endif
+    }
+
+    m_mapping = nullptr;
+    m_ownedData.clear();
+    m_data = nullptr;
+    m_size = 0;
+}
+
+bool MeshCache::Validate(const SourceStamp &expectedStamp, uint expectedFlags) const
+{
+    if (m_size < sizeof(FileHeader))
+        return false;
+
+    const FileHeader& header = GetHeader();
+
+    if (header.magic != magic || header.version != version || header.vertexSize != sizeof(vertexUVNormalPacked))
+        return false;
+
+    if (header.postProcessFlags != expectedFlags || SourceStamp{header.sourceSize, header.sourceWriteTime} != expectedStamp)
+        return false;
+
+    //Make sure that every block (and every mesh and texture name) is inside of the file, so a truncated or corrupted
+    //cache is rebuilt instead of reading out of the mapping
+    auto blockFits = [this](uint64 offset, uint64 count, uint64 elementSize) {
+        return offset % 16 == 0 && offset <= m_size && count <= (m_size - offset) / elementSize;
+    };
+
+    if (!blockFits(header.meshesOffset, header.numMeshes, sizeof(MeshRecord)) ||
+        !blockFits(header.texturesOffset, header.numTextures, sizeof(TextureRecord)) ||
+        !blockFits(header.stringsOffset, header.stringsSize, 1) ||
+        !blockFits(header.verticesOffset, header.numVertices, sizeof(vertexUVNormalPacked)) ||
+        !blockFits(header.indicesOffset, header.numIndices, sizeof(uint)))
+        return false;
+
+    for (uint i = 0; i < header.numMeshes; i++)
+    {
+        const MeshRecord& mesh = GetMeshRecord(i);
+        uint64 numTextures = static_cast<uint64>(mesh.numDiffuseTextures) + mesh.numSpecularTextures;
+
+        if (static_cast<uint64>(mesh.firstVertex) + mesh.numVertices > header.numVertices ||
+            static_cast<uint64>(mesh.firstIndex) + mesh.numIndices > header.numIndices ||
+            mesh.firstTexture + numTextures > header.numTextures)
+            return false;
+
+        if (mesh.numLodLevels == 0 || mesh.numLodLevels > MeshLods::maxLevels)
+            return false;
+
+        for (uint level = 0; level < mesh.numLodLevels; level++)
+        {
+            if (static_cast<uint64>(mesh.lodFirstIndex[level]) + mesh.lodIndexCount[level] > mesh.numIndices)
+                return false;
+        }
+    }
+
+    const TextureRecord* textures = reinterpret_cast<const TextureRecord*>(m_data + header.texturesOffset);
+    for (uint i = 0; i < header.numTextures; i++)
+    {
+        if (static_cast<uint64>(textures[i].nameOffset) + textures[i].nameLength > header.stringsSize)
+            return false;
+    }
+
+    return true;
+}
+
+const MeshCache::FileHeader& MeshCache::GetHeader() const
+{
+    return *reinterpret_cast<const FileHeader*>(m_data);
+}
+
+const MeshCache::MeshRecord& MeshCache::GetMeshRecord(uint index) const
+{
+    return reinterpret_cast<const MeshRecord*>(m_data + GetHeader().meshesOffset)[index];
+}
+
+uint MeshCache::GetNumMeshes() const
+{
+    return IsOpen() ? GetHeader().numMeshes : 0;
+}
+
+MeshCache::MeshView MeshCache::GetMesh(uint index) const
+{
+    ASSERT_LOG(index < GetNumMeshes(), "Mesh index out of range: " << index);
+
+    const FileHeader& header = GetHeader();
+    const MeshRecord& record = GetMeshRecord(index);
+
+    const vertexUVNormalPacked* vertices = reinterpret_cast<const vertexUVNormalPacked*>(m_data + header.verticesOffset);
+    const uint* indices = reinterpret_cast<const uint*>(m_data + header.indicesOffset);
+
+    MeshLods lods;
+    lods.numLevels = record.numLodLevels;
+    for (uint level = 0; level < MeshLods::maxLevels; level++)
+    {
+        lods.firstIndex[level] = record.lodFirstIndex[level];
+        lods.indexCount[level] = record.lodIndexCount[level];
+        lods.error[level] = record.lodError[level];
+    }
+
+    return {
+        {vertices + record.firstVertex, record.numVertices},
+        {indices + record.firstIndex, record.numIndices},
+        lods,
+        JPH::Mat44::sLoadFloat4x4(record.transform),
+        record.doubleSided != 0,
+        record.firstTexture, record.numDiffuseTextures, record.numSpecularTextures
+    };
+}
+
+std::string_view MeshCache::GetTextureName(uint index) const
+{
+    const FileHeader& header = GetHeader();
+    ASSERT_LOG(index < header.numTextures, "Texture index out of range: " << index);
+
+    const TextureRecord& record = reinterpret_cast<const TextureRecord*>(m_data + header.texturesOffset)[index];
+    return {reinterpret_cast<const char*>(m_data + header.stringsOffset + record.nameOffset), record.nameLength};
+}
+
+/*static*/ std::string MeshCache::GetCachePath(const std::string &sceneFilepath, uint postProcessFlags)
+{
+    //The flags are part of the name, so models that load the same scene with different post processing do not fight
+    std::ostringstream path;
+    path << sceneFilepath << "." << std::hex << postProcessFlags << ".meshcache";
+    return path.str();
+}
+
+/*static*/ MeshCache::SourceStamp MeshCache::GetSourceStamp(const std::string &sceneFilepath)
+{
+    SourceStamp stamp;
+    stamp.writeTime = std::numeric_limits<int64>::min(); //The file clock's epoch is not 1970, so times can be negative
+    std::error_code error;
+    std::filesystem::path scenePath(sceneFilepath);
+
+    for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(scenePath.parent_path(), error))
+    {
+        //Only the files that the scene is made of, the cache itself has the same stem but a different extension chain
+        if (!entry.is_regular_file(error) || entry.path().stem() != scenePath.stem())
+            continue;
+
+        stamp.size += entry.file_size(error);
+        stamp.writeTime = std::max<int64>(stamp.writeTime, entry.last_write_time(error).time_since_epoch().count());
+    }
+
+    return stamp;
+}
@@ -0,0 +1,122 @@
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include "Util.h"
+#include "MeshSimplifier.h"
+
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+ * A baked, memory mapped copy of everything a Model takes out of an Assimp scene: the final vertices and indices of
+ * every mesh (with its levels of detail, see MeshSimplifier), the transform of the node the mesh is in, and the names
+ * of the textures it uses.
+ *
+ * The first time a model is loaded it is imported with Assimp as usual, and the result is written next to the scene
+ * file (see GetCachePath()). On later runs the cache is mapped and the meshes are uploaded straight from the mapping,
+ * so Assimp (and all of its post processing) is skipped entirely.
+ *
+ * A cache is only used if its version, the post processing flags and the size/write time of the source files all
+ * match, so editing the model (or changing the flags or the layout of vertexUVNormalPacked) rebuilds it.
+ * The file is little endian, like every platform we build for.
+ */
+class MeshCache
+{
+private:
+    struct FileHeader;
+    struct MeshRecord;
+    struct TextureRecord;
+
+public:
+    static constexpr uint32 magic = 0x48534D46; //"FMSH"
+    static constexpr uint32 version = 6; //NOTE: Increment when the file layout (or vertexUVNormalPacked, or MeshOptimizer) changes
+
+    //Identifies the version of the source files that a cache was built from
+    struct SourceStamp
+    {
+        uint64 size = 0;
+        int64 writeTime = 0;
+
+        bool operator==(const SourceStamp&) const = default;
+    };
+
+    struct MeshView
+    {
+        std::span<const vertexUVNormalPacked> vertices;
+        std::span<const uint> indices; //Of every level of detail
+        MeshLods lods;
+        JPH::Mat44 transform; //Relative to the root of the scene
+        bool doubleSided; //The material of the mesh is two sided, so its back faces must not be culled
+
+        //Indices for GetTextureName(), the diffuse textures come first and then the specular ones
+        uint firstTexture;
+        uint numDiffuseTextures;
+        uint numSpecularTextures;
+    };
+
+    //Collects the meshes of a scene as it is being imported, and turns them into the contents of a cache file
+    class Builder
+    {
+    private:
+        std::vector<vertexUVNormalPacked> m_vertices;
+        std::vector<uint> m_indices;
+        std::vector<std::string> m_textureNames; //One per texture reference, so a name can appear multiple times
+        std::vector<MeshRecord> m_meshes;
+
+    public:
+        Builder();
+        ~Builder();
+
+        void AddMesh(
+            std::span<const vertexUVNormalPacked> vertices, std::span<const uint> indices, const MeshLods& lods,
+            const JPH::Mat44& transform, bool doubleSided,
+            const std::vector<std::string>& diffuseTextures, const std::vector<std::string>& specularTextures
+        );
+
+        std::vector<uint8> Serialize(const SourceStamp& sourceStamp, uint postProcessFlags) const;
+    };
+
+private:
+    const uint8* m_data = nullptr;
+    uint64 m_size = 0;
+
+    //Either the file is mapped, or the cache was made in memory by a Builder (and owns its data)
+    void* m_mapping = nullptr;
+    std::vector<uint8> m_ownedData;
+
+    const FileHeader& GetHeader() const;
+    const MeshRecord& GetMeshRecord(uint index) const;
+
+    bool Validate(const SourceStamp& expectedStamp, uint expectedFlags) const;
+    void Unmap();
+
+public:
+    MeshCache() = default;
+    ~MeshCache();
+
+    MeshCache(const MeshCache&) = delete;
+    MeshCache& operator=(const MeshCache&) = delete;
+
+    //Maps the cache file, returns false (and leaves the cache closed) if it does not exist or is out of date
+    bool Open(const std::string& cachePath, const SourceStamp& expectedStamp, uint expectedFlags);
+
+    //Uses data from Builder::Serialize() directly, for when the cache could not be written to disk
+    void Open(std::vector<uint8>&& data);
+
+    bool IsOpen() const { return m_data != nullptr; }
+
+    uint GetNumMeshes() const;
+    MeshView GetMesh(uint index) const;
+    std::string_view GetTextureName(uint index) const;
+
+    static std::string GetCachePath(const std::string& sceneFilepath, uint postProcessFlags);
+
+    //Covers the scene file and the files next to it with the same name (such as the .bin of a .gltf)
+    static SourceStamp GetSourceStamp(const std::string& sceneFilepath);
+};
+
+
+
+#endif //MESHCACHE_H
@@ -0,0 +1,327 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+#include <unordered_map>
+
+namespace
+{
+    JPH::Vec3 GetPosition(const vertexUVNormalPacked& vertex)
+    {
+        return {vertex.posX, vertex.posY, vertex.posZ};
+    }
+
+    //The vertex is packed, so its bytes are all there is to compare
+    struct VertexBytesHash
+    {
+        size_t operator()(const vertexUVNormalPacked& vertex) const
+        {
+            return std::hash<std::string_view>()(std::string_view(reinterpret_cast<const char*>(&vertex), sizeof(vertex)));
+        }
+    };
+
+    struct VertexBytesEqual
+    {
+        bool operator()(const vertexUVNormalPacked& a, const vertexUVNormalPacked& b) const
+        {
+            return std::memcmp(&a, &b, sizeof(a)) == 0;
+        }
+    };
+
+    /*
+     * Tipsify: fans around a vertex, emitting all of its triangles that are left, and then moves on to the vertex of
+     * those triangles that will still be in the cache after its own fan (the oldest one, so the cache is used up
+     * before it is flushed). When none of them has triangles left, it is a dead end, and the next vertex is one that
+     * was used recently, or else the next one in order. outClusterStarts gets where each run between dead ends starts
+     */
+    void Tipsify(
+        std::span<const uint> indices, uint numVertices, std::vector<uint>& outTriangles, std::vector<uint>& outClusterStarts)
+    {
+        uint numTriangles = indices.size() / 3;
+
+        //The triangles of every vertex
+        std::vector<uint> adjacencyOffsets(numVertices + 1, 0);
+        for (uint index : indices)
+            adjacencyOffsets[index + 1]++;
+        for (uint i = 0; i < numVertices; i++)
+            adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+
+        std::vector<uint> adjacency(indices.size());
+        std::vector<uint> adjacencyEnds(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (uint triangle = 0; triangle < numTriangles; triangle++)
+        {
+            for (uint corner = 0; corner < 3; corner++)
+                adjacency[adjacencyEnds[indices[triangle * 3 + corner]]++] = triangle;
+        }
+
+        std::vector<uint> liveTriangles(numVertices); //Triangles of the vertex that are not emitted yet
+        for (uint i = 0; i < numVertices; i++)
+            liveTriangles[i] = adjacencyOffsets[i + 1] - adjacencyOffsets[i];
+
+        std::vector<int> cacheTimes(numVertices, 0); //When the vertex last went into the cache
+        std::vector<bool> emitted(numTriangles, false);
+        std::vector<uint> deadEndStack;
+        std::vector<uint> candidates;
+
+        int time = MeshOptimizer::cacheSize + 1;
+        uint cursor = 0;
+
+        auto skipDeadEnd = [&]() -> int
+        {
+            while (!deadEndStack.empty())
+            {
+                uint vertex = deadEndStack.back();
+                deadEndStack.pop_back();
+                if (liveTriangles[vertex] > 0)
+                    return vertex;
+            }
+
+            for (; cursor < numVertices; cursor++)
+            {
+                if (liveTriangles[cursor] > 0)
+                    return cursor;
+            }
+
+            return -1;
+        };
+
+        outTriangles.clear();
+        outClusterStarts.clear();
+        outTriangles.reserve(numTriangles);
+
+        int fanVertex = skipDeadEnd();
+        bool startsCluster = true;
+
+        while (fanVertex >= 0)
+        {
+            candidates.clear();
+            for (uint i = adjacencyOffsets[fanVertex]; i < adjacencyOffsets[fanVertex + 1]; i++)
+            {
+                uint triangle = adjacency[i];
+                if (emitted[triangle])
+                    continue;
+
+                if (startsCluster)
+                {
+                    outClusterStarts.push_back(outTriangles.size());
+                    startsCluster = false;
+                }
+
+                for (uint corner = 0; corner < 3; corner++)
+                {
+                    uint vertex = indices[triangle * 3 + corner];
+                    deadEndStack.push_back(vertex);
+                    candidates.push_back(vertex);
+                    liveTriangles[vertex]--;
+
+                    if (time - cacheTimes[vertex] > static_cast<int>(MeshOptimizer::cacheSize))
+                        cacheTimes[vertex] = time++;
+                }
+
+                emitted[triangle] = true;
+                outTriangles.push_back(triangle);
+            }
+
+            int nextVertex = -1;
+            int bestPriority = -1;
+            for (uint vertex : candidates)
+            {
+                if (liveTriangles[vertex] == 0)
+                    continue;
+
+                //Only the vertices that stay in the cache through their own fan are worth anything
+                int priority = 0;
+                if (time - cacheTimes[vertex] + 2 * static_cast<int>(liveTriangles[vertex]) <= static_cast<int>(MeshOptimizer::cacheSize))
+                    priority = time - cacheTimes[vertex];
+
+                if (priority > bestPriority)
+                {
+                    bestPriority = priority;
+                    nextVertex = vertex;
+                }
+            }
+
+            if (nextVertex < 0)
+            {
+                nextVertex = skipDeadEnd();
+                startsCluster = true;
+            }
+
+            fanVertex = nextVertex;
+        }
+    }
+}
+
+MeshOptimizer::CacheStats& MeshOptimizer::CacheStats::operator+=(const CacheStats &other)
+{
+    numTriangles += other.numTriangles;
+    numVertices += other.numVertices;
+    numTransformed += other.numTransformed;
+    return *this;
+}
+
+/*static*/ MeshOptimizer::CacheStats MeshOptimizer::AnalyzeVertexCache(std::span<const uint> indices, uint numVertices)
+{
+    CacheStats stats;
+    stats.numTriangles = indices.size() / 3;
+
+    //A vertex is in the cache if fewer than cacheSize vertices were transformed since it was
+    std::vector<uint64> transformedAt(numVertices, 0);
+
+    for (uint index : indices)
+    {
+        if (transformedAt[index] == 0)
+            stats.numVertices++;
+
+        if (transformedAt[index] == 0 || stats.numTransformed - transformedAt[index] >= cacheSize)
+            transformedAt[index] = ++stats.numTransformed;
+    }
+
+    return stats;
+}
+
+/*static*/ MeshLods MeshOptimizer::OptimizeMesh(
+    std::vector<vertexUVNormalPacked> &ioVertices, std::vector<uint> &ioIndices, OptimizationStats &ioStats)
+{
+    ioStats.before += AnalyzeVertexCache(ioIndices, ioVertices.size());
+
+    WeldVertices(ioVertices, ioIndices);
+    MeshLods lods = MeshSimplifier::GenerateLods(ioVertices, ioIndices);
+
+    for (uint level = 0; level < lods.numLevels; level++)
+        OptimizeTriangleOrder(ioVertices, std::span<uint>(ioIndices).subspan(lods.firstIndex[level], lods.indexCount[level]));
+
+    //After the triangles, as this follows their order. Level 0 comes first, so it decides the order
+    OptimizeVertexFetch(ioVertices, ioIndices);
+
+    ioStats.after += AnalyzeVertexCache(lods.GetIndices(ioIndices, 0), ioVertices.size());
+    return lods;
+}
+
+/*static*/ void MeshOptimizer::WeldVertices(std::vector<vertexUVNormalPacked> &ioVertices, std::vector<uint> &ioIndices)
+{
+    std::unordered_map<vertexUVNormalPacked, uint, VertexBytesHash, VertexBytesEqual> weldedIndices;
+    std::vector<vertexUVNormalPacked> weldedVertices;
+    std::vector<uint> remap(ioVertices.size(), ~0u);
+
+    weldedIndices.reserve(ioVertices.size());
+    weldedVertices.reserve(ioVertices.size());
+
+    for (uint& index : ioIndices)
+    {
+        if (remap[index] == ~0u)
+        {
+            auto [welded, inserted] = weldedIndices.try_emplace(ioVertices[index], weldedVertices.size());
+            if (inserted)
+                weldedVertices.push_back(ioVertices[index]);
+
+            remap[index] = welded->second;
+        }
+
+        index = remap[index];
+    }
+
+    ioVertices = std::move(weldedVertices);
+}
+
+/*static*/ void MeshOptimizer::OptimizeTriangleOrder(std::span<const vertexUVNormalPacked> vertices, std::span<uint> ioIndices)
+{
+    uint numTriangles = ioIndices.size() / 3;
+    if (numTriangles == 0)
+        return;
+
+    std::vector<uint> triangleOrder;
+    std::vector<uint> clusterStarts;
+    Tipsify(ioIndices, vertices.size(), triangleOrder, clusterStarts);
+
+    //A cluster that faces away from the center of the mesh is on the outside of it, drawing those first means that they
+    //hide the triangles behind them from most directions
+    struct Cluster
+    {
+        uint firstTriangle;
+        uint endTriangle;
+        JPH::Vec3 centroid;
+        JPH::Vec3 normal;
+        float outwardness;
+    };
+
+    auto getCorner = [&](uint triangle, uint corner) { return GetPosition(vertices[ioIndices[triangle * 3 + corner]]); };
+
+    JPH::Vec3 meshCentroid = JPH::Vec3::sZero();
+    float meshArea = 0.0f;
+    std::vector<Cluster> clusters(clusterStarts.size());
+
+    for (uint i = 0; i < clusters.size(); i++)
+    {
+        Cluster& cluster = clusters[i];
+        cluster.firstTriangle = clusterStarts[i];
+        cluster.endTriangle = i + 1 < clusterStarts.size() ? clusterStarts[i + 1] : numTriangles;
+        cluster.centroid = JPH::Vec3::sZero();
+        cluster.normal = JPH::Vec3::sZero();
+
+        float area = 0.0f;
+        for (uint j = cluster.firstTriangle; j < cluster.endTriangle; j++)
+        {
+            uint triangle = triangleOrder[j];
+            JPH::Vec3 a = getCorner(triangle, 0), b = getCorner(triangle, 1), c = getCorner(triangle, 2);
+
+            JPH::Vec3 cross = (b - a).Cross(c - a); //Twice the area, along the normal
+            float triangleArea = cross.Length();
+
+            cluster.centroid += (a + b + c) * (triangleArea / 3.0f);
+            cluster.normal += cross;
+            area += triangleArea;
+        }
+
+        meshCentroid += cluster.centroid;
+        meshArea += area;
+
+        if (area > 0.0f)
+            cluster.centroid /= area;
+        cluster.normal = cluster.normal.NormalizedOr(JPH::Vec3::sZero());
+    }
+
+    if (meshArea > 0.0f)
+        meshCentroid /= meshArea;
+
+    for (Cluster& cluster : clusters)
+        cluster.outwardness = (cluster.centroid - meshCentroid).Dot(cluster.normal);
+
+    //Stable, so the clusters that are just as far out keep the order that Tipsify gave them
+    std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) { return a.outwardness > b.outwardness; });
+
+    std::vector<uint> sortedIndices;
+    sortedIndices.reserve(ioIndices.size());
+
+    for (const Cluster& cluster : clusters)
+    {
+        for (uint j = cluster.firstTriangle; j < cluster.endTriangle; j++)
+        {
+            uint triangle = triangleOrder[j];
+            sortedIndices.insert(sortedIndices.end(), ioIndices.begin() + triangle * 3, ioIndices.begin() + triangle * 3 + 3);
+        }
+    }
+
+    std::copy(sortedIndices.begin(), sortedIndices.end(), ioIndices.begin());
+}
+
+/*static*/ void MeshOptimizer::OptimizeVertexFetch(std::vector<vertexUVNormalPacked> &ioVertices, std::vector<uint> &ioIndices)
+{
+    std::vector<uint> remap(ioVertices.size(), ~0u);
+    std::vector<vertexUVNormalPacked> sortedVertices;
+    sortedVertices.reserve(ioVertices.size());
+
+    for (uint& index : ioIndices)
+    {
+        if (remap[index] == ~0u)
+        {
+            remap[index] = sortedVertices.size();
+            sortedVertices.push_back(ioVertices[index]);
+        }
+
+        index = remap[index];
+    }
+
+    ioVertices = std::move(sortedVertices);
+}
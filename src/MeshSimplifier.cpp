@@ -0,0 +1,149 @@
+#include "MeshSimplifier.h"
+
+#include <Jolt/Geometry/AABox.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <unordered_map>
+
+namespace
+{
+    JPH::Vec3 GetPosition(const vertexUVNormalPacked& vertex)
+    {
+        return {vertex.posX, vertex.posY, vertex.posZ};
+    }
+}
+
+/*static*/ MeshLods MeshSimplifier::GenerateLods(std::span<const vertexUVNormalPacked> vertices, std::vector<uint> &ioIndices)
+{
+    MeshLods lods;
+    lods.indexCount[0] = ioIndices.size();
+
+    JPH::AABox bounds;
+    for (const vertexUVNormalPacked& vertex : vertices)
+        bounds.Encapsulate(GetPosition(vertex));
+
+    uint previousTriangles = ioIndices.size() / 3;
+    if (previousTriangles < minTriangles)
+        return lods;
+
+    float longestSide = bounds.GetSize().ReduceMax();
+    float cellSize = longestSide / maxGridResolution;
+
+    std::vector<uint> levelIndices;
+    while (lods.numLevels < MeshLods::maxLevels && previousTriangles >= minTriangles)
+    {
+        //Grow the cells until enough triangles collapse, the next level starts from where this one ended up
+        float error;
+        do
+        {
+            error = Cluster(vertices, lods.GetIndices(ioIndices, 0), cellSize, levelIndices);
+            cellSize *= 2.0f;
+        }
+        while (levelIndices.size() / 3 > previousTriangles * targetReduction && cellSize < longestSide);
+
+        //Either the whole mesh collapsed, or it does not get any simpler with cells as big as the mesh
+        uint numTriangles = levelIndices.size() / 3;
+        if (numTriangles == 0 || numTriangles > previousTriangles * targetReduction)
+            break;
+
+        uint level = lods.numLevels++;
+        lods.firstIndex[level] = ioIndices.size();
+        lods.indexCount[level] = levelIndices.size();
+        lods.error[level] = std::max(error, lods.error[level - 1]); //So that coarser levels are never picked before finer ones
+
+        ioIndices.insert(ioIndices.end(), levelIndices.begin(), levelIndices.end());
+        previousTriangles = numTriangles;
+    }
+
+    return lods;
+}
+
+/*static*/ float MeshSimplifier::Cluster(
+    std::span<const vertexUVNormalPacked> vertices, std::span<const uint> indices, float cellSize,
+    std::vector<uint> &outIndices)
+{
+    outIndices.clear();
+
+    JPH::Vec3 boundsMin = JPH::Vec3::sReplicate(FLT_MAX);
+    for (const vertexUVNormalPacked& vertex : vertices)
+        boundsMin = JPH::Vec3::sMin(boundsMin, GetPosition(vertex));
+
+    //Find the cell of every vertex, and sum up the positions in every cell for their averages
+    static constexpr uint64 maxCellCoordinate = (1 << 21) - 1; //So the 3 coordinates fit in one key
+    float invCellSize = 1.0f / cellSize;
+
+    std::unordered_map<uint64, uint> cellsByKey;
+    std::vector<uint> vertexCells(vertices.size());
+    std::vector<JPH::Vec3> cellPositionSums;
+    std::vector<uint> cellVertexCounts;
+
+    for (uint i = 0; i < vertices.size(); i++)
+    {
+        JPH::Vec3 cellCoordinates = (GetPosition(vertices[i]) - boundsMin) * invCellSize;
+        uint64 x = std::min(static_cast<uint64>(cellCoordinates.GetX()), maxCellCoordinate);
+        uint64 y = std::min(static_cast<uint64>(cellCoordinates.GetY()), maxCellCoordinate);
+        uint64 z = std::min(static_cast<uint64>(cellCoordinates.GetZ()), maxCellCoordinate);
+
+        auto [cell, inserted] = cellsByKey.try_emplace(x | y << 21 | z << 42, cellPositionSums.size());
+        if (inserted)
+        {
+            cellPositionSums.push_back(JPH::Vec3::sZero());
+            cellVertexCounts.push_back(0);
+        }
+
+        vertexCells[i] = cell->second;
+        cellPositionSums[cell->second] += GetPosition(vertices[i]);
+        cellVertexCounts[cell->second]++;
+    }
+
+    //Every cell collapses onto its vertex that is nearest to the average
+    std::vector<uint> cellVertices(cellPositionSums.size());
+    std::vector<float> cellDistancesSq(cellPositionSums.size(), FLT_MAX);
+
+    for (uint i = 0; i < vertices.size(); i++)
+    {
+        uint cell = vertexCells[i];
+        JPH::Vec3 average = cellPositionSums[cell] / static_cast<float>(cellVertexCounts[cell]);
+        float distanceSq = (GetPosition(vertices[i]) - average).LengthSq();
+
+        if (distanceSq < cellDistancesSq[cell])
+        {
+            cellDistancesSq[cell] = distanceSq;
+            cellVertices[cell] = i;
+        }
+    }
+
+    //Drop the triangles that collapsed to a line or a point, and the ones that became the same as another
+    float maxErrorSq = 0.0f;
+    std::vector<std::array<uint, 3>> triangles;
+    triangles.reserve(indices.size() / 3);
+
+    for (uint i = 0; i + 2 < indices.size(); i += 3)
+    {
+        std::array<uint, 3> triangle;
+        for (uint j = 0; j < 3; j++)
+        {
+            uint vertex = indices[i + j];
+            triangle[j] = cellVertices[vertexCells[vertex]];
+            maxErrorSq = std::max(maxErrorSq, (GetPosition(vertices[vertex]) - GetPosition(vertices[triangle[j]])).LengthSq());
+        }
+
+        if (triangle[0] == triangle[1] || triangle[1] == triangle[2] || triangle[0] == triangle[2])
+            continue;
+
+        //Start at the smallest index, keeping the winding, so the same triangle always looks the same
+        std::rotate(triangle.begin(), std::min_element(triangle.begin(), triangle.end()), triangle.end());
+        triangles.push_back(triangle);
+    }
+
+    std::sort(triangles.begin(), triangles.end());
+    triangles.erase(std::unique(triangles.begin(), triangles.end()), triangles.end());
+
+    outIndices.reserve(triangles.size() * 3);
+    for (const std::array<uint, 3>& triangle : triangles)
+        outIndices.insert(outIndices.end(), triangle.begin(), triangle.end());
+
+    return std::sqrt(maxErrorSq);
+}
@@ -0,0 +1,65 @@
+#ifndef MESHSIMPLIFIER_H
+#define MESHSIMPLIFIER_H
+
+#include "Util.h"
+
+#include <array>
+#include <span>
+#include <vector>
+
+/*
+ * The levels of detail of a mesh. Every level indexes the same vertices, and the indices of the levels are stored one
+ * after another (level 0, the full mesh, first), so all of them fit in the mesh's one vertex and index buffer.
+ */
+struct MeshLods
+{
+    static constexpr uint maxLevels = 4; //Including level 0
+
+    uint numLevels = 1;
+    std::array<uint, maxLevels> firstIndex{};
+    std::array<uint, maxLevels> indexCount{};
+    std::array<float, maxLevels> error{}; //How far (in model space) any vertex was moved, always 0 for level 0
+
+    std::span<const uint> GetIndices(std::span<const uint> allIndices, uint level) const
+    {
+        return allIndices.subspan(firstIndex[level], indexCount[level]);
+    }
+};
+
+/*
+ * Generates the levels of detail of meshes when they are imported, by vertex clustering: the vertices are snapped to a
+ * grid, each cell is collapsed onto the vertex nearest to the average of the vertices in it, and the triangles that
+ * collapse are dropped. The cells get bigger for every level, until a level has at most half of the triangles of the
+ * level before it.
+ *
+ * As the levels only pick out vertices that already exist, the vertices of a level keep their UVs and normals, and no
+ * vertices have to be added. Clustering does not respect UV seams or the topology of the mesh, but it is only used for
+ * meshes far enough away that the moved vertices stay below a pixel or so (see Mesh::SelectLod()).
+ */
+class MeshSimplifier
+{
+public:
+    static constexpr uint minTriangles = 64; //Smaller meshes (and levels) are not worth simplifying any further
+    static constexpr float targetReduction = 0.5f; //Each level has at most this fraction of the triangles of the one before
+    static constexpr uint maxGridResolution = 256; //Cells along the longest side of the bounds, for the first try of level 1
+
+    /**
+     * Appends the simplified levels of the mesh to ioIndices, which holds the triangles of the full mesh. Returns where
+     * each level is in ioIndices
+     */
+    static MeshLods GenerateLods(std::span<const vertexUVNormalPacked> vertices, std::vector<uint>& ioIndices);
+
+private:
+    /**
+     * Clusters the vertices with cells of cellSize, and writes the triangles that are left to outIndices.
+     * Returns the furthest that a vertex moved
+     */
+    static float Cluster(
+        std::span<const vertexUVNormalPacked> vertices, std::span<const uint> indices, float cellSize,
+        std::vector<uint>& outIndices
+    );
+};
+
+
+
+#endif //MESHSIMPLIFIER_H
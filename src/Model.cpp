@@ -1,84 +1,181 @@
 #include "Model.h"
 
+#include <stb_image/stb_image.h>
+
 Model::Model(Renderer& renderer, const std::string& sceneFilepath)
     :   m_renderer(renderer)
+{
+    LoadScene(sceneFilepath, postProcessFlags);
+}
+
+void Model::LoadScene(const std::string &sceneFilepath, uint postProcessFlags, const JPH::Mat44 &rootTransform)
 {
     //TODO: BIGGEST HACK OF ALL TIME. If the number of textures exceeds this
     //then all textures for this model break as the memory of the vector gets reallocated, and so the pointers become invalid
     //We could heap allocated the textures using unique_pointer but that adds double indirection so this should be good enough
     m_loadedTextures.reserve(500);
-    Assimp::Importer importer;
-    const aiScene* scene = importer.ReadFile(sceneFilepath, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_ForceGenNormals);
 
-    ASSERT_LOG(
-        !(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode),
-        "Error with loading model:" << importer.GetErrorString() << " with path " << sceneFilepath
-    );
+    std::string directory = sceneFilepath.substr(0, sceneFilepath.find_last_of('/'));
+    std::string cachePath = MeshCache::GetCachePath(sceneFilepath, postProcessFlags);
+    MeshCache::SourceStamp sourceStamp = MeshCache::GetSourceStamp(sceneFilepath);
+
+    MeshCache cache;
+    if (!cache.Open(cachePath, sourceStamp, postProcessFlags))
+    {
+        Assimp::Importer importer;
+        const aiScene* scene = importer.ReadFile(sceneFilepath, postProcessFlags);
+
+        ASSERT_LOG(
+            !(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode),
+            "Error with loading model:" << importer.GetErrorString() << " with path " << sceneFilepath
+        );
+
+        MeshCache::Builder cacheBuilder;
+        MeshOptimizer::OptimizationStats stats;
+        ProcessNode(scene->mRootNode, scene, JPH::Mat44::sIdentity(), cacheBuilder, stats);
+
+        std::cout << "[INFO, Model.cpp, LoadScene] Optimized \"" << sceneFilepath << "\" for a vertex cache of "
+            << MeshOptimizer::cacheSize << ": ACMR " << stats.before.GetACMR() << " -> " << stats.after.GetACMR()
+            << ", ATVR " << stats.before.GetATVR() << " -> " << stats.after.GetATVR() << std::endl;
+
+        //The meshes are always added from the cache, so that the first run and every run after it behave the same
+        std::vector<uint8> cacheData = cacheBuilder.Serialize(sourceStamp, postProcessFlags);
+
+        if (!Util::WriteFileAtomic(cachePath, cacheData))
+            std::cout << "[WARNING, Model.cpp, LoadScene] Unable to write mesh cache \"" << cachePath << "\"" << std::endl;
+
+        cache.Open(std::move(cacheData));
+    }
+
+    m_meshes.reserve(m_meshes.size() + cache.GetNumMeshes());
+
+    std::vector<const Texture*> textures;
+    for (uint i = 0; i < cache.GetNumMeshes(); i++)
+    {
+        MeshCache::MeshView mesh = cache.GetMesh(i);
 
-    ProcessNode(scene->mRootNode, scene, sceneFilepath.substr(0, sceneFilepath.find_last_of('/')), JPH::Mat44::sIdentity());
+        textures.clear();
+        for (uint j = 0; j < mesh.numDiffuseTextures + mesh.numSpecularTextures; j++)
+        {
+            Texture::TextureType texType = j < mesh.numDiffuseTextures ? Texture::TextureType::diffuse : Texture::TextureType::specular;
+            textures.push_back(LoadTexture(directory + "/" + std::string(cache.GetTextureName(mesh.firstTexture + j)), texType));
+        }
+
+        //A transform that mirrors the mesh also flips the winding of its triangles, so its front faces would be culled
+        JPH::Mat44 transform = rootTransform * mesh.transform;
+        bool doubleSided = mesh.doubleSided || transform.GetDeterminant3x3() < 0.0f;
+
+        AddMesh(mesh.vertices, mesh.indices, mesh.lods, textures, doubleSided, transform);
+    }
+
+    UploadTextureArrays();
 }
 
-void Model::ProcessNode(aiNode *node, const aiScene *scene, const std::string &directory, const JPH::Mat44& parentTransformation)
+void Model::AddMesh(
+    std::span<const vertexUVNormalPacked> vertices, std::span<const uint> indices, const MeshLods& lods,
+    const std::vector<const Texture*> &textures, bool doubleSided, const JPH::Mat44 &transform)
 {
-    m_meshes.reserve(m_meshes.size() + node->mNumMeshes);
+    Error error;
+    m_meshes.emplace_back(vertices, indices, lods, textures, doubleSided, transform, error);
+
+    HANDLE_ERROR(error,
+        ASSERT_LOG(false, "Unable to process a mesh. Canceling Mesh processing.");
+    );
+}
 
+void Model::ProcessNode(
+    aiNode *node, const aiScene *scene, const JPH::Mat44& parentTransformation, MeshCache::Builder& cacheBuilder,
+    MeshOptimizer::OptimizationStats& ioStats)
+{
     aiMatrix4x4 aiLocal = node->mTransformation;
     JPH::Mat44 local = ConvertAssimpMatrix(aiLocal);
     JPH::Mat44 globalTransform = parentTransformation * local;
 
+    std::vector<vertexUVNormalPacked> vertices;
+    std::vector<uint> indices;
+    std::vector<std::string> diffuseTextures;
+    std::vector<std::string> specularTextures;
+
     for (int i = 0; i < node->mNumMeshes; i++)
     {
         aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
 
-        std::vector<vertexUVNormal> vertices;
-        std::vector<uint> indices;
-        std::vector<const Texture*> textures;
-
-        ProcessMesh(mesh, scene, directory, vertices, indices, textures);
+        vertices.clear();
+        indices.clear();
+        diffuseTextures.clear();
+        specularTextures.clear();
 
-        Error error;
-        m_meshes.emplace_back(vertices, indices, textures, globalTransform, error);
-
-        HANDLE_ERROR(error,
-            ASSERT_LOG(false, "Unable to process a mesh. Canceling Mesh processing.");
-        );
+        bool doubleSided = false;
+        ProcessMesh(mesh, scene, vertices, indices, diffuseTextures, specularTextures, doubleSided);
+        MeshLods lods = MeshOptimizer::OptimizeMesh(vertices, indices, ioStats);
+        cacheBuilder.AddMesh(vertices, indices, lods, globalTransform, doubleSided, diffuseTextures, specularTextures);
     }
 
     for(unsigned int i = 0; i < node->mNumChildren; i++)
     {
-        ProcessNode(node->mChildren[i], scene, directory, globalTransform);
+        ProcessNode(node->mChildren[i], scene, globalTransform, cacheBuilder, ioStats);
     }
 }
 
-void Model::ProcessMesh(aiMesh *mesh, const aiScene *scene, const std::string &directory,
-                        std::vector<vertexUVNormal> &outVertices,
+void Model::ProcessMesh(aiMesh *mesh, const aiScene *scene,
+                        std::vector<vertexUVNormalPacked> &outVertices,
                         std::vector<uint> &outIndices,
-                        std::vector<const Texture*> &outTextures
+                        std::vector<std::string> &outDiffuseTextures,
+                        std::vector<std::string> &outSpecularTextures,
+                        bool &outDoubleSided
 )
 {
     aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
 
     outVertices.reserve(mesh->mNumVertices);
-    //Roughly preallocate some memory so that lots of tiny allocations are not made
-    outIndices.reserve(mesh->mFaces[0].mNumIndices * 2);
-    outTextures.reserve(material->GetTextureCount(aiTextureType_DIFFUSE) + material->GetTextureCount(aiTextureType_SPECULAR));
+    outIndices.reserve(static_cast<uint64>(mesh->mNumFaces) * 3);
+
+    //The textures repeat, so the UVs can be moved by whole repeats to around 0, where half floats are the most precise
+    float uvOffsetX = 0.0f;
+    float uvOffsetY = 0.0f;
+
+    if (mesh->mTextureCoords[0] && mesh->mNumVertices > 0)
+    {
+        aiVector3D minUV = mesh->mTextureCoords[0][0];
+        aiVector3D maxUV = minUV;
+        for (uint i = 1; i < mesh->mNumVertices; i++)
+        {
+            const aiVector3D& uv = mesh->mTextureCoords[0][i];
+            minUV = aiVector3D(std::min(minUV.x, uv.x), std::min(minUV.y, uv.y), 0.0f);
+            maxUV = aiVector3D(std::max(maxUV.x, uv.x), std::max(maxUV.y, uv.y), 0.0f);
+        }
+
+        bool outsidePreciseRange = std::min(minUV.x, minUV.y) < -maxPreciseUV || std::max(maxUV.x, maxUV.y) > maxPreciseUV;
+        if (outsidePreciseRange)
+        {
+            uvOffsetX = std::round((minUV.x + maxUV.x) * 0.5f);
+            uvOffsetY = std::round((minUV.y + maxUV.y) * 0.5f);
+
+            //Moving them does not help if the mesh itself spans too many repeats
+            bool stillOutside = maxUV.x - uvOffsetX > maxPreciseUV || minUV.x - uvOffsetX < -maxPreciseUV ||
+                maxUV.y - uvOffsetY > maxPreciseUV || minUV.y - uvOffsetY < -maxPreciseUV;
+
+            std::cout << "[WARNING, Model.cpp, ProcessMesh] The UVs of mesh \"" << mesh->mName.C_Str() << "\" are between ("
+                << minUV.x << ", " << minUV.y << ") and (" << maxUV.x << ", " << maxUV.y << "), they are moved by ("
+                << -uvOffsetX << ", " << -uvOffsetY << ")"
+                << (stillOutside ? " but still lose precision as half floats" : "") << std::endl;
+        }
+    }
 
     for (uint i = 0; i < mesh->mNumVertices; i++)
     {
-        vertexUVNormal vertex{};
+        vertexUVNormalPacked vertex{};
 
         vertex.posX = mesh->mVertices[i].x;
         vertex.posY = mesh->mVertices[i].y;
         vertex.posZ = mesh->mVertices[i].z;
 
-        vertex.normalX = mesh->mNormals[i].x;
-        vertex.normalY = mesh->mNormals[i].y;
-        vertex.normalZ = mesh->mNormals[i].z;
+        vertex.normal = Util::PackNormal(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
 
         if (mesh->mTextureCoords[0])
         {
-            vertex.texcoordX = mesh->mTextureCoords[0][i].x;
-            vertex.texcoordY = mesh->mTextureCoords[0][i].y;
+            vertex.texcoordX = Util::FloatToHalf(mesh->mTextureCoords[0][i].x - uvOffsetX);
+            vertex.texcoordY = Util::FloatToHalf(mesh->mTextureCoords[0][i].y - uvOffsetY);
         }
 
         outVertices.push_back(vertex);
@@ -91,38 +188,82 @@ void Model::ProcessMesh(aiMesh *mesh, const aiScene *scene, const std::string &d
             outIndices.emplace_back(face.mIndices[j]);
     }
 
-    LoadMaterialTextures(material, aiTextureType_DIFFUSE, Texture::TextureType::diffuse, directory, outTextures);
-    LoadMaterialTextures(material, aiTextureType_SPECULAR, Texture::TextureType::specular, directory, outTextures);
+    GetMaterialTextureNames(material, aiTextureType_DIFFUSE, outDiffuseTextures);
+    GetMaterialTextureNames(material, aiTextureType_SPECULAR, outSpecularTextures);
 
-    outIndices.shrink_to_fit();
+    int twoSided = 0;
+    outDoubleSided = material->Get(AI_MATKEY_TWOSIDED, twoSided) == AI_SUCCESS && twoSided != 0;
 }
 
-void Model::LoadMaterialTextures(aiMaterial *mat, aiTextureType type, Texture::TextureType texType, const std::string& directory, std::vector<const Texture*> &outTexVector)
+void Model::GetMaterialTextureNames(aiMaterial *mat, aiTextureType type, std::vector<std::string> &outNames)
 {
     int numTexture = mat->GetTextureCount(type);
     for (int i = 0; i < numTexture; i++)
     {
         aiString str;
         mat->GetTexture(type, i, &str);
+        outNames.emplace_back(str.C_Str());
+    }
+}
 
-        //If we can find it in the global model textures vector, then just return that
-        //Otherwise, add it to the global model textures vector
-        bool addToGlobalTextures = false;
-        for (int j = 0; j < m_loadedTextures.size(); j++)
-        {
-            if (m_loadedTextures[j].GetFilePath() == (directory + "/" + str.C_Str()))
-            {
-                outTexVector.emplace_back(&m_loadedTextures[j]);
-                addToGlobalTextures = true;
-                break;
-            }
-        }
+const Texture* Model::LoadTexture(const std::string &path, Texture::TextureType texType)
+{
+    //If we can find it in the global model textures vector, then just return that
+    //Otherwise, add it to the global model textures vector
+    for (const Texture& texture : m_loadedTextures)
+    {
+        if (texture.GetFilePath() == path)
+            return &texture;
+    }
 
-        if (!addToGlobalTextures)
-        {
-            m_loadedTextures.emplace_back(directory + "/" + str.C_Str(), texType);
-            outTexVector.emplace_back(&m_loadedTextures.back());
-        }
+    //Only reads the header, the image itself is loaded in UploadTextureArrays()
+    //If the texture cooker has made a compressed version of the image, that is loaded instead
+    std::string cookedPath = CompressedTexture::FindCookedPath(path);
+    CompressedTexture::Info cookedInfo;
+    int width, height, bytesPerPixel;
+
+    if (!cookedPath.empty() && CompressedTexture::ReadInfo(cookedPath, cookedInfo))
+    {
+        TextureArray& textureArray = FindOrAddTextureArray(cookedInfo.width, cookedInfo.height, cookedInfo.format);
+        uint layer = textureArray.AddLayer(cookedPath, cookedInfo.numLevels);
+
+        m_loadedTextures.emplace_back();
+        m_loadedTextures.back().InitAsLayer(textureArray.GetRendererID(), layer, cookedInfo.width, cookedInfo.height, path, texType);
+    }
+    else if (stbi_info(path.c_str(), &width, &height, &bytesPerPixel))
+    {
+        TextureArray& textureArray = FindOrAddTextureArray(width, height, CompressedTexture::Format::rgba8);
+        uint layer = textureArray.AddLayer(path);
+
+        m_loadedTextures.emplace_back();
+        m_loadedTextures.back().InitAsLayer(textureArray.GetRendererID(), layer, width, height, path, texType);
+    }
+    else
+    {
+        m_loadedTextures.emplace_back(path, texType); //This will print out the error
+    }
+
+    return &m_loadedTextures.back();
+}
+
+TextureArray& Model::FindOrAddTextureArray(int width, int height, CompressedTexture::Format format)
+{
+    for (TextureArray& textureArray : m_textureArrays)
+    {
+        if (textureArray.GetWidth() == width && textureArray.GetHeight() == height && textureArray.GetFormat() == format &&
+            !textureArray.IsUploaded())
+            return textureArray;
+    }
+
+    return m_textureArrays.emplace_back(width, height, format);
+}
+
+void Model::UploadTextureArrays()
+{
+    for (TextureArray& textureArray : m_textureArrays)
+    {
+        if (!textureArray.IsUploaded())
+            textureArray.Upload(m_renderer.GetTextureLoader());
     }
 }
 
@@ -140,7 +281,7 @@ JPH::Mat44 Model::ConvertAssimpMatrix(const aiMatrix4x4 &mat)
 
 void Model::Draw(Shader& shader, const JPH::Mat44& projectionMatrix, const JPH::Mat44& viewMatrix)
 {
-    shader.SetUniform("u_viewMatrix", viewMatrix);
+    m_renderer.SetFrameUniforms(viewMatrix, projectionMatrix);
 
     for (Mesh& mesh : m_meshes)
         mesh.Draw(m_renderer, shader, projectionMatrix * viewMatrix);
@@ -149,7 +290,7 @@ void Model::Draw(Shader& shader, const JPH::Mat44& projectionMatrix, const JPH::
 void Model::Draw(Shader &shader, const JPH::Mat44 &projectionMatrix, const JPH::Mat44 &viewMatrix,
     const JPH::Mat44 &modelMatrix)
 {
-    shader.SetUniform("u_viewMatrix", viewMatrix);
+    m_renderer.SetFrameUniforms(viewMatrix, projectionMatrix);
 
     for (Mesh& mesh : m_meshes)
         mesh.Draw(m_renderer, shader, projectionMatrix * viewMatrix, modelMatrix);
@@ -3,6 +3,9 @@
 
 #include "Renderer.h"
 #include "Texture.h"
+#include "TextureArray.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
 #include "../Mesh.h"
 
 #include <assimp/Importer.hpp>
@@ -11,34 +14,74 @@
 
 #include "Physics.h"
 
+#include <span>
+
 class Model
 {
 protected:
     Renderer& m_renderer;
     std::vector<Mesh> m_meshes;
     std::vector<Texture> m_loadedTextures;
+    std::vector<TextureArray> m_textureArrays; //Every texture in m_loadedTextures is a layer in one of these
 
-    virtual void ProcessNode(aiNode* node, const aiScene* scene, const std::string &directory, const JPH::Mat44& parentTransformation);
+    /*
+     * Loads every mesh in the scene, either from its mesh cache or (if there is no valid cache) by importing it with
+     * Assimp and then writing the cache. Every mesh is given to AddMesh(), and the textures are queued to be loaded.
+     * rootTransform is applied on top of the transforms of the nodes in the scene.
+     */
+    void LoadScene(const std::string& sceneFilepath, uint postProcessFlags, const JPH::Mat44& rootTransform = JPH::Mat44::sIdentity());
 
-    virtual void ProcessMesh(
-        aiMesh* mesh, const aiScene* scene, const std::string &directory,
-        std::vector<vertexUVNormal> &outVertices,
-        std::vector<uint> &outIndices,
-        std::vector<const Texture*> &outTextures
+    /*
+     * Called for every mesh in the scene, in the same order every time. The spans might point into a memory mapped
+     * cache file, so they are only valid during the call. indices holds every level of detail (see lods), level 0 is the
+     * full mesh. doubleSided meshes are drawn without back face culling (see Material).
+     * Child classes override this to also add the mesh to the physics engine.
+     */
+    virtual void AddMesh(
+        std::span<const vertexUVNormalPacked> vertices, std::span<const uint> indices, const MeshLods& lods,
+        const std::vector<const Texture*>& textures, bool doubleSided, const JPH::Mat44& transform
+    );
+
+    //Runs every mesh through MeshOptimizer::OptimizeMesh() before it goes into the cache
+    void ProcessNode(
+        aiNode* node, const aiScene* scene, const JPH::Mat44& parentTransformation, MeshCache::Builder& cacheBuilder,
+        MeshOptimizer::OptimizationStats& ioStats
     );
 
-    void LoadMaterialTextures(
-        aiMaterial *mat, aiTextureType type,
-        Texture::TextureType texType, const std::string& directory,
-        std::vector<const Texture*> &outTexVector
+    //Half float UVs are precise to 1/1024 of a texture repeat up to this, see vertexUVNormalPacked
+    static constexpr float maxPreciseUV = 2.0f;
+
+    //Copies the vertices, indices, texture names and whether the material is two sided out of an Assimp mesh
+    static void ProcessMesh(
+        aiMesh* mesh, const aiScene* scene,
+        std::vector<vertexUVNormalPacked> &outVertices,
+        std::vector<uint> &outIndices,
+        std::vector<std::string> &outDiffuseTextures,
+        std::vector<std::string> &outSpecularTextures,
+        bool &outDoubleSided
     );
 
+    static void GetMaterialTextureNames(aiMaterial* mat, aiTextureType type, std::vector<std::string>& outNames);
+
+    //Returns the texture with this path, loading it if no mesh in this model has used it yet
+    const Texture* LoadTexture(const std::string& path, Texture::TextureType texType);
+
+    //Returns the texture array that holds textures of this size and format, creating it if needed
+    TextureArray& FindOrAddTextureArray(int width, int height, CompressedTexture::Format format);
+
+    //Must be called once all meshes have been processed, this is when the texture images are queued to be loaded
+    void UploadTextureArrays();
+
     static JPH::Mat44 ConvertAssimpMatrix(const aiMatrix4x4& matrix);
 
     //This constructor is so that the model itself is not loaded, instead that it left for the child class to do
     explicit Model(Renderer& renderer) : m_renderer(renderer) {}
 
 public:
+    //NOTE: Changing these rebuilds the mesh caches, as the flags are part of the cache
+    static constexpr uint postProcessFlags =
+        aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_ForceGenNormals | aiProcess_JoinIdenticalVertices;
+
     virtual ~Model() = default;
 
     Model(Renderer& renderer, const std::string& sceneFilepath);
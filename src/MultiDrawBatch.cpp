@@ -0,0 +1,301 @@
+#include "MultiDrawBatch.h"
+
+#include "Mesh.h"
+
+#include <algorithm>
+
+MultiDrawBatch::MultiDrawBatch()
+    :   m_meshDataBuffer(GL_SHADER_STORAGE_BUFFER),
+        m_indirectBuffer(GL_DRAW_INDIRECT_BUFFER),
+        m_cullMeshDataBuffer(GL_SHADER_STORAGE_BUFFER),
+        m_culledCommandBuffer(GL_DRAW_INDIRECT_BUFFER),
+        m_culledDrawCountBuffer(GL_PARAMETER_BUFFER)
+#ifdef ENABLE_IMGUI
+        ,m_cullStatsBuffer(GL_SHADER_STORAGE_BUFFER),
+        m_cullStatsReadback(GL_COPY_WRITE_BUFFER)
+#endif
+{
+    VertexArray::Unbind(); //The VertexArray constructor binds it, and we do not want other buffers to get attached to it
+}
+
+MultiDrawBatch::~MultiDrawBatch()
+{
+#ifdef ENABLE_IMGUI
+    for (GLsync fence : m_cullStatsFences)
+    {
+        if (fence != nullptr)
+            glDeleteSync(fence);
+    }
+#endif
+}
+
+void MultiDrawBatch::AddMesh(
+    std::span<const vertexUVNormalPacked> vertices, std::span<const uint> indices,
+    const std::vector<const Texture*> &textures, bool doubleSided, const JPH::Mat44 &modelMatrix)
+{
+    ASSERT_LOG(!m_finalized, "Meshes can not be added to a MultiDrawBatch after it has been finalized");
+
+    MeshRange range{};
+    range.indexCount = indices.size();
+    range.firstIndex = m_stagingIndices.size();
+    range.baseVertex = static_cast<int>(m_stagingVertices.size());
+    Material material(textures, doubleSided);
+    range.materialIndex = FindOrAddMaterial(material);
+
+    m_meshRanges.push_back(range);
+    m_stagingMeshData.push_back({modelMatrix, NormalMatrix(modelMatrix), material.GetTextureLayers()});
+
+    JPH::AABox bounds = Mesh::ComputeBounds(vertices).Transformed(modelMatrix);
+
+    //The command region is only known once every mesh has been added, see Finalize()
+    CullMeshData cullData{};
+    bounds.GetCenter().StoreFloat3(&cullData.boundsCenter);
+    bounds.GetExtent().StoreFloat3(&cullData.boundsExtent);
+    cullData.materialIndex = range.materialIndex;
+    cullData.indexCount = range.indexCount;
+    cullData.firstIndex = range.firstIndex;
+    cullData.baseVertex = range.baseVertex;
+    m_stagingCullMeshData.push_back(cullData);
+
+    //Indices are kept relative to the mesh, baseVertex offsets them when drawing
+    m_stagingVertices.insert(m_stagingVertices.end(), vertices.begin(), vertices.end());
+    m_stagingIndices.insert(m_stagingIndices.end(), indices.begin(), indices.end());
+}
+
+void MultiDrawBatch::Finalize()
+{
+    ASSERT_LOG(!m_finalized, "MultiDrawBatch has already been finalized");
+    m_finalized = true;
+
+    if (IsEmpty())
+        return;
+
+    VertexBufferLayout layout;
+    layout.Push<float>(3); //pos
+    layout.Push<HalfFloat>(2); //uv
+    layout.Push<Int2_10_10_10Rev>(4); //normals
+
+    m_vao.Bind();
+
+    m_vbo.Init(m_stagingVertices.data(), m_stagingVertices.size() * sizeof(m_stagingVertices[0]));
+    m_ibo.Init(m_stagingIndices.data(), m_stagingIndices.size());
+    m_vao.AddBuffer(m_vbo, m_ibo, layout);
+
+    VertexArray::Unbind();
+
+    //Because JPH::Mat44, JPH::Vec4 and JPH::UVec4 are guaranteed to be trivial types, this matches the std430 MeshData[]
+    m_meshDataBuffer.Init(m_stagingMeshData.data(), m_stagingMeshData.size() * sizeof(MeshData));
+
+    m_materialMeshCounts.resize(m_materials.size());
+    for (const MeshRange& range : m_meshRanges)
+        m_materialMeshCounts[range.materialIndex]++;
+
+    m_materialCommandRegions.resize(m_materials.size());
+    uint commandRegion = 0;
+    for (uint i = 0; i < m_materials.size(); i++)
+    {
+        m_materialCommandRegions[i] = commandRegion;
+        commandRegion += m_materialMeshCounts[i];
+    }
+
+    for (CullMeshData& cullData : m_stagingCullMeshData)
+        cullData.commandRegion = m_materialCommandRegions[cullData.materialIndex];
+
+    m_cullMeshDataBuffer.Init(m_stagingCullMeshData.data(), m_stagingCullMeshData.size() * sizeof(CullMeshData));
+    m_culledCommandBuffer.Init(nullptr, m_meshRanges.size() * sizeof(DrawElementsIndirectCommand), GL_DYNAMIC_COPY);
+    m_culledDrawCountBuffer.Init(nullptr, m_materials.size() * sizeof(uint), GL_DYNAMIC_COPY);
+
+#ifdef ENABLE_IMGUI
+    m_cullStatsBuffer.Init(nullptr, 2 * sizeof(uint), GL_DYNAMIC_COPY);
+
+    uint readbackSize = numCullStatsSlots * 2 * sizeof(uint);
+    uint readbackFlags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    m_cullStatsReadback.InitStorage(nullptr, readbackSize, readbackFlags);
+    m_cullStatsMapping = static_cast<const uint*>(m_cullStatsReadback.Map(0, readbackSize, readbackFlags));
+
+    m_lastCullStats.numMeshes = m_meshRanges.size();
+#endif
+
+    m_commands.reserve(m_meshRanges.size());
+    m_materialDrawCounts.resize(m_materials.size());
+    m_materialDrawOffsets.resize(m_materials.size());
+    m_materialWriteCursors.resize(m_materials.size());
+
+    //Swap with empty vectors to actually free the memory
+    std::vector<vertexUVNormalPacked>().swap(m_stagingVertices);
+    std::vector<uint>().swap(m_stagingIndices);
+    std::vector<MeshData>().swap(m_stagingMeshData);
+    std::vector<CullMeshData>().swap(m_stagingCullMeshData);
+}
+
+uint MultiDrawBatch::FindOrAddMaterial(const Material &material)
+{
+    for (uint i = 0; i < m_materials.size(); i++)
+    {
+        if (m_materials[i].GetSortID() == material.GetSortID())
+            return i;
+    }
+
+    m_materials.push_back(material);
+    return m_materials.size() - 1;
+}
+
+void MultiDrawBatch::Draw(Renderer &renderer, Shader &shader, std::span<const uint> visibleMeshes)
+{
+    ASSERT_LOG(m_finalized, "MultiDrawBatch must be finalized before it is drawn");
+
+    m_lastDraw = LastDraw::none;
+    if (visibleMeshes.empty())
+        return;
+
+    //Counting sort of the visible meshes by material, so that every material's commands are contiguous
+    std::fill(m_materialDrawCounts.begin(), m_materialDrawCounts.end(), 0);
+    for (uint meshIndex : visibleMeshes)
+        m_materialDrawCounts[m_meshRanges[meshIndex].materialIndex]++;
+
+    uint runningOffset = 0;
+    for (uint i = 0; i < m_materials.size(); i++)
+    {
+        m_materialDrawOffsets[i] = runningOffset;
+        m_materialWriteCursors[i] = runningOffset;
+        runningOffset += m_materialDrawCounts[i];
+    }
+
+    m_commands.resize(visibleMeshes.size());
+    for (uint meshIndex : visibleMeshes)
+    {
+        const MeshRange& range = m_meshRanges[meshIndex];
+
+        //baseInstance is the mesh index so that the shader can find the model matrix using gl_BaseInstance
+        m_commands[m_materialWriteCursors[range.materialIndex]++] = {
+            range.indexCount, 1, range.firstIndex, range.baseVertex, meshIndex
+        };
+    }
+
+    m_indirectBuffer.SetData(m_commands.data(), m_commands.size() * sizeof(DrawElementsIndirectCommand));
+    m_lastDraw = LastDraw::commands;
+    DrawCommands(renderer, shader);
+}
+
+void MultiDrawBatch::DrawCommands(Renderer &renderer, Shader &shader)
+{
+    m_meshDataBuffer.BindBase(meshDataBinding);
+
+    for (uint i = 0; i < m_materials.size(); i++)
+    {
+        if (m_materialDrawCounts[i] == 0)
+            continue;
+
+        Shader& variant = shader.GetVariant(shader.GetFeatures() | m_materials[i].GetShaderFeatures());
+        renderer.BindShader(variant);
+        m_materials[i].Bind(renderer, variant);
+        renderer.MultiDrawIndirect(
+            m_vao, m_ibo, m_indirectBuffer,
+            m_materialDrawOffsets[i] * sizeof(DrawElementsIndirectCommand), m_materialDrawCounts[i]
+        );
+    }
+
+    renderer.SetCullFace(false);
+}
+
+void MultiDrawBatch::DrawGPUCulled(Renderer &renderer, Shader &shader, Shader &cullShader, const HiZBuffer* hiZBuffer /* = nullptr */)
+{
+    ASSERT_LOG(m_finalized, "MultiDrawBatch must be finalized before it is drawn");
+
+    m_lastDraw = LastDraw::none;
+    if (IsEmpty())
+        return;
+
+    //The compute shader appends the commands of the visible meshes to their material's region, counting them as it goes
+    m_culledDrawCountBuffer.Clear();
+    m_cullMeshDataBuffer.BindBase(cullMeshDataBinding);
+    m_culledCommandBuffer.BindBase(GL_SHADER_STORAGE_BUFFER, culledCommandsBinding);
+    m_culledDrawCountBuffer.BindBase(GL_SHADER_STORAGE_BUFFER, culledDrawCountsBinding);
+
+#ifdef ENABLE_IMGUI
+    ReadCullStats();
+    m_cullStatsBuffer.Clear();
+    m_cullStatsBuffer.BindBase(cullStatsBinding);
+    cullShader.SetUniform("u_collectStats"_uniform, true);
+    uint barriers = GL_COMMAND_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT; //The copy of the stats reads what the cull wrote
+#else
+    cullShader.SetUniform("u_collectStats"_uniform, false);
+    uint barriers = GL_COMMAND_BARRIER_BIT;
+#endif
+
+    bool occlusionCulling = hiZBuffer != nullptr && hiZBuffer->IsValid();
+    cullShader.SetUniform("u_occlusionCulling"_uniform, occlusionCulling);
+    if (occlusionCulling)
+    {
+        hiZBuffer->Bind(renderer);
+        cullShader.SetUniform("u_hiZProjViewMatrix"_uniform, hiZBuffer->GetProjViewMatrix());
+    }
+
+    uint numGroups = (GetNumMeshes() + cullWorkGroupSize - 1) / cullWorkGroupSize;
+    renderer.DispatchCompute(cullShader, numGroups, 1, 1, barriers);
+    m_lastDraw = LastDraw::culledCommands;
+
+#ifdef ENABLE_IMGUI
+    CopyCullStats();
+#endif
+
+    DrawCulledCommands(renderer, shader);
+}
+
+#ifdef ENABLE_IMGUI
+void MultiDrawBatch::ReadCullStats()
+{
+    //The slot was written numCullStatsSlots culls ago, the GPU is almost always done with that by now
+    GLsync& fence = m_cullStatsFences[m_cullStatsSlot];
+    if (fence == nullptr)
+        return;
+
+    //If it is not done, the old stats are kept. The slot is overwritten anyway, as the copies are ordered on the GPU
+    GLenum status = glClientWaitSync(fence, 0, 0);
+    if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+    {
+        m_lastCullStats.numInFrustum = m_cullStatsMapping[m_cullStatsSlot * 2];
+        m_lastCullStats.numVisible = m_cullStatsMapping[m_cullStatsSlot * 2 + 1];
+    }
+
+    glDeleteSync(fence);
+    fence = nullptr;
+}
+
+void MultiDrawBatch::CopyCullStats()
+{
+    glCopyNamedBufferSubData(
+        m_cullStatsBuffer.GetRendererID(), m_cullStatsReadback.GetRendererID(),
+        0, m_cullStatsSlot * 2 * sizeof(uint), 2 * sizeof(uint)
+    );
+
+    m_cullStatsFences[m_cullStatsSlot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    m_cullStatsSlot = (m_cullStatsSlot + 1) % numCullStatsSlots;
+}
+#endif
+
+void MultiDrawBatch::DrawCulledCommands(Renderer &renderer, Shader &shader)
+{
+    m_meshDataBuffer.BindBase(meshDataBinding);
+
+    for (uint i = 0; i < m_materials.size(); i++)
+    {
+        Shader& variant = shader.GetVariant(shader.GetFeatures() | m_materials[i].GetShaderFeatures());
+        renderer.BindShader(variant);
+        m_materials[i].Bind(renderer, variant);
+        renderer.MultiDrawIndirectCount(
+            m_vao, m_ibo, m_culledCommandBuffer, m_materialCommandRegions[i] * sizeof(DrawElementsIndirectCommand),
+            m_culledDrawCountBuffer, i * sizeof(uint), m_materialMeshCounts[i]
+        );
+    }
+
+    renderer.SetCullFace(false);
+}
+
+void MultiDrawBatch::Redraw(Renderer &renderer, Shader &shader)
+{
+    if (m_lastDraw == LastDraw::commands)
+        DrawCommands(renderer, shader);
+    else if (m_lastDraw == LastDraw::culledCommands)
+        DrawCulledCommands(renderer, shader);
+}
@@ -0,0 +1,210 @@
+#ifndef MULTIDRAWBATCH_H
+#define MULTIDRAWBATCH_H
+
+#include "Util.h"
+
+#include "Buffer.h"
+#include "HiZBuffer.h"
+#include "Material.h"
+#include "Renderer.h"
+#include "Shader.h"
+#include "Texture.h"
+#include "VertexArray.h"
+
+#include <span>
+#include <vector>
+
+/*
+ * Packs all of the meshes of a model into one shared vertex and index buffer so that any subset of them can be drawn
+ * with glMultiDrawElementsIndirect. Meshes are grouped by their material's sort ID (the texture arrays they use and whether
+ * they are double sided), and each group is one multi draw call.
+ *
+ * The model matrix and texture layers of every mesh are stored in a shader storage buffer and are indexed with
+ * gl_BaseInstance, which is set to the index of the mesh, so the shader used to draw must be ModelVertex.glsl with the
+ * INSTANCING feature (or read the same buffer). Each material draws with the variant of that shader for its own features
+ * (see Material::GetShaderFeatures()).
+ *
+ * Draw() takes the visible meshes from the CPU. DrawGPUCulled() instead frustum culls every mesh in a compute shader
+ * (FrustumCullCompute.glsl) that writes the draw commands and their counts straight into the buffers that the draw reads,
+ * so nothing is read back and the CPU cost does not depend on the number of meshes. With a HiZBuffer it also culls the
+ * meshes that were hidden behind others in the last frame. Only the statistics for ImGui (see GetLastCullStats()) come
+ * back to the CPU, and only once the GPU is done with them.
+ *
+ * The indices stay relative to their mesh (baseVertex offsets them), so the shared index buffer can be 16 bit as long as
+ * every mesh has fewer than 65536 vertices, no matter how many vertices the batch has in total.
+ */
+class MultiDrawBatch
+{
+public:
+    //The layout of this struct is dictated by OpenGL, see glMultiDrawElementsIndirect
+    struct DrawElementsIndirectCommand
+    {
+        uint count;
+        uint instanceCount;
+        uint firstIndex;
+        int  baseVertex;
+        uint baseInstance;
+    };
+
+    //NOTE: DO NOT UPDATE without changing ModelVertex.glsl and ModelDepthVertex.glsl
+    struct MeshData
+    {
+        JPH::Mat44 modelMatrix;
+        NormalMatrix normalMatrix;
+        JPH::UVec4 textureLayers; //See Material::GetTextureLayers()
+    };
+
+    static_assert(sizeof(MeshData) == 128, "MeshData must match the std430 layout in ModelVertex.glsl");
+
+    static constexpr uint meshDataBinding = 0; //NOTE: DO NOT UPDATE without changing ModelVertex.glsl and ModelDepthVertex.glsl
+
+    //NOTE: DO NOT UPDATE without changing FrustumCullCompute.glsl
+    struct CullMeshData
+    {
+        JPH::Float3 boundsCenter; //World space
+        uint materialIndex;
+        JPH::Float3 boundsExtent;
+        uint commandRegion; //The index of the first command of this mesh's material in the culled command buffer
+        uint indexCount;
+        uint firstIndex;
+        int  baseVertex;
+        uint padding;
+    };
+
+    static_assert(sizeof(CullMeshData) == 48, "CullMeshData must match the std430 layout in FrustumCullCompute.glsl");
+
+    //NOTE: DO NOT UPDATE without changing FrustumCullCompute.glsl
+    static constexpr uint cullMeshDataBinding = 2;
+    static constexpr uint culledCommandsBinding = 3;
+    static constexpr uint culledDrawCountsBinding = 4;
+    static constexpr uint cullStatsBinding = 5;
+    static constexpr uint cullWorkGroupSize = 64;
+
+    //What DrawGPUCulled() culled, NOTE: DO NOT UPDATE the first 2 members without changing FrustumCullCompute.glsl
+    struct CullStats
+    {
+        uint numInFrustum = 0;
+        uint numVisible = 0; //In the frustum and not occluded, these are the meshes that were drawn
+        uint numMeshes = 0;
+    };
+
+private:
+    //Which commands Redraw() draws
+    enum class LastDraw : uint8
+    {
+        none,
+        commands, //m_indirectBuffer, from Draw()
+        culledCommands, //m_culledCommandBuffer, from DrawGPUCulled()
+    };
+
+    struct MeshRange
+    {
+        uint indexCount;
+        uint firstIndex;
+        int  baseVertex;
+        uint materialIndex;
+    };
+
+    std::vector<MeshRange> m_meshRanges;
+    std::vector<Material> m_materials; //One per sort ID, as materials with the same sort ID bind the same state
+
+    //Only used while meshes are being added, these are freed once Finalize() uploads them
+    std::vector<vertexUVNormalPacked> m_stagingVertices;
+    std::vector<uint> m_stagingIndices;
+    std::vector<MeshData> m_stagingMeshData;
+    std::vector<CullMeshData> m_stagingCullMeshData;
+
+    VertexArray m_vao;
+    VertexBuffer m_vbo;
+    IndexBuffer m_ibo;
+    Buffer m_meshDataBuffer;
+    Buffer m_indirectBuffer;
+
+    //For DrawGPUCulled(). The commands of every material get a region with room for all of the material's meshes
+    Buffer m_cullMeshDataBuffer;
+    Buffer m_culledCommandBuffer;
+    Buffer m_culledDrawCountBuffer; //One count per material, cleared before every cull
+    std::vector<uint> m_materialMeshCounts;
+    std::vector<uint> m_materialCommandRegions;
+
+    //These are rebuilt every frame, but are kept around so that we do not allocate every frame
+    std::vector<DrawElementsIndirectCommand> m_commands;
+    std::vector<uint> m_materialDrawCounts;
+    std::vector<uint> m_materialDrawOffsets;
+    std::vector<uint> m_materialWriteCursors;
+
+    LastDraw m_lastDraw = LastDraw::none;
+    bool m_finalized = false;
+
+#ifdef ENABLE_IMGUI
+    //The cull counts into m_cullStatsBuffer, which is then copied into the next slot of m_cullStatsReadback. A slot is
+    //only read once the fence of its copy has signalled, so the CPU never waits for the GPU
+    static constexpr uint numCullStatsSlots = StreamBuffer::numRegions;
+
+    Buffer m_cullStatsBuffer; //CullStats::numInFrustum and numVisible
+    Buffer m_cullStatsReadback; //Persistently mapped, 2 uints per slot
+    const uint* m_cullStatsMapping = nullptr;
+    GLsync m_cullStatsFences[numCullStatsSlots] = {};
+    uint m_cullStatsSlot = 0; //The slot that the next cull copies its counts into
+    CullStats m_lastCullStats;
+
+    void ReadCullStats();
+    void CopyCullStats();
+#endif
+
+    uint FindOrAddMaterial(const Material& material);
+
+    void DrawCommands(Renderer& renderer, Shader& shader);
+    void DrawCulledCommands(Renderer& renderer, Shader& shader);
+
+public:
+    MultiDrawBatch();
+    ~MultiDrawBatch();
+
+    MultiDrawBatch(const MultiDrawBatch&) = delete;
+    MultiDrawBatch& operator=(const MultiDrawBatch&) = delete;
+
+    /*
+     * Adds a mesh to the batch. Meshes are given indices in the order that they are added, and these indices are what
+     * Draw() expects. Must not be called after Finalize().
+     */
+    void AddMesh(
+        std::span<const vertexUVNormalPacked> vertices, std::span<const uint> indices,
+        const std::vector<const Texture*>& textures, bool doubleSided, const JPH::Mat44& modelMatrix
+    );
+
+    //Uploads all added meshes to the GPU and frees the CPU side copies
+    void Finalize();
+
+    bool IsEmpty() const { return m_meshRanges.empty(); }
+    uint GetNumMeshes() const { return m_meshRanges.size(); }
+
+    /*
+     * Draws the meshes whose indices are in visibleMeshes with the variants of shader for every material (shader's own
+     * features plus the material's). The frame uniforms (Renderer::SetFrameUniforms) should already be set.
+     */
+    void Draw(Renderer& renderer, Shader& shader, std::span<const uint> visibleMeshes);
+
+    /*
+     * Draws the meshes whose bounds are inside the view frustum of the current frame uniforms, culling them on the GPU
+     * with cullShader (FrustumCullCompute.glsl). The bounds are computed once when the mesh is added, like the model
+     * matrices. If hiZBuffer is valid, the meshes it shows to be hidden are culled too.
+     * Otherwise the same as Draw().
+     */
+    void DrawGPUCulled(Renderer& renderer, Shader& shader, Shader& cullShader, const HiZBuffer* hiZBuffer = nullptr);
+
+    /*
+     * Draws the same meshes as the last Draw() or DrawGPUCulled() again with another shader, without culling them again.
+     * This is how the lighting pass draws exactly what the depth pre-pass drew.
+     */
+    void Redraw(Renderer& renderer, Shader& shader);
+
+#ifdef ENABLE_IMGUI
+    //The statistics of a recent DrawGPUCulled(), they are a few frames late as they are only read once the GPU is done
+    const CullStats& GetLastCullStats() const { return m_lastCullStats; }
+#endif
+};
+
+
+
+#endif //MULTIDRAWBATCH_H
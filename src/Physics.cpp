@@ -1,4 +1,5 @@
 #include "Physics.h"
+#include <cstring>
 #include <unordered_set>
 
 #include "Constants.h"
@@ -15,7 +16,7 @@ Physics::Physics(Shader &shader, Renderer &renderer, const JPH::Mat44& projMatri
         std::clamp((int)std::thread::hardware_concurrency() / 2, 12, 12)
     ),*/
     m_jobSystem(std::pow(2, 20))
-    JPH_IF_DEBUG_RENDERER(,m_debugRenderer(shader, cameraPosition))
+    JPH_IF_DEBUG_RENDERER(,m_debugRenderer(shader, renderer, cameraPosition), m_drawFilter(cameraPosition))
 #ifdef  JPH_PROFILE_ENABLED
     ,m_profiler(JPH::Profiler::sInstance),
     m_profileThread("JPH Main Thread")
@@ -107,11 +108,12 @@ void Physics::Update(float deltaTime)
 void Physics::DrawDebugPhysics()
 {
 #ifdef JPH_DEBUG_RENDERER
-    m_shader.Bind();
-    m_shader.SetUniform("u_MVP", m_projMatrix * m_viewMatrix);
+    JPH::Mat44 viewProjMatrix = m_projMatrix * m_viewMatrix;
+    m_renderer.BindShader(m_shader);
+    m_drawFilter.SetFrustum(viewProjMatrix);
 
-    m_debugRenderer.StartFrame();
-    m_physicsSystem.DrawBodies(m_drawSettings, &m_debugRenderer);
+    m_debugRenderer.StartFrame(viewProjMatrix);
+    m_physicsSystem.DrawBodies(m_drawSettings, &m_debugRenderer, &m_drawFilter);
     m_debugRenderer.EndFrame();
 #endif
 }
@@ -218,73 +220,98 @@ JPH::RVec3 Physics::CharacterHandler::GetPosition()
 }
 
 #ifdef JPH_DEBUG_RENDERER
-Physics::DebugRendererImpl::DebugRendererImpl(Shader &shader, const JPH::Vec3& cameraPosition)
+Physics::DebugRendererImpl::DebugRendererImpl(Shader &shader, Renderer &renderer, const JPH::Vec3& cameraPosition)
 :	m_shader(shader),
-    m_cameraPosition(cameraPosition)
+    m_renderer(renderer),
+    m_cameraPosition(cameraPosition),
+    m_viewProjMatrix(JPH::Mat44::sIdentity())
 {
+    Initialize(); //Creates the batches of the shapes that Jolt draws with DrawGeometry(), such as spheres and boxes
     InitBuffers();
     m_lineVertices.reserve(1'000);
     m_triangleVertices.reserve(10'000);
 }
 
 
+Physics::DebugRendererImpl::~DebugRendererImpl()
+{
+    glDeleteVertexArrays(1, &m_vao);
+    glDeleteVertexArrays(1, &m_batchVao);
+}
+
+
 void Physics::DebugRendererImpl::InitBuffers()
 {
-    glGenVertexArrays(1, &lineVAO);
-    glGenBuffers(1, &lineVBO);
-    glBindVertexArray(lineVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, lineVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 7, nullptr, GL_DYNAMIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 7 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 7 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-
-    glGenVertexArrays(1, &triangleVAO);
-    glGenBuffers(1, &triangleVBO);
-    glBindVertexArray(triangleVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, triangleVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 21, nullptr, GL_DYNAMIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 7 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 7 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-    glBindVertexArray(0);
+    //Lines and triangles have the same vertex format, only the buffer offset is different (and set when drawing)
+    glCreateVertexArrays(1, &m_vao);
+
+    glEnableVertexArrayAttrib(m_vao, 0);
+    glVertexArrayAttribFormat(m_vao, 0, 3, GL_FLOAT, GL_FALSE, 0);
+    glVertexArrayAttribBinding(m_vao, 0, 0);
+
+    glEnableVertexArrayAttrib(m_vao, 1);
+    glVertexArrayAttribFormat(m_vao, 1, 4, GL_FLOAT, GL_FALSE, 3 * sizeof(float));
+    glVertexArrayAttribBinding(m_vao, 1, 0);
+
+    //Only the position and the color of the batch vertices are used, the color is normalized from 8 bits per channel
+    glCreateVertexArrays(1, &m_batchVao);
+
+    glEnableVertexArrayAttrib(m_batchVao, 0);
+    glVertexArrayAttribFormat(m_batchVao, 0, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, mPosition));
+    glVertexArrayAttribBinding(m_batchVao, 0, 0);
+
+    glEnableVertexArrayAttrib(m_batchVao, 1);
+    glVertexArrayAttribFormat(m_batchVao, 1, 4, GL_UNSIGNED_BYTE, GL_TRUE, offsetof(Vertex, mColor));
+    glVertexArrayAttribBinding(m_batchVao, 1, 0);
 }
 
 
-void Physics::DebugRendererImpl::StartFrame()
+void Physics::DebugRendererImpl::StartFrame(const JPH::Mat44& viewProjMatrix)
 {
-    SetCameraPos({m_cameraPosition[0], m_cameraPosition[1], m_cameraPosition[2]}); //to enable LOD
+    m_viewProjMatrix = viewProjMatrix;
 }
 
 
 void Physics::DebugRendererImpl::EndFrame()
 {
-    if (!m_lineVertices.empty())
-    {
-        glBindVertexArray(lineVAO);
-        glBindBuffer(GL_ARRAY_BUFFER, lineVBO);
-        glBufferData(
-            GL_ARRAY_BUFFER, sizeof(float) * m_lineVertices.size(),
-            m_lineVertices.data(), GL_STATIC_DRAW
-        );
-        glDrawArrays(GL_LINES, 0, m_lineVertices.size() / 7);
-        m_lineVertices.clear();
-    }
+    //The streamed vertices are already in world space
+    m_shader.SetUniform("u_MVP"_uniform, m_viewProjMatrix);
+    m_shader.SetUniform("u_color"_uniform, JPH::Vec4::sReplicate(1.0f));
+    m_renderer.SetCullFace(false);
+
+    DrawVertices(m_lineVertices, GL_LINES);
+    DrawVertices(m_triangleVertices, GL_TRIANGLES);
+}
+
+
+void Physics::DebugRendererImpl::DrawVertices(std::vector<float>& vertices, uint mode)
+{
+    if (vertices.empty())
+        return;
 
-    if (!m_triangleVertices.empty())
+    uint size = vertices.size() * sizeof(float);
+    StreamBuffer& streamBuffer = m_renderer.GetStreamBuffer();
+    StreamBuffer::Allocation allocation = streamBuffer.Allocate(size);
+
+    if (allocation.data == nullptr)
     {
-        glBindVertexArray(triangleVAO);
-        glBindBuffer(GL_ARRAY_BUFFER, triangleVBO);
-        glBufferData(
-            GL_ARRAY_BUFFER, sizeof(float) * m_triangleVertices.size(),
-            m_triangleVertices.data(), GL_STATIC_DRAW
-        );
-
-        glDrawArrays(GL_TRIANGLES, 0, m_triangleVertices.size() / 7);
-        m_triangleVertices.clear();
+        static bool warned = false;
+        if (!warned)
+            std::cout << "[WARNING, Physics.cpp, DrawVertices] " << size << " bytes of debug geometry do not fit in the stream buffer, "
+                "increase Renderer::streamBufferRegionSize" << std::endl;
+
+        warned = true;
+        vertices.clear();
+        return;
     }
+
+    //The mapping is coherent, so the copy is visible to the draw without any flush
+    std::memcpy(allocation.data, vertices.data(), size);
+    glVertexArrayVertexBuffer(m_vao, 0, streamBuffer.GetRendererID(), allocation.offset, floatsPerVertex * sizeof(float));
+
+    m_renderer.BindVertexArray(m_vao);
+    glDrawArrays(mode, 0, vertices.size() / floatsPerVertex);
+    vertices.clear();
 }
 
 
@@ -305,7 +332,7 @@ void Physics::DebugRendererImpl::DrawLine(JPH::RVec3Arg inFrom, JPH::RVec3Arg in
 
 void Physics::DebugRendererImpl::DrawTriangle(
     JPH::RVec3Arg inV1, JPH::RVec3Arg inV2,
-    JPH::RVec3Arg inV3, JPH::ColorArg inColor, ECastShadow inCastShadow
+    JPH::RVec3Arg inV3, JPH::ColorArg inColor, ECastShadow /*inCastShadow*/
 )
 {
     JPH::Vec4 color = inColor.ToVec4();
@@ -322,4 +349,97 @@ void Physics::DebugRendererImpl::DrawTriangle(
         color[0], color[1], color[2], color[3],
     });
 }
+
+
+JPH::DebugRenderer::Batch Physics::DebugRendererImpl::CreateTriangleBatch(const Triangle* inTriangles, int inTriangleCount)
+{
+    //The vertices of the triangles are next to each other, so they can be drawn as a vertex array
+    static_assert(sizeof(Triangle) == 3 * sizeof(Vertex));
+    const Vertex* vertices = inTriangles != nullptr ? inTriangles->mV : nullptr;
+
+    return new BatchImpl(vertices, 3 * inTriangleCount, nullptr, 0);
+}
+
+
+JPH::DebugRenderer::Batch Physics::DebugRendererImpl::CreateTriangleBatch(
+    const Vertex* inVertices, int inVertexCount, const JPH::uint32* inIndices, int inIndexCount
+)
+{
+    return new BatchImpl(inVertices, inVertexCount, inIndices, inIndexCount);
+}
+
+
+void Physics::DebugRendererImpl::DrawGeometry(
+    JPH::RMat44Arg inModelMatrix, const JPH::AABox& inWorldSpaceBounds, float inLODScaleSq, JPH::ColorArg inModelColor,
+    const GeometryRef& inGeometry, ECullMode inCullMode, ECastShadow /*inCastShadow*/, EDrawMode inDrawMode
+)
+{
+    const LOD& lod = inGeometry->GetLOD(m_cameraPosition, inWorldSpaceBounds, inLODScaleSq);
+    const BatchImpl* batch = static_cast<const BatchImpl*>(lod.mTriangleBatch.GetPtr());
+    if (batch->count == 0)
+        return;
+
+    m_shader.SetUniform("u_MVP"_uniform, m_viewProjMatrix * inModelMatrix);
+    m_shader.SetUniform("u_color"_uniform, inModelColor.ToVec4());
+
+    m_renderer.SetCullFace(inCullMode != ECullMode::Off);
+    if (inCullMode == ECullMode::CullFrontFace)
+        glCullFace(GL_FRONT);
+    if (inDrawMode == EDrawMode::Wireframe)
+        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+
+    glVertexArrayVertexBuffer(m_batchVao, 0, batch->vertexBuffer, 0, sizeof(Vertex));
+    glVertexArrayElementBuffer(m_batchVao, batch->indexBuffer);
+    m_renderer.BindVertexArray(m_batchVao);
+
+    if (batch->indexBuffer != 0)
+        glDrawElements(GL_TRIANGLES, batch->count, GL_UNSIGNED_INT, nullptr);
+    else
+        glDrawArrays(GL_TRIANGLES, 0, batch->count);
+
+    //Back to the state that everything else expects (see Application::InitOpenGL())
+    if (inCullMode == ECullMode::CullFrontFace)
+        glCullFace(GL_BACK);
+    if (inDrawMode == EDrawMode::Wireframe)
+        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+}
+
+
+Physics::DebugRendererImpl::BatchImpl::BatchImpl(const Vertex* vertices, int numVertices, const uint32* indices, int numIndices)
+{
+    //Jolt can create empty batches, and buffers cannot have a size of 0
+    if (numVertices == 0)
+        return;
+
+    glCreateBuffers(1, &vertexBuffer);
+    glNamedBufferStorage(vertexBuffer, numVertices * sizeof(Vertex), vertices, 0);
+    count = numVertices;
+
+    if (numIndices == 0)
+        return;
+
+    glCreateBuffers(1, &indexBuffer);
+    glNamedBufferStorage(indexBuffer, numIndices * sizeof(uint32), indices, 0);
+    count = numIndices;
+}
+
+
+Physics::DebugRendererImpl::BatchImpl::~BatchImpl()
+{
+    //Deleting 0 is ignored
+    glDeleteBuffers(1, &vertexBuffer);
+    glDeleteBuffers(1, &indexBuffer);
+}
+
+
+bool Physics::DrawFilterImpl::ShouldDraw(const JPH::Body& inBody) const
+{
+    JPH::AABox bounds = inBody.GetWorldSpaceBounds();
+
+    float maxDistance = Util::options.debugPhysicsDrawDistance;
+    if (maxDistance > 0.0f && bounds.GetSqDistanceTo(m_cameraPosition) > maxDistance * maxDistance)
+        return false;
+
+    return m_frustumCuller.IsAABBVisible(bounds);
+}
 #endif
@@ -25,7 +25,12 @@
 #include <Jolt/Physics/Body/BodyActivationListener.h>
 
 #ifdef JPH_DEBUG_RENDERER
-	#include <Jolt/Renderer/DebugRendererSimple.h>
+	#include <Jolt/Renderer/DebugRenderer.h>
+	#include <Jolt/Physics/Body/BodyFilter.h>
+
+	#include "FrustumCulling.h"
+
+	#include <atomic>
 #endif
 
 #include "Core/JobSystemSingleThreaded.h"
@@ -37,35 +42,88 @@ class Physics
 private:
 
 #ifdef JPH_DEBUG_RENDERER
-	class DebugRendererImpl : public JPH::DebugRendererSimple
+	/*
+	 * The geometry of the shapes is uploaded once, when Jolt creates a triangle batch for it, and every body is then drawn
+	 * from its batch with its own transform (see DrawGeometry()). Only the lines and the few loose triangles are copied
+	 * into the stream buffer every frame.
+	 */
+	class DebugRendererImpl : public JPH::DebugRenderer
 	{
 	private:
+		//The vertices and indices of a triangle batch in GPU buffers, freed when Jolt releases the last reference to it
+		class BatchImpl : public JPH::RefTargetVirtual
+		{
+		private:
+			std::atomic<uint32> m_refCount = 0;
+
+		public:
+			uint vertexBuffer = 0;
+			uint indexBuffer = 0; //0 if the batch was made from triangles, which are drawn without indices
+			uint count = 0; //The number of indices, or of vertices if there are no indices
+
+			BatchImpl(const Vertex* vertices, int numVertices, const uint32* indices, int numIndices);
+			~BatchImpl();
+
+			virtual void AddRef() override { m_refCount++; }
+			virtual void Release() override { if (--m_refCount == 0) delete this; }
+		};
+
 		Shader &m_shader;
+		Renderer &m_renderer;
+
+		static constexpr uint floatsPerVertex = 7; //Position and color
 
 		std::vector<float> m_lineVertices;
 		std::vector<float> m_triangleVertices;
 
-		uint lineVAO, lineVBO;
-		uint triangleVAO, triangleVBO;
+		uint m_vao; //The vertices are copied into the renderer's stream buffer every frame, see DrawVertices()
+		uint m_batchVao; //In the format of JPH::DebugRenderer::Vertex, the buffers of a batch are attached when it is drawn
 
 		const JPH::Vec3& m_cameraPosition;
+		JPH::Mat44 m_viewProjMatrix;
 
 		void InitBuffers();
+		void DrawVertices(std::vector<float>& vertices, uint mode);
 
 	public:
-		DebugRendererImpl(Shader &shader, const JPH::Vec3& cameraPosition);
+		DebugRendererImpl(Shader &shader, Renderer &renderer, const JPH::Vec3& cameraPosition);
+		~DebugRendererImpl();
 
-		void StartFrame();
+		//The shader has to be bound until EndFrame()
+		void StartFrame(const JPH::Mat44& viewProjMatrix);
 		void EndFrame();
 
 		virtual void DrawLine(JPH::RVec3Arg inFrom, JPH::RVec3Arg inTo, JPH::ColorArg inColor) override;
 		virtual void DrawTriangle(JPH::RVec3Arg inV1, JPH::RVec3Arg inV2, JPH::RVec3Arg inV3, JPH::ColorArg inColor, ECastShadow inCastShadow) override;
 
+		virtual Batch CreateTriangleBatch(const Triangle* inTriangles, int inTriangleCount) override;
+		virtual Batch CreateTriangleBatch(const Vertex* inVertices, int inVertexCount, const JPH::uint32* inIndices, int inIndexCount) override;
+
+		virtual void DrawGeometry(
+			JPH::RMat44Arg inModelMatrix, const JPH::AABox& inWorldSpaceBounds, float inLODScaleSq, JPH::ColorArg inModelColor,
+			const GeometryRef& inGeometry, ECullMode inCullMode, ECastShadow inCastShadow, EDrawMode inDrawMode
+		) override;
+
 		virtual void DrawText3D(JPH::RVec3Arg inPosition, const std::string_view &inString, JPH::ColorArg inColor, float inHeight) override
 		{
 			// Not implemented
 		}
 	};
+
+	//Skips the bodies outside of the camera frustum, and the ones further away than Util::options.debugPhysicsDrawDistance
+	class DrawFilterImpl : public JPH::BodyDrawFilter
+	{
+	private:
+		FrustumCuller m_frustumCuller;
+		const JPH::Vec3& m_cameraPosition;
+
+	public:
+		explicit DrawFilterImpl(const JPH::Vec3& cameraPosition) : m_cameraPosition(cameraPosition) {}
+
+		void SetFrustum(const JPH::Mat44& viewProjMatrix) { m_frustumCuller.SetFrustumPlanes(viewProjMatrix); }
+
+		virtual bool ShouldDraw(const JPH::Body& inBody) const override;
+	};
 #endif
 
 
@@ -105,6 +163,7 @@ private:
 
 #ifdef JPH_DEBUG_RENDERER
 	DebugRendererImpl m_debugRenderer;
+	DrawFilterImpl m_drawFilter;
 	JPH::BodyManager::DrawSettings m_drawSettings;
 #endif
 
@@ -151,6 +210,7 @@ public:
 
 	CharacterHandler* GetCharacterHandler() { return &m_characterHandler; }
 	const JPH::BodyLockInterfaceLocking& GetBodyManager() { return m_physicsSystem.GetBodyLockInterface(); }
+	const JPH::BroadPhaseQuery& GetBroadPhaseQuery() const { return m_physicsSystem.GetBroadPhaseQuery(); }
 
 	JPH::Vec3 GetPosition(JPH::BodyID id) const { return m_bodyInterface->GetPosition(id); }
 	JPH::Quat GetRotation(JPH::BodyID id) const { return m_bodyInterface->GetRotation(id); }
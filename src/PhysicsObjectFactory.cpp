@@ -35,7 +35,7 @@ PhysicsObjectFactory::Object PhysicsObjectFactory::ConstructSphere(const ObjectI
 
 PhysicsObjectFactory::Object PhysicsObjectFactory::ConstructStaticMesh(
     float mass, Physics &physics,
-    const std::vector<JPH::Vec3> &positions, const std::vector<uint> &indices, const JPH::Mat44& verticesTransformation
+    const std::vector<JPH::Vec3> &positions, std::span<const uint> indices, const JPH::Mat44& verticesTransformation
 )
 {
     //This is going to be a 2 step process. We first want to make the data un-indexed and get all true vertices
@@ -89,7 +89,7 @@ PhysicsObjectFactory::Object PhysicsObjectFactory::ConstructStaticMesh(
 }
 
 PhysicsObjectFactory::Object PhysicsObjectFactory::ConstructDynamicMesh(float mass, Physics &physics,
-    const std::vector<JPH::Vec3> &positions, const std::vector<uint> &indices, const JPH::Mat44 &verticesTransformation)
+    const std::vector<JPH::Vec3> &positions, std::span<const uint> indices, const JPH::Mat44 &verticesTransformation)
 {
     //This is going to be a 2 step process. We first want to make the data un-indexed and get all true vertices
     //Then we want to apply transformations to all of these vertices
@@ -50,13 +50,13 @@ public:
      */
     static Object ConstructStaticMesh(
         float mass, Physics& physics,
-        const std::vector<JPH::Vec3> &positions, const std::vector<uint>& indices,
+        const std::vector<JPH::Vec3> &positions, std::span<const uint> indices,
         const JPH::Mat44& verticesTransformation
     );
 
     static Object ConstructDynamicMesh(
         float mass, Physics& physics,
-        const std::vector<JPH::Vec3> &positions, const std::vector<uint>& indices,
+        const std::vector<JPH::Vec3> &positions, std::span<const uint> indices,
         const JPH::Mat44& verticesTransformation
     );
 };
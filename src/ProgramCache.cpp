@@ -0,0 +1,163 @@
+#include "ProgramCache.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+namespace
+{
+	struct FileHeader
+	{
+		uint32 magic;
+		uint32 version;
+		uint64 key;
+		uint32 binaryFormat;
+		uint32 binarySize;
+	};
+
+	//FNV-1a, the same as HashUniformName() but 64 bit, as there can be a lot more entries than uniforms in a shader
+	uint64 HashBytes(uint64 hash, std::string_view bytes)
+	{
+		for (char c : bytes)
+		{
+			hash ^= static_cast<uint8>(c);
+			hash *= 1099511628211ull;
+		}
+
+		return hash;
+	}
+
+	std::string_view GetGLString(uint name)
+	{
+		const char* string = reinterpret_cast<const char*>(glGetString(name));
+		return string != nullptr ? string : "";
+	}
+
+	uint numProgramIndices = 0;
+	std::vector<uint> freeProgramIndices;
+}
+
+/*static*/ bool ProgramCache::IsSupported()
+{
+	static const bool supported = []()
+	{
+		int numFormats = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+		return numFormats > 0;
+	}();
+
+	return supported;
+}
+
+/*static*/ uint64 ProgramCache::ComputeKey(std::span<const std::string_view> sources)
+{
+	uint64 hash = 14695981039346656037ull;
+
+	//A NUL between the strings, so that moving text from the end of one to the start of the next changes the key
+	for (uint name : {GL_VENDOR, GL_RENDERER, GL_VERSION})
+		hash = HashBytes(HashBytes(hash, GetGLString(name)), std::string_view("", 1));
+
+	for (std::string_view source : sources)
+		hash = HashBytes(HashBytes(hash, source), std::string_view("", 1));
+
+	return hash;
+}
+
+/*static*/ bool ProgramCache::Load(uint64 key, uint programID)
+{
+	if (!IsSupported())
+		return false;
+
+	std::string path = GetCachePath(key);
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+
+	FileHeader header{};
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+	std::vector<uint8> binary;
+	bool valid = file && header.magic == magic && header.version == version && header.key == key;
+	if (valid)
+	{
+		binary.resize(header.binarySize);
+		file.read(reinterpret_cast<char*>(binary.data()), static_cast<std::streamsize>(binary.size()));
+		valid = static_cast<bool>(file);
+	}
+
+	int linked = GL_FALSE;
+	if (valid)
+	{
+		glProgramBinary(programID, header.binaryFormat, binary.data(), static_cast<int>(binary.size()));
+		glGetProgramiv(programID, GL_LINK_STATUS, &linked);
+	}
+
+	if (linked == GL_FALSE)
+	{
+		//Stale (usually a driver update that the version string did not show), so it is rebuilt from source
+		file.close();
+		std::error_code error;
+		std::filesystem::remove(path, error);
+		return false;
+	}
+
+	return true;
+}
+
+/*static*/ bool ProgramCache::Store(uint64 key, uint programID)
+{
+	if (!IsSupported())
+		return false;
+
+	int binarySize = 0;
+	glGetProgramiv(programID, GL_PROGRAM_BINARY_LENGTH, &binarySize);
+	if (binarySize <= 0)
+		return false;
+
+	FileHeader header{magic, version, key, 0, 0};
+	std::vector<uint8> data(sizeof(FileHeader) + binarySize);
+
+	int writtenSize = 0;
+	uint binaryFormat = 0;
+	glGetProgramBinary(programID, binarySize, &writtenSize, &binaryFormat, data.data() + sizeof(FileHeader));
+
+	header.binaryFormat = binaryFormat;
+	header.binarySize = static_cast<uint32>(writtenSize);
+	std::memcpy(data.data(), &header, sizeof(header));
+	data.resize(sizeof(FileHeader) + writtenSize);
+
+	std::error_code error;
+	std::filesystem::create_directories(cacheDirectory, error);
+
+	if (error || !Util::WriteFileAtomic(GetCachePath(key), data))
+	{
+		std::cout << "[WARNING, ProgramCache.cpp, Store] Unable to write program cache \"" << GetCachePath(key) << "\"" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+/*static*/ std::string ProgramCache::GetCachePath(uint64 key)
+{
+	std::ostringstream path;
+	path << cacheDirectory << std::hex << key << ".programcache";
+	return path.str();
+}
+
+/*static*/ uint ProgramCache::AcquireProgramIndex()
+{
+	if (freeProgramIndices.empty())
+		return numProgramIndices++;
+
+	uint index = freeProgramIndices.back();
+	freeProgramIndices.pop_back();
+	return index;
+}
+
+/*static*/ void ProgramCache::ReleaseProgramIndex(uint index)
+{
+	freeProgramIndices.push_back(index);
+}
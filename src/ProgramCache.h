@@ -0,0 +1,50 @@
+#ifndef PROGRAMCACHE_H
+#define PROGRAMCACHE_H
+
+#include "Util.h"
+
+#include <span>
+#include <string>
+#include <string_view>
+
+/*
+ * Linked programs saved with glGetProgramBinary, so that later runs can load them with glProgramBinary instead of
+ * compiling and linking the GLSL again.
+ *
+ * An entry is keyed by a hash of the source of every stage (after the feature #defines are injected, see Shader) and of
+ * the vendor, renderer and version strings of the driver, so editing a shader or updating the driver uses a new entry.
+ * Drivers can still reject a binary (it is only guaranteed to work with the exact driver that made it), in which case
+ * Load() deletes the entry and the program is compiled from source as usual.
+ *
+ * Entries of old versions of a shader are not cleaned up, deleting the cache directory is always safe.
+ */
+class ProgramCache
+{
+public:
+	static constexpr uint32 magic = 0x47525050; //"PPRG"
+	static constexpr uint32 version = 1; //NOTE: Increment when the file layout changes
+
+	static constexpr const char* cacheDirectory = "../resources/shaders/cache/";
+
+	//Some drivers support the functions but no formats, then nothing is cached
+	static bool IsSupported();
+
+	static uint64 ComputeKey(std::span<const std::string_view> sources);
+
+	//Loads the binary into programID, returns false (and leaves programID unlinked) if there is no valid entry for key
+	static bool Load(uint64 key, uint programID);
+
+	//programID must have been linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set
+	static bool Store(uint64 key, uint programID);
+
+	static std::string GetCachePath(uint64 key);
+
+	//A dense index for every live program, for keys that have fewer bits than a GL name (such as the sort keys of
+	//RenderQueue). The indices of released programs are handed out again. Only called from the thread with the context
+	static uint AcquireProgramIndex();
+	static void ReleaseProgramIndex(uint index);
+};
+
+
+
+#endif //PROGRAMCACHE_H
@@ -32,18 +32,16 @@ void Quads2D::Init(float originalX, float originalY, float originalZ, float widt
 
 void Quads2D::Draw(Shader &shader, Renderer &renderer, const JPH::Mat44& projectionMatrix)
 {
-	shader.Bind();
+	renderer.BindShader(shader);
 
-	shader.SetUniform("u_MVP", projectionMatrix);
-	shader.SetUniform("u_modelMatrix", JPH::Mat44::sIdentity());
-	renderer.Draw(m_va, m_ib);
+	uint drawID = renderer.PushObjectUniforms(JPH::Mat44::sIdentity(), projectionMatrix);
+	renderer.Draw(m_va, m_ib, drawID);
 }
 
 void Quads2D::Draw(Shader &shader, Renderer &renderer, const JPH::Mat44 &projectionMatrix, const JPH::Mat44 &modelMatrix)
 {
-	shader.Bind();
+	renderer.BindShader(shader);
 
-	shader.SetUniform("u_MVP", projectionMatrix * modelMatrix);
-	shader.SetUniform("u_modelMatrix", modelMatrix);
-	renderer.Draw(m_va, m_ib);
+	uint drawID = renderer.PushObjectUniforms(modelMatrix, projectionMatrix * modelMatrix);
+	renderer.Draw(m_va, m_ib, drawID);
 }
@@ -5,7 +5,8 @@ Quads3D::Quads3D(float originalX, float originalY, float originalZ, float width,
 		m_height(height),
 		m_depth(depth),
 		m_numQuads(numQuads),
-		m_modelMatrices(modelMatrices)
+		m_modelMatrices(modelMatrices),
+		m_instanceBuffer(GL_SHADER_STORAGE_BUFFER)
 {
 	if (numQuads != modelMatrices.size())
 	{
@@ -78,12 +79,69 @@ Quads3D::Quads3D(float originalX, float originalY, float originalZ, float width,
 void Quads3D::Draw(Shader &shader, Renderer &renderer, const JPH::Mat44& projectionMatrix, const JPH::Mat44& viewMatrix)
 {
 	JPH::Mat44 projViewMatrix = projectionMatrix * viewMatrix;
-	shader.Bind();
+	renderer.SetFrameUniforms(viewMatrix, projectionMatrix);
+	renderer.BindShader(shader);
 
 	for (const auto& i : m_modelMatrices)
 	{
-		shader.SetUniform("u_MVP", projViewMatrix * i);
-		shader.SetUniform("u_modelMatrix", i);
-		renderer.Draw(m_va, m_ib);
+		uint drawID = renderer.PushObjectUniforms(i, projViewMatrix * i);
+		renderer.Draw(m_va, m_ib, drawID);
 	}
 }
+
+void Quads3D::DrawInstanced(Shader &shader, Renderer &renderer, const JPH::Mat44& projectionMatrix, const JPH::Mat44& viewMatrix)
+{
+	renderer.SetFrameUniforms(viewMatrix, projectionMatrix);
+	renderer.BindShader(shader);
+
+	UpdateInstanceBuffer();
+
+	if (m_instanceData.empty())
+		return;
+
+	m_instanceBuffer.BindBase(MultiDrawBatch::meshDataBinding);
+	renderer.DrawInstanced(m_va, m_ib, m_instanceData.size());
+}
+
+void Quads3D::UpdateInstanceBuffer()
+{
+	//Nothing to draw, and the buffer might never have been created
+	if (m_modelMatrices.empty())
+	{
+		m_instanceData.clear();
+		return;
+	}
+
+	if (m_instanceData.size() != m_modelMatrices.size())
+	{
+		m_instanceData.resize(m_modelMatrices.size());
+		for (uint i = 0; i < m_modelMatrices.size(); i++)
+			m_instanceData[i] = {m_modelMatrices[i], NormalMatrix(m_modelMatrices[i]), JPH::UVec4::sZero()};
+
+		m_instanceBuffer.Init(m_instanceData.data(), m_instanceData.size() * sizeof(MultiDrawBatch::MeshData), GL_DYNAMIC_DRAW);
+		return;
+	}
+
+	//Only the range between the first and last changed matrix is uploaded, which is usually nothing at all
+	uint firstChanged = m_modelMatrices.size();
+	uint lastChanged = 0;
+
+	for (uint i = 0; i < m_modelMatrices.size(); i++)
+	{
+		if (m_instanceData[i].modelMatrix == m_modelMatrices[i])
+			continue;
+
+		m_instanceData[i].modelMatrix = m_modelMatrices[i];
+		m_instanceData[i].normalMatrix = NormalMatrix(m_modelMatrices[i]);
+		firstChanged = std::min(firstChanged, i);
+		lastChanged = i;
+	}
+
+	if (firstChanged > lastChanged)
+		return;
+
+	m_instanceBuffer.ChangeData(
+		&m_instanceData[firstChanged], (lastChanged - firstChanged + 1) * sizeof(MultiDrawBatch::MeshData),
+		firstChanged * sizeof(MultiDrawBatch::MeshData)
+	);
+}
@@ -6,7 +6,9 @@
 
 #include <vector>
 
+#include "Buffer.h"
 #include "IndexBuffer.h"
+#include "MultiDrawBatch.h"
 #include "Renderer.h"
 #include "Shader.h"
 #include "../VertexArray.h"
@@ -21,9 +23,22 @@ public:
 	Quads3D(float originalX, float originalY, float originalZ, float width, float height, float depth, int numQuads, std::vector<JPH::Mat44>& modelMatrices);
 	void Draw(Shader &shader, Renderer &renderer, const JPH::Mat44& projectionMatrix, const JPH::Mat44& viewMatrix);
 
+	/*
+	 * Draws every cube with one instanced draw call. The model matrices are kept in an instance buffer that is only
+	 * written to when the matrices change (and then only the range that changed).
+	 * The shader must have the INSTANCING feature (or read the same buffer), as the instances are MultiDrawBatch::MeshData.
+	 */
+	void DrawInstanced(Shader &shader, Renderer &renderer, const JPH::Mat44& projectionMatrix, const JPH::Mat44& viewMatrix);
+
 private:
 	std::vector<JPH::Mat44> &m_modelMatrices;
 
+	//A copy of what is in m_instanceBuffer, to find which matrices changed since the last upload
+	std::vector<MultiDrawBatch::MeshData> m_instanceData;
+	Buffer m_instanceBuffer;
+
+	void UpdateInstanceBuffer();
+
 	VertexArray m_va;
 	VertexBufferLayout m_layout;
 
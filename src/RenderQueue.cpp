@@ -0,0 +1,105 @@
+#include "RenderQueue.h"
+
+#include "Material.h"
+#include "Renderer.h"
+
+#include <array>
+#include <bit>
+
+/*static*/ uint64 RenderQueue::MakeKey(RenderPass pass, const Shader& shader, const Material& material, float viewDepth)
+{
+	//Positive floats sort the same way as their bit patterns, so the top 24 bits are a quantized depth
+	//that does not need to know the near and far planes
+	if (!(viewDepth > 0.f))
+		viewDepth = 0.f; //Also catches NaN
+
+	uint64 depthBits = std::bit_cast<uint32>(viewDepth) >> 8;
+
+	ASSERT_LOG(
+		shader.GetProgramIndex() < maxShaders,
+		"Program index " << shader.GetProgramIndex() << " does not fit in the shader bits of the sort key"
+	);
+
+	uint64 key = 0;
+	key |= (static_cast<uint64>(pass) & 0x3) << 62;
+	key |= (static_cast<uint64>(shader.GetProgramIndex()) & 0xFF) << 54;
+	key |= (static_cast<uint64>(material.GetSortID()) & 0x3FFFFFFF) << 24;
+	key |= depthBits & 0xFFFFFF;
+
+	return key;
+}
+
+void RenderQueue::Push(
+	RenderPass pass, Shader& shader, const Material& material,
+	const VertexArray& va, const IndexBuffer& ib, uint firstIndex, uint indexCount, uint drawID, float viewDepth)
+{
+	//Resolved here so that the sort key groups draws by the program that actually draws them
+	Shader& variant = shader.GetVariant(shader.GetFeatures() | material.GetShaderFeatures());
+
+	m_entries.push_back({MakeKey(pass, variant, material, viewDepth), static_cast<uint32>(m_packets.size())});
+	m_packets.push_back({&variant, &material, &va, &ib, firstIndex, indexCount, drawID});
+}
+
+void RenderQueue::RadixSort()
+{
+	m_scratch.resize(m_entries.size());
+
+	for (uint shift = 0; shift < 64; shift += 8)
+	{
+		std::array<uint32, 256> counts{};
+		for (const SortEntry& entry : m_entries)
+			counts[(entry.key >> shift) & 0xFF]++;
+
+		//Every key has the same byte here (common for the pass and shader bytes), so this pass would not change anything
+		if (counts[(m_entries[0].key >> shift) & 0xFF] == m_entries.size())
+			continue;
+
+		uint32 offset = 0;
+		for (uint32& count : counts)
+		{
+			uint32 bucketSize = count;
+			count = offset;
+			offset += bucketSize;
+		}
+
+		for (const SortEntry& entry : m_entries)
+			m_scratch[counts[(entry.key >> shift) & 0xFF]++] = entry;
+
+		m_entries.swap(m_scratch);
+	}
+}
+
+void RenderQueue::Flush(Renderer& renderer)
+{
+	if (m_packets.empty())
+		return;
+
+	RadixSort();
+
+	Shader* boundShader = nullptr;
+	const Material* boundMaterial = nullptr;
+
+	//The first packet always binds, as boundShader is null, so boundMaterial is never dereferenced while null
+
+	for (const SortEntry& entry : m_entries)
+	{
+		const DrawPacket& packet = m_packets[entry.packetIndex];
+
+		//Materials with the same sort ID bind the same texture arrays, so there is no need to rebind them
+		if (packet.shader != boundShader || packet.material->GetSortID() != boundMaterial->GetSortID())
+		{
+			renderer.BindShader(*packet.shader);
+			packet.material->Bind(renderer, *packet.shader);
+
+			boundShader = packet.shader;
+			boundMaterial = packet.material;
+		}
+
+		renderer.Draw(*packet.va, *packet.ib, packet.drawID, packet.firstIndex, packet.indexCount);
+	}
+
+	renderer.SetCullFace(false); //Anything drawn without a material expects the default state
+
+	m_packets.clear();
+	m_entries.clear();
+}
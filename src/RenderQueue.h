@@ -0,0 +1,79 @@
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include "Util.h"
+
+#include <vector>
+
+//Forward declared because Renderer.h includes this file
+class IndexBuffer;
+class Material;
+class Renderer;
+class Shader;
+class VertexArray;
+
+//Passes are drawn in this order. A pass takes the top bits of the sort key, so it overrides everything else
+enum class RenderPass : uint8
+{
+	opaque = 0,
+};
+
+/*
+ * Collects draws so that they can be sorted before they are submitted. Every draw gets a 64-bit key:
+ *
+ *   [63:62] pass | [61:54] shader | [53:24] material | [23:0] quantized view space depth
+ *
+ * The shader is Shader::GetProgramIndex(), so every program (and every variant) gets its own value as long as there are
+ * no more than maxShaders of them.
+ *
+ * so after sorting, draws are grouped by shader and then by material, and draws with the same material are drawn
+ * front to back. The keys are sorted with an LSD radix sort.
+ */
+class RenderQueue
+{
+public:
+	struct DrawPacket
+	{
+		Shader* shader; //The variant for the material's features, see Shader::GetVariant()
+		const Material* material;
+		const VertexArray* va;
+		const IndexBuffer* ib;
+		uint firstIndex; //The range of ib to draw, such as one level of detail of a mesh
+		uint indexCount;
+		uint drawID; //From Renderer::PushObjectUniforms
+	};
+
+private:
+	struct SortEntry
+	{
+		uint64 key;
+		uint32 packetIndex;
+	};
+
+	std::vector<DrawPacket> m_packets;
+
+	//Kept around so that sorting does not allocate every frame
+	std::vector<SortEntry> m_entries;
+	std::vector<SortEntry> m_scratch;
+
+	void RadixSort();
+
+public:
+	static constexpr uint maxShaders = 1 << 8;
+
+	static uint64 MakeKey(RenderPass pass, const Shader& shader, const Material& material, float viewDepth);
+
+	void Push(
+		RenderPass pass, Shader& shader, const Material& material,
+		const VertexArray& va, const IndexBuffer& ib, uint firstIndex, uint indexCount, uint drawID, float viewDepth
+	);
+
+	bool IsEmpty() const { return m_packets.empty(); }
+
+	//Sorts and draws everything in the queue, then empties it
+	void Flush(Renderer& renderer);
+};
+
+
+
+#endif //RENDERQUEUE_H
@@ -1,7 +1,279 @@
 #include "Renderer.h"
 
-void Renderer::Draw(const VertexArray& va, const IndexBuffer& ib) const
+#include <cstring>
+
+Renderer::Renderer()
+	:	m_frameUniforms(),
+		m_uniformOffsetAlignment(256),
+		m_storageOffsetAlignment(256),
+		m_streamBuffer(GL_ARRAY_BUFFER, streamBufferRegionSize),
+		m_objectUniformBuffer(GL_SHADER_STORAGE_BUFFER, sizeof(ObjectUniforms) * maxObjectsPerFrame),
+		m_numObjectsThisFrame(0)
+{
+	m_frameUniforms.viewMatrix = JPH::Mat44::sIdentity();
+	m_frameUniforms.projectionMatrix = JPH::Mat44::sIdentity();
+	m_frameUniforms.projViewMatrix = JPH::Mat44::sIdentity();
+
+	int uniformOffsetAlignment = 0;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformOffsetAlignment);
+	if (uniformOffsetAlignment > 0)
+		m_uniformOffsetAlignment = static_cast<uint>(uniformOffsetAlignment);
+
+	int storageOffsetAlignment = 0;
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storageOffsetAlignment);
+	if (storageOffsetAlignment > 0)
+		m_storageOffsetAlignment = static_cast<uint>(storageOffsetAlignment);
+
+	UploadFrameUniforms();
+}
+
+Renderer::~Renderer() = default;
+
+void Renderer::BeginFrame()
+{
+	m_lastFrameStats = m_stats;
+	m_stats = StateCacheStats();
+	InvalidateStateCache();
+
+	m_numObjectsThisFrame = 0;
+
+	m_streamBuffer.BeginFrame();
+	m_objectUniformBuffer.BeginFrame();
+
+	m_objectUniformBuffer.GetBuffer().BindRange(
+		objectUniformsBinding, m_objectUniformBuffer.GetRegionOffset(), m_objectUniformBuffer.GetRegionSize()
+	);
+
+	//The frame uniforms that are bound are in the region of the last frame, which is reused in a couple of frames
+	UploadFrameUniforms();
+
+	m_textureLoader.UploadFinished();
+}
+
+void Renderer::EndFrame()
+{
+	FlushRenderQueue();
+
+	m_streamBuffer.EndFrame();
+	m_objectUniformBuffer.EndFrame();
+}
+
+void Renderer::BindShader(const Shader& shader)
+{
+	m_stats.programBinds++;
+	if (m_stateCache.program == shader.GetRendererID())
+	{
+		m_stats.programBindsFiltered++;
+		return;
+	}
+
+	m_stateCache.program = shader.GetRendererID();
+	glUseProgram(m_stateCache.program);
+}
+
+void Renderer::BindVertexArray(uint vertexArrayID)
+{
+	m_stats.vertexArrayBinds++;
+	if (m_stateCache.vertexArray == vertexArrayID)
+	{
+		m_stats.vertexArrayBindsFiltered++;
+		return;
+	}
+
+	m_stateCache.vertexArray = vertexArrayID;
+	glBindVertexArray(vertexArrayID);
+}
+
+void Renderer::BindTexture(uint unit, const Texture& texture)
+{
+	BindTexture(unit, texture.GetRendererID());
+}
+
+void Renderer::BindTexture(uint unit, uint textureID)
+{
+	m_stats.textureBinds++;
+	if (unit < numCachedTextureUnits)
+	{
+		if (m_stateCache.textures[unit] == textureID)
+		{
+			m_stats.textureBindsFiltered++;
+			return;
+		}
+
+		m_stateCache.textures[unit] = textureID;
+	}
+
+	//glBindTextureUnit does not change the active texture unit, so there is no glActiveTexture state to track
+	glBindTextureUnit(unit, textureID);
+}
+
+void Renderer::SetDepthTest(bool enabled)
+{
+	SetCapability(GL_DEPTH_TEST, enabled, m_stateCache.depthTest);
+}
+
+void Renderer::SetDepthWrite(bool enabled)
+{
+	m_stats.stateChanges++;
+	if (m_stateCache.depthWrite == enabled)
+	{
+		m_stats.stateChangesFiltered++;
+		return;
+	}
+
+	m_stateCache.depthWrite = enabled;
+	glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+}
+
+void Renderer::SetDepthFunc(uint func)
+{
+	m_stats.stateChanges++;
+	if (m_stateCache.depthFunc == func)
+	{
+		m_stats.stateChangesFiltered++;
+		return;
+	}
+
+	m_stateCache.depthFunc = func;
+	glDepthFunc(func);
+}
+
+void Renderer::SetBlend(bool enabled)
+{
+	SetCapability(GL_BLEND, enabled, m_stateCache.blend);
+}
+
+void Renderer::SetCullFace(bool enabled)
+{
+	SetCapability(GL_CULL_FACE, enabled, m_stateCache.cullFace);
+}
+
+void Renderer::SetColorWrite(bool enabled)
+{
+	m_stats.stateChanges++;
+	if (m_stateCache.colorWrite == enabled)
+	{
+		m_stats.stateChangesFiltered++;
+		return;
+	}
+
+	m_stateCache.colorWrite = enabled;
+	GLboolean mask = enabled ? GL_TRUE : GL_FALSE;
+	glColorMask(mask, mask, mask, mask);
+}
+
+void Renderer::SetCapability(uint capability, bool enabled, int8& cachedState)
+{
+	m_stats.stateChanges++;
+	if (cachedState == enabled)
+	{
+		m_stats.stateChangesFiltered++;
+		return;
+	}
+
+	cachedState = enabled;
+	if (enabled)
+		glEnable(capability);
+	else
+		glDisable(capability);
+}
+
+void Renderer::InvalidateStateCache()
+{
+	m_stateCache = StateCache();
+}
+
+void Renderer::SetFrameUniforms(const JPH::Mat44& viewMatrix, const JPH::Mat44& projectionMatrix)
+{
+	if (m_frameUniforms.viewMatrix == viewMatrix && m_frameUniforms.projectionMatrix == projectionMatrix)
+		return;
+
+	FlushRenderQueue();
+
+	m_frameUniforms.viewMatrix = viewMatrix;
+	m_frameUniforms.projectionMatrix = projectionMatrix;
+	m_frameUniforms.projViewMatrix = projectionMatrix * viewMatrix;
+
+	UploadFrameUniforms();
+}
+
+void Renderer::UploadFrameUniforms()
+{
+	//A new copy every time instead of overwriting the old one, as queued GPU work may still read it
+	StreamBuffer::Allocation allocation = m_streamBuffer.Allocate(sizeof(FrameUniforms), m_uniformOffsetAlignment);
+	ASSERT_LOG(allocation.data != nullptr, "The stream buffer is full, increase Renderer::streamBufferRegionSize");
+
+	std::memcpy(allocation.data, &m_frameUniforms, sizeof(FrameUniforms));
+	m_streamBuffer.GetBuffer().BindRange(GL_UNIFORM_BUFFER, frameUniformsBinding, allocation.offset, sizeof(FrameUniforms));
+}
+
+void Renderer::FlushRenderQueue()
+{
+	m_renderQueue.Flush(*this);
+}
+
+uint Renderer::PushObjectUniforms(const JPH::Mat44& modelMatrix, const JPH::Mat44& MVP, JPH::UVec4Arg textureLayers)
+{
+	ASSERT_LOG(m_numObjectsThisFrame < maxObjectsPerFrame, "Too many objects drawn this frame, increase Renderer::maxObjectsPerFrame");
+
+	uint drawID = m_numObjectsThisFrame++;
+	ObjectUniforms& object = static_cast<ObjectUniforms*>(m_objectUniformBuffer.GetRegionData())[drawID];
+	object.modelMatrix = modelMatrix;
+	object.MVP = MVP;
+	object.normalMatrix = NormalMatrix(modelMatrix);
+	object.textureLayers = textureLayers;
+
+	return drawID;
+}
+
+void Renderer::Draw(const VertexArray& va, const IndexBuffer& ib)
+{
+	BindVertexArray(va.GetRendererID());
+	glDrawElements(GL_TRIANGLES, ib.GetCount(), ib.GetType(), nullptr);
+}
+
+void Renderer::Draw(const VertexArray& va, const IndexBuffer& ib, uint drawID)
+{
+	BindVertexArray(va.GetRendererID());
+	glDrawElementsInstancedBaseInstance(GL_TRIANGLES, ib.GetCount(), ib.GetType(), nullptr, 1, drawID);
+}
+
+void Renderer::Draw(const VertexArray& va, const IndexBuffer& ib, uint drawID, uint firstIndex, uint indexCount)
+{
+	BindVertexArray(va.GetRendererID());
+
+	uint64 offset = static_cast<uint64>(firstIndex) * ib.GetIndexSize();
+	glDrawElementsInstancedBaseInstance(GL_TRIANGLES, indexCount, ib.GetType(), reinterpret_cast<const void*>(offset), 1, drawID);
+}
+
+void Renderer::DrawInstanced(const VertexArray& va, const IndexBuffer& ib, uint instanceCount, uint baseInstance /* = 0 */)
+{
+	BindVertexArray(va.GetRendererID());
+	glDrawElementsInstancedBaseInstance(GL_TRIANGLES, ib.GetCount(), ib.GetType(), nullptr, instanceCount, baseInstance);
+}
+
+void Renderer::MultiDrawIndirect(const VertexArray& va, const IndexBuffer& ib, const Buffer& indirectBuffer, uint64 offset, uint drawCount)
+{
+	BindVertexArray(va.GetRendererID());
+	indirectBuffer.Bind();
+	glMultiDrawElementsIndirect(GL_TRIANGLES, ib.GetType(), reinterpret_cast<const void*>(offset), drawCount, 0);
+}
+
+void Renderer::MultiDrawIndirectCount(
+	const VertexArray& va, const IndexBuffer& ib, const Buffer& indirectBuffer, uint64 offset,
+	const Buffer& drawCountBuffer, uint64 drawCountOffset, uint maxDrawCount)
+{
+	BindVertexArray(va.GetRendererID());
+	indirectBuffer.Bind();
+	drawCountBuffer.Bind();
+	glMultiDrawElementsIndirectCount(
+		GL_TRIANGLES, ib.GetType(), reinterpret_cast<const void*>(offset), static_cast<GLintptr>(drawCountOffset), maxDrawCount, 0
+	);
+}
+
+void Renderer::DispatchCompute(const Shader& shader, uint numGroupsX, uint numGroupsY, uint numGroupsZ, uint barriers)
 {
-	va.Bind();
-	glDrawElements(GL_TRIANGLES, ib.GetCount(), GL_UNSIGNED_INT, nullptr);
+	BindShader(shader);
+	glDispatchCompute(numGroupsX, numGroupsY, numGroupsZ);
+	glMemoryBarrier(barriers);
 }
@@ -1,19 +1,222 @@
 #ifndef RENDERER_H
 #define RENDERER_H
+#include "Buffer.h"
 #include "IndexBuffer.h"
+#include "RenderQueue.h"
 #include "Shader.h"
+#include "StreamBuffer.h"
+#include "Texture.h"
+#include "TextureLoader.h"
 #include "VertexArray.h"
 
+#include <array>
+
+
+//NOTE: DO NOT UPDATE THE LAYOUT of these structs without changing ModelVertex.glsl and ModelDepthVertex.glsl
+
+/*
+ * The inverse transpose of the upper 3x3 of a model matrix, which keeps normals perpendicular to their surface under
+ * non uniform scale. It is computed on the CPU once per object instead of inverting a matrix for every vertex.
+ * The columns are padded to 4 floats, like a std430 mat3
+ */
+struct NormalMatrix
+{
+	std::array<JPH::Vec4, 3> columns;
+
+	NormalMatrix() = default;
+
+	explicit NormalMatrix(const JPH::Mat44& modelMatrix)
+	{
+		JPH::Mat44 inverseTranspose = modelMatrix.Inversed3x3().Transposed3x3();
+		for (uint i = 0; i < 3; i++)
+			columns[i] = JPH::Vec4(inverseTranspose.GetColumn3(i), 0.0f);
+	}
+};
+
+//Uniforms that are the same for every object drawn with a given view (std140 uniform block)
+struct FrameUniforms
+{
+	JPH::Mat44 viewMatrix;
+	JPH::Mat44 projectionMatrix;
+	JPH::Mat44 projViewMatrix;
+};
+
+//Uniforms that are different for every draw call (std430 shader storage buffer, indexed by the draw ID)
+struct ObjectUniforms
+{
+	JPH::Mat44 modelMatrix;
+	JPH::Mat44 MVP;
+	NormalMatrix normalMatrix;
+	JPH::UVec4 textureLayers; //See Material::GetTextureLayers()
+};
+
+static_assert(sizeof(FrameUniforms) == 192, "FrameUniforms must match the std140 layout of the FrameUniforms block");
+static_assert(sizeof(NormalMatrix) == 48, "NormalMatrix must match the std430 layout of a mat3");
+static_assert(sizeof(ObjectUniforms) == 192, "ObjectUniforms must match the std430 layout of the ObjectUniforms block");
+
+//How many binds/state changes were requested in a frame, and how many of those were skipped because nothing changed
+struct StateCacheStats
+{
+	uint programBinds = 0;
+	uint programBindsFiltered = 0;
+
+	uint vertexArrayBinds = 0;
+	uint vertexArrayBindsFiltered = 0;
+
+	uint textureBinds = 0;
+	uint textureBindsFiltered = 0;
+
+	uint stateChanges = 0; //Depth, blend, face culling and color mask state
+	uint stateChangesFiltered = 0;
+};
+
 
 class Renderer {
+public:
+	static constexpr uint frameUniformsBinding = 0; //Uniform buffer binding point
+	static constexpr uint objectUniformsBinding = 1; //Shader storage buffer binding point
+
+	static constexpr uint maxObjectsPerFrame = 16384;
+	static constexpr uint numFramesInFlight = StreamBuffer::numRegions; //So we never write to a region that the GPU is reading
+
+	//Per frame for the frame uniforms, debug geometry and anything else that GetStreamBuffer() is used for
+	static constexpr uint streamBufferRegionSize = 8 * 1024 * 1024;
+
+	static constexpr uint numCachedTextureUnits = 32; //Binds to texture units past this still work, they are just not filtered
+
 private:
+	static constexpr uint unknownID = -1; //The cache does not know what is bound, so the next bind always goes through
+	static constexpr int8 unknownState = -1;
+
+	/*
+	 * A shadow copy of the GL state that we change while drawing. It is reset at the start of every frame, because
+	 * anything that binds outside of a frame (loading models, ImGui, etc.) does not go through the renderer.
+	 */
+	struct StateCache
+	{
+		uint program = unknownID;
+		uint vertexArray = unknownID;
+		std::array<uint, numCachedTextureUnits> textures;
+
+		int8 depthTest = unknownState;
+		int8 depthWrite = unknownState;
+		uint depthFunc = unknownID;
+		int8 blend = unknownState;
+		int8 cullFace = unknownState;
+		int8 colorWrite = unknownState;
+
+		StateCache() { textures.fill(unknownID); }
+	};
+
+	RenderQueue m_renderQueue;
+	TextureLoader m_textureLoader;
+
+	StateCache m_stateCache;
+	StateCacheStats m_stats;
+	StateCacheStats m_lastFrameStats;
+
+	void SetCapability(uint capability, bool enabled, int8& cachedState);
+
+	FrameUniforms m_frameUniforms; //A CPU side copy, so we only upload when something changes
+	uint m_uniformOffsetAlignment;
+	uint m_storageOffsetAlignment;
+
+	StreamBuffer m_streamBuffer;
+	StreamBuffer m_objectUniformBuffer; //Indexed by the draw ID from the start of the frame's region
+	uint m_numObjectsThisFrame;
+
+	void UploadFrameUniforms();
+
 public:
-	inline void Clear() const
+	Renderer();
+	~Renderer();
+
+	Renderer(const Renderer&) = delete;
+	Renderer& operator=(const Renderer&) = delete;
+
+	inline void Clear()
 	{
+		SetDepthWrite(true); //glClear respects the depth and color masks
+		SetColorWrite(true);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	}
 
-	void Draw(const VertexArray& va, const IndexBuffer& ib) const;
+	/*
+	 * Must be called at the start and end of every frame. BeginFrame() waits until the GPU is done with the regions of
+	 * the stream buffers that we are about to write to, and EndFrame() marks the regions as in use by the GPU.
+	 */
+	void BeginFrame();
+	void EndFrame();
+
+	//These only call into OpenGL if the state is different from what the renderer knows is already set
+	void BindShader(const Shader& shader);
+	void BindVertexArray(uint vertexArrayID);
+	void BindTexture(uint unit, const Texture& texture);
+	void BindTexture(uint unit, uint textureID);
+
+	void SetDepthTest(bool enabled);
+	void SetDepthWrite(bool enabled);
+	void SetDepthFunc(uint func); //GL_LESS, GL_EQUAL, ...
+	void SetBlend(bool enabled);
+	void SetCullFace(bool enabled); //Which faces are culled is set once in Application::InitOpenGL()
+
+	//Turning color writes off makes the draws depth only, materials then skip binding their textures (see Material::Bind())
+	void SetColorWrite(bool enabled);
+	bool IsColorWriteEnabled() const { return m_stateCache.colorWrite != 0; }
+
+	//Forgets the cached state, call this after binding things without going through the renderer in the middle of a frame
+	void InvalidateStateCache();
+
+	const StateCacheStats& GetLastFrameStats() const { return m_lastFrameStats; }
+
+	/*
+	 * Only uploads the frame uniforms if they are different from what is already on the GPU. Because queued draws read
+	 * the frame uniforms when they are submitted, the render queue is flushed before they change.
+	 */
+	void SetFrameUniforms(const JPH::Mat44& viewMatrix, const JPH::Mat44& projectionMatrix);
+
+	const FrameUniforms& GetFrameUniforms() const { return m_frameUniforms; }
+
+	//Draws pushed into the queue are sorted and drawn when the queue is flushed (explicitly, at EndFrame, or when the frame uniforms change)
+	RenderQueue& GetRenderQueue() { return m_renderQueue; }
+	void FlushRenderQueue();
+
+	//Finished images are uploaded at the start of every frame
+	TextureLoader& GetTextureLoader() { return m_textureLoader; }
+
+	//For geometry (or anything else) that is written every frame, allocations are only valid until the end of the frame
+	StreamBuffer& GetStreamBuffer() { return m_streamBuffer; }
+
+	//The alignments that stream buffer allocations need to be bound as uniform or shader storage buffer ranges
+	uint GetUniformOffsetAlignment() const { return m_uniformOffsetAlignment; }
+	uint GetStorageOffsetAlignment() const { return m_storageOffsetAlignment; }
+
+	//Writes the uniforms for one draw into the mapped object buffer and returns the draw ID that has to be passed to Draw()
+	uint PushObjectUniforms(const JPH::Mat44& modelMatrix, const JPH::Mat44& MVP, JPH::UVec4Arg textureLayers = JPH::UVec4::sZero());
+
+	void Draw(const VertexArray& va, const IndexBuffer& ib);
+
+	//The draw ID is passed as the base instance, so the shader finds its ObjectUniforms with gl_BaseInstance
+	void Draw(const VertexArray& va, const IndexBuffer& ib, uint drawID);
+
+	//Same as above, but only draws indexCount indices starting at firstIndex
+	void Draw(const VertexArray& va, const IndexBuffer& ib, uint drawID, uint firstIndex, uint indexCount);
+
+	//Draws instanceCount instances, gl_InstanceID goes from 0 to instanceCount - 1 and gl_BaseInstance is baseInstance
+	void DrawInstanced(const VertexArray& va, const IndexBuffer& ib, uint instanceCount, uint baseInstance = 0);
+
+	//indirectBuffer holds MultiDrawBatch::DrawElementsIndirectCommand structs, offset is in bytes
+	//ib is only used for its index type, it must be the index buffer attached to va
+	void MultiDrawIndirect(const VertexArray& va, const IndexBuffer& ib, const Buffer& indirectBuffer, uint64 offset, uint drawCount);
+
+	//Same as MultiDrawIndirect(), but the number of draws is read from drawCountBuffer (a GL_PARAMETER_BUFFER) on the GPU
+	void MultiDrawIndirectCount(
+		const VertexArray& va, const IndexBuffer& ib, const Buffer& indirectBuffer, uint64 offset,
+		const Buffer& drawCountBuffer, uint64 drawCountOffset, uint maxDrawCount
+	);
+
+	//barriers are the glMemoryBarrier bits for how the results of the compute shader are used next
+	void DispatchCompute(const Shader& shader, uint numGroupsX, uint numGroupsY, uint numGroupsZ, uint barriers);
 };
 
 
@@ -1,89 +1,274 @@
 #include "Shader.h"
+#include "ProgramCache.h"
 #include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <cctype>
 #include <fstream>
+#include <thread>
 
-Shader::Shader(const std::string& vertexShaderFilePath, const std::string& fragmentShaderFilePath)
+struct Shader::PermutationCache
 {
-	std::string vertexShader = ParseShader(vertexShaderFilePath);
-	std::string fragmentShader = ParseShader(fragmentShaderFilePath);
+	std::string vertexShader;
+	std::string fragmentShader;
+	uint32 supportedFeatures;
 
-	int shaderIDResult = CreateShaders(vertexShader, fragmentShader);
+	Shader* base; //The shader that owns this cache, it is not in variants
+	std::array<std::unique_ptr<Shader>, ShaderFeature::numPermutations> variants; //Indexed by the feature mask
+};
 
-	if (shaderIDResult == -1)
-		ASSERT_LOG(false, "Shader could not be created.")
+Shader::Shader(const std::string& vertexShaderFilePath, const std::string& fragmentShaderFilePath, uint32 features /* = ShaderFeature::none */)
+	:	m_ownedPermutations(std::make_unique<PermutationCache>())
+{
+	m_permutations = m_ownedPermutations.get();
+	m_permutations->vertexShader = ParseShader(vertexShaderFilePath);
+	m_permutations->fragmentShader = ParseShader(fragmentShaderFilePath);
+	m_permutations->supportedFeatures =
+		FindSupportedFeatures(m_permutations->vertexShader) | FindSupportedFeatures(m_permutations->fragmentShader);
+	m_permutations->base = this;
+
+	CompileVariant(features & m_permutations->supportedFeatures);
+}
+
+Shader::Shader(PermutationCache& permutations, uint32 features)
+	:	m_permutations(&permutations)
+{
+	CompileVariant(features);
+}
+
+void Shader::CompileVariant(uint32 features)
+{
+	m_features = features;
 
-	m_RendererID = static_cast<uint>(shaderIDResult);
+	CreateProgram({
+		{GL_VERTEX_SHADER, InjectDefines(m_permutations->vertexShader, features)},
+		{GL_FRAGMENT_SHADER, InjectDefines(m_permutations->fragmentShader, features)}
+	});
+}
+
+Shader::Shader(const std::string& computeShaderFilePath)
+{
+	CreateProgram({{GL_COMPUTE_SHADER, ParseShader(computeShaderFilePath)}});
 }
 
 Shader::~Shader()
 {
+	for (uint shaderID : m_linkingShaders)
+		glDeleteShader(shaderID);
+
 	glDeleteProgram(m_RendererID);
+	ProgramCache::ReleaseProgramIndex(m_programIndex);
+}
+
+Shader& Shader::GetVariant(uint32 features)
+{
+	if (m_permutations == nullptr)
+		return *this;
+
+	features &= m_permutations->supportedFeatures;
+	if (features == m_features) [[likely]]
+		return *this;
+
+	if (features == m_permutations->base->m_features)
+		return *m_permutations->base;
+
+	std::unique_ptr<Shader>& variant = m_permutations->variants[features];
+	if (variant == nullptr)
+	{
+		variant.reset(new Shader(*m_permutations, features)); //The constructor is private, so no std::make_unique
+		variant->FinishLinking(); //It is about to be drawn with anyway
+	}
+
+	return *variant;
+}
+
+/*static*/ std::string Shader::InjectDefines(const std::string& source, uint32 features)
+{
+	if (features == ShaderFeature::none)
+		return source;
+
+	std::string defines;
+	for (uint i = 0; i < ShaderFeature::numFeatures; i++)
+	{
+		if (features & (1u << i))
+			defines.append("#define ").append(ShaderFeature::defineNames[i]).append("\n");
+	}
+
+	//The #version line has to come first. #line keeps the line numbers in compile errors the same as in the file
+	size_t versionLineEnd = source.starts_with("#version") ? source.find('\n') + 1 : 0;
+	defines.append(versionLineEnd == 0 ? "#line 1\n" : "#line 2\n");
+
+	std::string result = source;
+	result.insert(versionLineEnd, defines);
+	return result;
+}
+
+/*static*/ uint32 Shader::FindSupportedFeatures(const std::string& source)
+{
+	auto isNameCharacter = [](char c) { return std::isalnum(static_cast<unsigned char>(c)) || c == '_'; };
+
+	uint32 features = ShaderFeature::none;
+	for (uint i = 0; i < ShaderFeature::numFeatures; i++)
+	{
+		std::string_view name = ShaderFeature::defineNames[i];
+
+		//Only whole words count, so SPECULAR_MAP_SIZE would not mean that SPECULAR_MAP is supported
+		for (size_t position = source.find(name); position != std::string::npos; position = source.find(name, position + 1))
+		{
+			size_t end = position + name.size();
+			if ((position == 0 || !isNameCharacter(source[position - 1])) && (end == source.size() || !isNameCharacter(source[end])))
+			{
+				features |= 1u << i;
+				break;
+			}
+		}
+	}
+
+	return features;
 }
 
-int Shader::CreateShaders(const std::string& vertexShader, const std::string& fragmentShader)
+void Shader::CreateProgram(std::initializer_list<ShaderSource> sources)
 {
-	uint programID = glCreateProgram();
-	int vertexShaderID = CompileShader(GL_VERTEX_SHADER, vertexShader);
-	int fragmentShaderID = CompileShader(GL_FRAGMENT_SHADER, fragmentShader);
+	m_RendererID = glCreateProgram();
+	m_programIndex = ProgramCache::AcquireProgramIndex();
 
-	if (vertexShaderID == -1 || fragmentShaderID == -1 )
+	std::vector<std::string_view> sourceViews;
+	for (const ShaderSource& source : sources)
+		sourceViews.push_back(source.source);
+
+	m_programCacheKey = ProgramCache::ComputeKey(sourceViews);
+	if (ProgramCache::Load(m_programCacheKey, m_RendererID))
 	{
-		glDeleteShader(vertexShaderID);
-		glDeleteShader(fragmentShaderID);
-		glDeleteProgram(programID);
-		return -1;
+		CacheUniformLocations();
+		return;
 	}
 
-	glAttachShader(programID, vertexShaderID);
-	glAttachShader(programID, fragmentShaderID);
-	glLinkProgram(programID);
-	glValidateProgram(programID);
+	//Nothing here asks for a result, so the driver can carry on compiling while we do other work
+	for (const ShaderSource& source : sources)
+	{
+		uint shaderID = glCreateShader(source.type);
+		const char* sourceString = source.source.c_str();
 
-	//We can delete them because they have been attached to a program
-	glDeleteShader(vertexShaderID);
-	glDeleteShader(fragmentShaderID);
+		glShaderSource(shaderID, 1, &sourceString, nullptr);
+		glCompileShader(shaderID);
+		glAttachShader(m_RendererID, shaderID);
+		m_linkingShaders.push_back(shaderID);
+	}
 
-	return static_cast<int>(programID);
+	glProgramParameteri(m_RendererID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	glLinkProgram(m_RendererID);
+	m_linkPending = true;
 }
 
-int Shader::CompileShader(uint type, const std::string& shaderSource)
+void Shader::FinishLinking()
 {
-	uint shaderID = glCreateShader(type);
-	const char* shaderSrc = shaderSource.c_str();
+	if (!m_linkPending)
+		return;
+
+	m_linkPending = false;
 
-	glShaderSource(shaderID, 1, &shaderSrc, nullptr);
-	glCompileShader(shaderID);
+	int linked = GL_FALSE;
+	glGetProgramiv(m_RendererID, GL_LINK_STATUS, &linked);
 
-	int result;
-	glGetShaderiv(shaderID, GL_COMPILE_STATUS, &result);
+	if (linked == GL_FALSE)
+		PrintLinkErrors();
+	else
+		ProgramCache::Store(m_programCacheKey, m_RendererID);
 
-	if (result == GL_FALSE)
+	//The program keeps its own copy of the compiled code
+	for (uint shaderID : m_linkingShaders)
 	{
+		glDetachShader(m_RendererID, shaderID);
+		glDeleteShader(shaderID);
+	}
+	m_linkingShaders.clear();
+
+	ASSERT_LOG(linked != GL_FALSE, "Shader could not be created (features " << m_features << ").");
+	CacheUniformLocations();
+}
+
+/*static*/ void Shader::FinishLinking(std::initializer_list<Shader*> shaders)
+{
+	std::vector<Shader*> pending(shaders);
+
+	while (!pending.empty())
+	{
+		std::erase_if(pending, [](Shader* shader)
+		{
+			if (!shader->IsLinkComplete())
+				return false;
+
+			shader->FinishLinking();
+			return true;
+		});
+
+		if (!pending.empty())
+			std::this_thread::yield();
+	}
+}
+
+bool Shader::IsLinkComplete() const
+{
+	if (!m_linkPending)
+		return true;
+
+	if (!GLEW_KHR_parallel_shader_compile && !GLEW_ARB_parallel_shader_compile)
+		return true;
+
+	int complete = GL_FALSE;
+	glGetProgramiv(m_RendererID, GL_COMPLETION_STATUS_KHR, &complete);
+	return complete != GL_FALSE;
+}
+
+void Shader::PrintLinkErrors() const
+{
+	bool compileFailed = false;
+
+	for (uint shaderID : m_linkingShaders)
+	{
+		int result;
+		glGetShaderiv(shaderID, GL_COMPILE_STATUS, &result);
+		if (result != GL_FALSE)
+			continue;
+
+		compileFailed = true;
+
 		int length;
+		int type;
 		glGetShaderiv(shaderID, GL_INFO_LOG_LENGTH, &length);
+		glGetShaderiv(shaderID, GL_SHADER_TYPE, &type);
 
-		char* message = (char*) alloca(length * sizeof(char));
-		glGetShaderInfoLog(shaderID, length, &length, message);
+		std::string message(length, '\0');
+		glGetShaderInfoLog(shaderID, length, &length, message.data());
 
-		std::cerr << "Failed to compile shader of type: " << (type == GL_VERTEX_SHADER ? "vertex" : "fragment") << "\n";
+		const char* typeName = type == GL_VERTEX_SHADER ? "vertex" : type == GL_FRAGMENT_SHADER ? "fragment" : "compute";
+		std::cerr << "Failed to compile shader of type: " << typeName << "\n";
 		std::cerr << message << "\n";
-
-		glDeleteShader(shaderID);
-		return -1;
 	}
 
-	return static_cast<int>(shaderID);
+	//A link error is only interesting if every stage compiled
+	if (compileFailed)
+		return;
+
+	int length;
+	glGetProgramiv(m_RendererID, GL_INFO_LOG_LENGTH, &length);
+
+	std::string message(length, '\0');
+	glGetProgramInfoLog(m_RendererID, length, &length, message.data());
+
+	std::cerr << "Failed to link program (features " << m_features << ")\n";
+	std::cerr << message << "\n";
 }
 
 std::string Shader::ParseShader(const std::string& filepath)
 {
-	std::ifstream file(filepath);
-	std::string str;
-	std::string content;
+	std::ifstream file(filepath, std::ios::binary);
+	ASSERT_LOG(file, "Unable to open shader \"" << filepath << "\"");
 
-	while (std::getline(file, str)) {
-		content.append(str + "\n");
-	}
+	//Read in one go, the size is known up front
+	file.seekg(0, std::ios::end);
+	std::string content(static_cast<size_t>(std::max<std::streamoff>(file.tellg(), 0)), '\0');
+	file.seekg(0, std::ios::beg);
+	file.read(content.data(), static_cast<std::streamsize>(content.size()));
 
 	return content;
 }
@@ -100,50 +285,147 @@ void Shader::Unbind()
 
 void Shader::SetUniform(const std::string& uniformName, float val)
 {
-	glUniform1f(GetUniformLocation(uniformName), val);
+	SetUniform(UniformID(HashUniformName(uniformName), uniformName.c_str()), val);
 }
 
 void Shader::SetUniform(const std::string& uniformName, int val)
 {
-	glUniform1i(GetUniformLocation(uniformName), val);
+	SetUniform(UniformID(HashUniformName(uniformName), uniformName.c_str()), val);
 }
 
 void Shader::SetUniform(const std::string& uniformName, uint val)
 {
-	glUniform1i(GetUniformLocation(uniformName), val);
+	SetUniform(UniformID(HashUniformName(uniformName), uniformName.c_str()), val);
 }
 
 void Shader::SetUniform(const std::string &uniformName, bool val)
 {
-	glUniform1i(GetUniformLocation(uniformName), val);
+	SetUniform(UniformID(HashUniformName(uniformName), uniformName.c_str()), val);
 }
 
 void Shader::SetUniform(const std::string& uniformName, const JPH::Vec3& val)
 {
-	glUniform3f(GetUniformLocation(uniformName), val[0], val[1], val[2]);
+	SetUniform(UniformID(HashUniformName(uniformName), uniformName.c_str()), val);
 }
 
 void Shader::SetUniform(const std::string& uniformName, const JPH::Vec4& val)
 {
-	glUniform4f(GetUniformLocation(uniformName), val[0], val[1], val[2], val[3]);
+	SetUniform(UniformID(HashUniformName(uniformName), uniformName.c_str()), val);
 }
 
 void Shader::SetUniform(const std::string &uniformName, const JPH::Mat44 &val)
 {
+	SetUniform(UniformID(HashUniformName(uniformName), uniformName.c_str()), val);
+}
+
+//The UniformID versions use glProgramUniform so that the cached values stay correct even if another program is bound
+void Shader::SetUniform(UniformID uniform, float val)
+{
+	UniformSlot& slot = GetUniformSlot(uniform);
+	if (!IsRedundant(slot, val))
+		glProgramUniform1f(m_RendererID, slot.location, val);
+}
+
+void Shader::SetUniform(UniformID uniform, int val)
+{
+	UniformSlot& slot = GetUniformSlot(uniform);
+	if (!IsRedundant(slot, val))
+		glProgramUniform1i(m_RendererID, slot.location, val);
+}
+
+void Shader::SetUniform(UniformID uniform, uint val)
+{
+	SetUniform(uniform, static_cast<int>(val));
+}
+
+void Shader::SetUniform(UniformID uniform, bool val)
+{
+	SetUniform(uniform, static_cast<int>(val));
+}
+
+void Shader::SetUniform(UniformID uniform, const JPH::Vec3& val)
+{
+	//JPH::Vec3 has a hidden 4th component that can contain anything, so only the first 3 floats are compared
+	std::array<float, 3> values = {val[0], val[1], val[2]};
+
+	UniformSlot& slot = GetUniformSlot(uniform);
+	if (!IsRedundant(slot, values))
+		glProgramUniform3f(m_RendererID, slot.location, val[0], val[1], val[2]);
+}
+
+void Shader::SetUniform(UniformID uniform, const JPH::Vec4& val)
+{
+	UniformSlot& slot = GetUniformSlot(uniform);
+	if (!IsRedundant(slot, val))
+		glProgramUniform4f(m_RendererID, slot.location, val[0], val[1], val[2], val[3]);
+}
+
+void Shader::SetUniform(UniformID uniform, const JPH::Mat44& val)
+{
+	UniformSlot& slot = GetUniformSlot(uniform);
+
 	//Because JPH::Mat44 is guaranteed to be a trivial type, we can just reinterpret_cast safely
-	glUniformMatrix4fv(GetUniformLocation(uniformName), 1, GL_FALSE, reinterpret_cast<const float*>(&val));
+	if (!IsRedundant(slot, val))
+		glProgramUniformMatrix4fv(m_RendererID, slot.location, 1, GL_FALSE, reinterpret_cast<const float*>(&val));
+}
+
+void Shader::CacheUniformLocations()
+{
+	int numUniforms = 0;
+	int maxNameLength = 0;
+	glGetProgramiv(m_RendererID, GL_ACTIVE_UNIFORMS, &numUniforms);
+	glGetProgramiv(m_RendererID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+
+	std::string name(maxNameLength, '\0');
+	m_uniforms.reserve(numUniforms);
+
+	for (int i = 0; i < numUniforms; i++)
+	{
+		int nameLength = 0;
+		int size = 0;
+		uint type = 0;
+		glGetActiveUniform(m_RendererID, i, maxNameLength, &nameLength, &size, &type, name.data());
+
+		std::string_view uniformName(name.data(), nameLength);
+		int location = glGetUniformLocation(m_RendererID, name.c_str());
+
+		if (location == -1)
+			continue; //Members of uniform blocks do not have a location
+
+		//Arrays are reported as "u_name[0]", but are set using "u_name"
+		if (uniformName.ends_with("[0]"))
+			uniformName.remove_suffix(3);
+
+		UniformSlot slot{};
+		slot.hash = HashUniformName(uniformName);
+		slot.location = location;
+
+		auto it = std::lower_bound(m_uniforms.begin(), m_uniforms.end(), slot.hash,
+			[](const UniformSlot& a, uint32 hash) { return a.hash < hash; });
+
+		ASSERT_LOG(it == m_uniforms.end() || it->hash != slot.hash, "Two uniforms have the same hash, rename one of them: " << uniformName);
+		m_uniforms.insert(it, slot);
+	}
 }
 
-int Shader::GetUniformLocation(const std::string& uniformName)
+Shader::UniformSlot& Shader::GetUniformSlot(UniformID uniform, bool warnIfMissing)
 {
-	if (m_uniformLocationMap.contains(uniformName))
-		return m_uniformLocationMap[uniformName];
+	if (m_linkPending) [[unlikely]]
+		FinishLinking();
+
+	auto it = std::lower_bound(m_uniforms.begin(), m_uniforms.end(), uniform.hash,
+		[](const UniformSlot& a, uint32 hash) { return a.hash < hash; });
+
+	if (it != m_uniforms.end() && it->hash == uniform.hash) [[likely]]
+		return *it;
 
-	int uniformLocation = glGetUniformLocation(m_RendererID, uniformName.c_str());
-	if (uniformLocation == -1)
-		std::clog << "[WARNING] Uniform \"" << uniformName << "\" requested but not found - Shader.cpp, GetUniformLocation" << std::endl;
+	//Not an active uniform. We still add it (with the location -1, which GL ignores) so that we only warn once
+	UniformSlot slot{};
+	slot.hash = uniform.hash;
+	slot.location = glGetUniformLocation(m_RendererID, uniform.name);
 
-	m_uniformLocationMap[uniformName] = uniformLocation;
+	if (slot.location == -1 && warnIfMissing)
+		std::clog << "[WARNING] Uniform \"" << uniform.name << "\" requested but not found - Shader.cpp, GetUniformSlot" << std::endl;
 
-	return uniformLocation;
+	return *m_uniforms.insert(it, slot);
 }
@@ -1,32 +1,186 @@
 #ifndef SHADER_H
 #define SHADER_H
 
-#include <map>
+#include <array>
+#include <cstring>
+#include <initializer_list>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
 
 #include <glm/glm.hpp>
 
 #include "Util.h"
 
+//FNV-1a. This is constexpr so that uniform names written in the code can be hashed at compile time
+constexpr uint32 HashUniformName(std::string_view name)
+{
+	uint32 hash = 2166136261u;
+	for (char c : name)
+	{
+		hash ^= static_cast<uint8>(c);
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+//A uniform name and its hash. Use the _uniform literal ("u_MVP"_uniform) so that the hash is computed at compile time
+struct UniformID
+{
+	uint32 hash;
+	const char* name; //Only used to look up uniforms that are not found at link time, and for warnings
+
+	constexpr explicit UniformID(const char* uniformName)
+		:	hash(HashUniformName(uniformName)),
+			name(uniformName)
+	{}
+
+	constexpr UniformID(uint32 uniformHash, const char* uniformName)
+		:	hash(uniformHash),
+			name(uniformName)
+	{}
+};
+
+consteval UniformID operator""_uniform(const char* name, std::size_t)
+{
+	return UniformID(name);
+}
+
+/*
+ * The #define keys that a shader can be specialized on (see Shader::GetVariant()). Each is a bit, so a set of features
+ * is a mask, and every combination that is used is compiled into its own program
+ */
+namespace ShaderFeature
+{
+	constexpr uint32 none = 0;
+	constexpr uint32 lighting = 1 << 0; //LIGHTING
+	constexpr uint32 specularMap = 1 << 1; //SPECULAR_MAP, set by materials with a specular texture
+	constexpr uint32 instancing = 1 << 2; //INSTANCING, the per draw data is MultiDrawBatch::MeshData
+
+	constexpr uint numFeatures = 3;
+	constexpr uint numPermutations = 1 << numFeatures;
+
+	//Indexed by the bit of the feature
+	constexpr const char* defineNames[numFeatures] = {"LIGHTING", "SPECULAR_MAP", "INSTANCING"};
+}
+
+/*
+ * A shader program. Vertex/fragment shaders can be compiled with any set of ShaderFeature keys, which are injected as
+ * #defines after the #version line, so a shader can #ifdef its optional paths away instead of branching on uniforms.
+ *
+ * The Shader constructed from the files owns a permutation cache with the sources, and GetVariant() compiles the other
+ * feature sets from it the first time they are asked for. Features that neither source mentions are ignored, so asking a
+ * depth only shader for SPECULAR_MAP returns the same program. Uniforms are per program, so they have to be set on the
+ * variant that is drawn with.
+ */
 class Shader {
 private:
+	struct PermutationCache;
+	struct UniformSlot
+	{
+		uint32 hash;
+		int location;
+
+		//The last value set, so that setting a uniform to the value it already has does not call into the driver
+		bool hasValue;
+		alignas(16) std::array<uint8, sizeof(JPH::Mat44)> value;
+	};
+
+	struct ShaderSource
+	{
+		uint type; //GL_VERTEX_SHADER, GL_FRAGMENT_SHADER or GL_COMPUTE_SHADER
+		std::string source;
+	};
+
 	uint m_RendererID;
-	std::map<std::string, int> m_uniformLocationMap;
+	uint m_programIndex; //From ProgramCache::AcquireProgramIndex()
+	std::vector<UniformSlot> m_uniforms; //Sorted by hash so it can be binary searched. Filled in at link time
+
+	//While the driver is still linking a program built from source, see FinishLinking()
+	bool m_linkPending = false;
+	std::vector<uint> m_linkingShaders; //Attached to the program until it is linked
+	uint64 m_programCacheKey = 0;
+
+	uint32 m_features = ShaderFeature::none;
+
+	//Shared by the shader that was constructed from the files (which owns it) and all of its variants, null for compute shaders
+	PermutationCache* m_permutations = nullptr;
+	std::unique_ptr<PermutationCache> m_ownedPermutations;
+
+	//Compiles a variant from the sources in the cache
+	Shader(PermutationCache& permutations, uint32 features);
 
-	int GetUniformLocation(const std::string& name);
+	void CompileVariant(uint32 features);
 
-	int CreateShaders(const std::string& vertexShader, const std::string& fragmentShader);
-	int CompileShader(uint type, const std::string& shaderSource);
+	void CacheUniformLocations();
+	UniformSlot& GetUniformSlot(UniformID uniform, bool warnIfMissing = true);
+
+	//Returns true if the uniform already has this value, otherwise stores the value and returns false
+	template<typename T>
+	static bool IsRedundant(UniformSlot& slot, const T& val)
+	{
+		static_assert(sizeof(T) <= sizeof(slot.value));
+
+		if (slot.hasValue && std::memcmp(slot.value.data(), &val, sizeof(T)) == 0)
+			return true;
+
+		std::memcpy(slot.value.data(), &val, sizeof(T));
+		slot.hasValue = true;
+		return false;
+	}
+
+	//Loads the program from the ProgramCache, or starts compiling and linking it without waiting for the driver
+	void CreateProgram(std::initializer_list<ShaderSource> sources);
+	void PrintLinkErrors() const;
 	std::string ParseShader(const std::string& filepath);
 
+	static std::string InjectDefines(const std::string& source, uint32 features);
+	static uint32 FindSupportedFeatures(const std::string& source);
+
 public:
-	Shader(const std::string& vertexShaderFilePath, const std::string& fragmentShaderFilePath);
+	//features are masked by the features that the sources support, see GetVariant()
+	Shader(const std::string& vertexShaderFilePath, const std::string& fragmentShaderFilePath, uint32 features = ShaderFeature::none);
+	explicit Shader(const std::string& computeShaderFilePath); //A compute shader, dispatch it with Renderer::DispatchCompute()
 	~Shader();
 
+	Shader(const Shader&) = delete;
+	Shader& operator=(const Shader&) = delete;
+
+	/*
+	 * Returns the variant of this shader compiled with features (masked by the features the sources support), compiling
+	 * it if it has not been used before. Returns *this if that is this shader's feature set, and for compute shaders.
+	 * The variants live as long as the shader that was constructed from the files
+	 */
+	Shader& GetVariant(uint32 features);
+
+	uint32 GetFeatures() const { return m_features; }
+
+	/*
+	 * A program that is not in the ProgramCache is compiled and linked by the driver in the background (on multiple
+	 * threads with GL_KHR_parallel_shader_compile), and nothing waits for it until FinishLinking() checks the result and
+	 * stores it in the cache. This happens on its own when a uniform is first set, but creating a group of shaders and
+	 * then finishing them together lets the driver compile all of them at once
+	 */
+	void FinishLinking();
+
+	//Finishes the programs in the order that the driver completes them
+	static void FinishLinking(std::initializer_list<Shader*> shaders);
+
+	//Does not wait for the driver. Without GL_KHR_parallel_shader_compile it can not ask, and is always true
+	bool IsLinkComplete() const;
+
 	void Bind() const;
 
 	static void Unbind();
 
+	uint GetRendererID() const { return m_RendererID; }
+	uint GetProgramIndex() const { return m_programIndex; } //Dense, unlike the GL name, see ProgramCache::AcquireProgramIndex()
+
+	//Whether the program has this uniform as an active uniform. Does not warn, and is only looked up in GL the first time
+	bool HasUniform(UniformID uniform) { return GetUniformSlot(uniform, false).location != -1; }
+
 	void SetUniform(const std::string& uniformName, float val);
 	void SetUniform(const std::string& uniformName, int val);
 	void SetUniform(const std::string& uniformName, uint val);
@@ -36,6 +190,17 @@ public:
 	void SetUniform(const std::string& uniformName, const JPH::Vec4& val);
 
 	void SetUniform(const std::string& uniformName, const JPH::Mat44& val);
+
+	//These do not build any strings or do any allocations (apart from the first time an unknown uniform is used)
+	void SetUniform(UniformID uniform, float val);
+	void SetUniform(UniformID uniform, int val);
+	void SetUniform(UniformID uniform, uint val);
+	void SetUniform(UniformID uniform, bool val);
+
+	void SetUniform(UniformID uniform, const JPH::Vec3& val);
+	void SetUniform(UniformID uniform, const JPH::Vec4& val);
+
+	void SetUniform(UniformID uniform, const JPH::Mat44& val);
 };
 
 
@@ -0,0 +1,291 @@
+#include "SoftwareOcclusionCuller.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+
+SoftwareOcclusionCuller::SoftwareOcclusionCuller(JPH::JobSystem &jobSystem)
+    :   m_jobSystem(jobSystem),
+        m_barrier(nullptr),
+        m_depth(width * height, 0.0f),
+        m_projViewMatrix(JPH::Mat44::sIdentity()),
+        m_valid(false)
+{
+}
+
+SoftwareOcclusionCuller::~SoftwareOcclusionCuller()
+{
+    WaitForRasterization();
+}
+
+void SoftwareOcclusionCuller::AddOccluderCandidate(std::span<const JPH::Vec3> positions, std::span<const uint> indices)
+{
+    uint numTriangles = indices.size() / 3;
+    if (numTriangles == 0 || numTriangles > maxTrianglesPerOccluder)
+        return;
+
+    JPH::AABox bounds;
+    for (const JPH::Vec3& position : positions)
+        bounds.Encapsulate(position);
+
+    OccluderCandidate candidate;
+    candidate.positions.assign(positions.begin(), positions.end());
+    candidate.indices.assign(indices.begin(), indices.end());
+    candidate.surfaceArea = bounds.GetSurfaceArea();
+    m_occluderCandidates.emplace_back(std::move(candidate));
+}
+
+void SoftwareOcclusionCuller::FinalizeOccluders()
+{
+    //Largest first, so the budget goes to the meshes that can hide the most
+    std::sort(m_occluderCandidates.begin(), m_occluderCandidates.end(), [](const OccluderCandidate& a, const OccluderCandidate& b)
+    {
+        return a.surfaceArea > b.surfaceArea;
+    });
+
+    for (const OccluderCandidate& candidate : m_occluderCandidates)
+    {
+        if (GetNumOccluderTriangles() + candidate.indices.size() / 3 > maxOccluderTriangles)
+            continue;
+
+        uint firstVertex = m_occluderPositions.size();
+        m_occluderPositions.insert(m_occluderPositions.end(), candidate.positions.begin(), candidate.positions.end());
+        for (uint index : candidate.indices)
+            m_occluderIndices.push_back(firstVertex + index);
+    }
+
+    m_occluderCandidates = {};
+
+    m_screenVertices.reserve(m_occluderPositions.size());
+    m_triangles.reserve(GetNumOccluderTriangles());
+}
+
+void SoftwareOcclusionCuller::Rasterize(const JPH::Mat44 &projViewMatrix)
+{
+    WaitForRasterization(); //The jobs of the last frame use the same buffers
+
+    m_projViewMatrix = projViewMatrix;
+    m_valid = true;
+    m_barrier = m_jobSystem.CreateBarrier();
+
+    //The bands can only start once the triangles are set up, so they wait on a dependency that the setup job removes
+    std::array<JPH::JobHandle, (height + rowsPerJob - 1) / rowsPerJob> rowJobs;
+    for (uint band = 0; band < rowJobs.size(); band++)
+    {
+        uint firstRow = band * rowsPerJob;
+        rowJobs[band] = m_jobSystem.CreateJob("OcclusionRasterize", JPH::Color::sOrange, [this, firstRow]()
+        {
+            RasterizeRows(firstRow, std::min(firstRow + rowsPerJob, height));
+        }, 1);
+    }
+    m_barrier->AddJobs(rowJobs.data(), rowJobs.size());
+
+    JPH::JobHandle setupJob = m_jobSystem.CreateJob("OcclusionSetUp", JPH::Color::sYellow, [this, rowJobs]()
+    {
+        SetUpTriangles();
+        JPH::JobHandle::sRemoveDependencies(rowJobs.data(), rowJobs.size());
+    });
+    m_barrier->AddJob(setupJob);
+}
+
+void SoftwareOcclusionCuller::WaitForRasterization()
+{
+    if (m_barrier == nullptr)
+        return;
+
+    m_jobSystem.WaitForJobs(m_barrier);
+    m_jobSystem.DestroyBarrier(m_barrier);
+    m_barrier = nullptr;
+}
+
+void SoftwareOcclusionCuller::SetUpTriangles()
+{
+    m_screenVertices.clear();
+    for (const JPH::Vec3& position : m_occluderPositions)
+    {
+        JPH::Vec4 clip = m_projViewMatrix * JPH::Vec4(position, 1.0f);
+        float w = clip.GetW();
+        if (w < minW)
+        {
+            m_screenVertices.emplace_back(0.0f, 0.0f, -1.0f);
+            continue;
+        }
+
+        float invW = 1.0f / w;
+        m_screenVertices.emplace_back(
+            (clip.GetX() * invW * 0.5f + 0.5f) * width, (clip.GetY() * invW * 0.5f + 0.5f) * height, invW
+        );
+    }
+
+    m_triangles.clear();
+    for (uint i = 0; i + 2 < m_occluderIndices.size(); i += 3)
+    {
+        const JPH::Float3& v0 = m_screenVertices[m_occluderIndices[i]];
+        const JPH::Float3& v1 = m_screenVertices[m_occluderIndices[i + 1]];
+        const JPH::Float3& v2 = m_screenVertices[m_occluderIndices[i + 2]];
+
+        //Clipping against the near plane would need new vertices, skipping the triangle is simpler and still conservative
+        if (v0.z < 0.0f || v1.z < 0.0f || v2.z < 0.0f)
+            continue;
+
+        //The pixels whose centers (x + 0.5, y + 0.5) are within the bounds of the triangle
+        Triangle triangle;
+        triangle.minX = std::max(static_cast<int>(std::ceil(std::min({v0.x, v1.x, v2.x}) - 0.5f)), 0);
+        triangle.maxX = std::min(static_cast<int>(std::floor(std::max({v0.x, v1.x, v2.x}) - 0.5f)), static_cast<int>(width) - 1);
+        triangle.minY = std::max(static_cast<int>(std::ceil(std::min({v0.y, v1.y, v2.y}) - 0.5f)), 0);
+        triangle.maxY = std::min(static_cast<int>(std::floor(std::max({v0.y, v1.y, v2.y}) - 0.5f)), static_cast<int>(height) - 1);
+        if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+            continue;
+
+        //Edge i is opposite of vertex i, so it is 0 at the other two vertices and twice the signed area at vertex i
+        const JPH::Float3* vertices[3] = {&v0, &v1, &v2};
+        for (uint edge = 0; edge < 3; edge++)
+        {
+            const JPH::Float3& a = *vertices[(edge + 1) % 3];
+            const JPH::Float3& b = *vertices[(edge + 2) % 3];
+            triangle.edgeA[edge] = a.y - b.y;
+            triangle.edgeB[edge] = b.x - a.x;
+            triangle.edgeC[edge] = a.x * b.y - b.x * a.y;
+        }
+
+        float doubleArea = triangle.edgeA[0] * v0.x + triangle.edgeB[0] * v0.y + triangle.edgeC[0];
+        if (std::abs(doubleArea) < 1e-6f)
+            continue;
+
+        //The edges over twice the area are the barycentric coordinates, which interpolate 1 / w
+        float invDoubleArea = 1.0f / doubleArea;
+        triangle.depthA = (triangle.edgeA[0] * v0.z + triangle.edgeA[1] * v1.z + triangle.edgeA[2] * v2.z) * invDoubleArea;
+        triangle.depthB = (triangle.edgeB[0] * v0.z + triangle.edgeB[1] * v1.z + triangle.edgeB[2] * v2.z) * invDoubleArea;
+        triangle.depthC = (triangle.edgeC[0] * v0.z + triangle.edgeC[1] * v1.z + triangle.edgeC[2] * v2.z) * invDoubleArea;
+
+        //Either winding is drawn, so flip the edges of the ones that would be negative inside
+        if (doubleArea < 0.0f)
+        {
+            for (uint edge = 0; edge < 3; edge++)
+            {
+                triangle.edgeA[edge] = -triangle.edgeA[edge];
+                triangle.edgeB[edge] = -triangle.edgeB[edge];
+                triangle.edgeC[edge] = -triangle.edgeC[edge];
+            }
+        }
+
+        m_triangles.push_back(triangle);
+    }
+}
+
+void SoftwareOcclusionCuller::RasterizeRows(uint firstRow, uint endRow)
+{
+    std::fill(m_depth.begin() + firstRow * width, m_depth.begin() + endRow * width, 0.0f);
+
+    const JPH::Vec4 laneOffsets(0.5f, 1.5f, 2.5f, 3.5f); //From x to the centers of the 4 pixels
+    const JPH::Vec4 zero = JPH::Vec4::sZero();
+
+    for (const Triangle& triangle : m_triangles)
+    {
+        int minY = std::max(triangle.minY, static_cast<int>(firstRow));
+        int maxY = std::min(triangle.maxY, static_cast<int>(endRow) - 1);
+
+        JPH::Vec4 edgeA0 = JPH::Vec4::sReplicate(triangle.edgeA[0]);
+        JPH::Vec4 edgeA1 = JPH::Vec4::sReplicate(triangle.edgeA[1]);
+        JPH::Vec4 edgeA2 = JPH::Vec4::sReplicate(triangle.edgeA[2]);
+        JPH::Vec4 depthA = JPH::Vec4::sReplicate(triangle.depthA);
+
+        for (int y = minY; y <= maxY; y++)
+        {
+            float pixelY = y + 0.5f;
+            JPH::Vec4 rowEdge0 = JPH::Vec4::sReplicate(triangle.edgeB[0] * pixelY + triangle.edgeC[0]);
+            JPH::Vec4 rowEdge1 = JPH::Vec4::sReplicate(triangle.edgeB[1] * pixelY + triangle.edgeC[1]);
+            JPH::Vec4 rowEdge2 = JPH::Vec4::sReplicate(triangle.edgeB[2] * pixelY + triangle.edgeC[2]);
+            JPH::Vec4 rowDepth = JPH::Vec4::sReplicate(triangle.depthB * pixelY + triangle.depthC);
+
+            //width is a multiple of 4, so starting on one keeps all 4 pixels on the row
+            for (int x = triangle.minX & ~3; x <= triangle.maxX; x += 4)
+            {
+                JPH::Vec4 pixelX = JPH::Vec4::sReplicate(static_cast<float>(x)) + laneOffsets;
+
+                JPH::UVec4 inside = JPH::UVec4::sAnd(
+                    JPH::UVec4::sAnd(
+                        JPH::Vec4::sGreaterOrEqual(pixelX * edgeA0 + rowEdge0, zero),
+                        JPH::Vec4::sGreaterOrEqual(pixelX * edgeA1 + rowEdge1, zero)
+                    ),
+                    JPH::Vec4::sGreaterOrEqual(pixelX * edgeA2 + rowEdge2, zero)
+                );
+                if (!inside.TestAnyTrue())
+                    continue;
+
+                JPH::Float4* pixels = reinterpret_cast<JPH::Float4*>(&m_depth[y * width + x]);
+                JPH::Vec4 depth = JPH::Vec4::sLoadFloat4(pixels);
+                JPH::Vec4 nearest = JPH::Vec4::sMax(depth, pixelX * depthA + rowDepth);
+                JPH::Vec4::sSelect(depth, nearest, inside).StoreFloat4(pixels);
+            }
+        }
+    }
+}
+
+void SoftwareOcclusionCuller::RemoveOccluded(const AABBCullKernel::Bounds &bounds, std::vector<uint> &meshes)
+{
+    WaitForRasterization();
+
+    std::erase_if(meshes, [&](uint meshIndex) { return IsOccluded(bounds.Get(meshIndex)); });
+}
+
+bool SoftwareOcclusionCuller::IsOccluded(const JPH::AABox &box) const
+{
+    //The screen rect of the box, and the 1 / w of its nearest corner
+    float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+    float nearestInvW = 0.0f;
+
+    for (uint corner = 0; corner < 8; corner++)
+    {
+        JPH::Vec3 position(
+            corner & 1 ? box.mMax.GetX() : box.mMin.GetX(),
+            corner & 2 ? box.mMax.GetY() : box.mMin.GetY(),
+            corner & 4 ? box.mMax.GetZ() : box.mMin.GetZ()
+        );
+
+        JPH::Vec4 clip = m_projViewMatrix * JPH::Vec4(position, 1.0f);
+        if (clip.GetW() < minW)
+            return false; //Too close to the camera to tell, and the occluders near the camera were skipped anyway
+
+        float invW = 1.0f / clip.GetW();
+        float x = (clip.GetX() * invW * 0.5f + 0.5f) * width;
+        float y = (clip.GetY() * invW * 0.5f + 0.5f) * height;
+
+        minX = std::min(minX, x);
+        maxX = std::max(maxX, x);
+        minY = std::min(minY, y);
+        maxY = std::max(maxY, y);
+        nearestInvW = std::max(nearestInvW, invW);
+    }
+
+    //Every pixel the rect touches, not just the ones whose centers it covers
+    int firstX = std::max(static_cast<int>(std::floor(minX)), 0);
+    int lastX = std::min(static_cast<int>(std::ceil(maxX)), static_cast<int>(width)) - 1;
+    int firstY = std::max(static_cast<int>(std::floor(minY)), 0);
+    int lastY = std::min(static_cast<int>(std::ceil(maxY)), static_cast<int>(height)) - 1;
+    if (firstX > lastX || firstY > lastY)
+        return false; //Off screen, that is up to frustum culling
+
+    const JPH::Vec4 laneX(0.0f, 1.0f, 2.0f, 3.0f);
+    const JPH::Vec4 rectMinX = JPH::Vec4::sReplicate(static_cast<float>(firstX));
+    const JPH::Vec4 rectMaxX = JPH::Vec4::sReplicate(static_cast<float>(lastX));
+    const JPH::Vec4 boxDepth = JPH::Vec4::sReplicate(nearestInvW);
+
+    for (int y = firstY; y <= lastY; y++)
+    {
+        for (int x = firstX & ~3; x <= lastX; x += 4)
+        {
+            JPH::Vec4 pixelX = JPH::Vec4::sReplicate(static_cast<float>(x)) + laneX;
+            JPH::UVec4 inRect = JPH::UVec4::sAnd(
+                JPH::Vec4::sGreaterOrEqual(pixelX, rectMinX), JPH::Vec4::sLessOrEqual(pixelX, rectMaxX)
+            );
+
+            //Visible through any pixel whose occluder (if any) is not in front of the box
+            JPH::Vec4 depth = JPH::Vec4::sLoadFloat4(reinterpret_cast<const JPH::Float4*>(&m_depth[y * width + x]));
+            if (JPH::UVec4::sAnd(inRect, JPH::Vec4::sLessOrEqual(depth, boxDepth)).TestAnyTrue())
+                return false;
+        }
+    }
+
+    return true;
+}
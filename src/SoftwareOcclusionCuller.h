@@ -0,0 +1,109 @@
+#ifndef SOFTWAREOCCLUSIONCULLER_H
+#define SOFTWAREOCCLUSIONCULLER_H
+
+#include "Util.h"
+#include "AABBCullKernel.h"
+
+#include <Jolt/Core/JobSystem.h>
+#include <Jolt/Geometry/AABox.h>
+
+#include <array>
+#include <span>
+#include <vector>
+
+/*
+ * Occlusion culling on the CPU, for when the GPU culled draws (and with them the Hi-Z culling of MultiDrawBatch) are not
+ * used. A few large occluder meshes from the static scene are rasterized into a small depth buffer, and the bounds of
+ * the meshes that passed frustum culling are tested against it, so the meshes hidden behind the occluders are not drawn.
+ *
+ * The depth buffer holds 1 / w, which is linear in screen space, and every pixel keeps the nearest occluder. The
+ * rasterizer and the box test work on 4 pixels at a time with JPH::Vec4. A box is occluded when every pixel that it
+ * touches has an occluder in front of the nearest point of the box.
+ *
+ * Rasterize() only queues jobs on the job system: one that transforms and sets up the triangles, and one per band of
+ * rows that rasterizes them. They run on the worker threads while the render thread carries on (and while physics
+ * updates on its own thread), and RemoveOccluded() waits for them.
+ *
+ * The occluders are chosen by FinalizeOccluders() from the meshes given to AddOccluderCandidate(): the largest ones that
+ * are low poly enough, up to a total triangle budget. Only their own triangles are drawn, and the ones that cross the
+ * near plane are skipped, so an occluder never covers more than the mesh it came from and the culling stays conservative.
+ */
+class SoftwareOcclusionCuller
+{
+public:
+    static constexpr uint width = 256; //NOTE: Must be a multiple of 4
+    static constexpr uint height = 144;
+    static constexpr uint rowsPerJob = 16;
+
+    static constexpr uint maxTrianglesPerOccluder = 4096;
+    static constexpr uint maxOccluderTriangles = 32768; //For all of the occluders together
+
+    //Triangles with a vertex closer to the camera than this are skipped, and boxes with a corner closer are visible
+    static constexpr float minW = 0.05f;
+
+private:
+    struct OccluderCandidate
+    {
+        std::vector<JPH::Vec3> positions; //World space
+        std::vector<uint> indices;
+        float surfaceArea; //Of the bounds, how good of an occluder the mesh is likely to be
+    };
+
+    //A triangle set up for rasterizing, the edge functions are positive inside of it
+    struct Triangle
+    {
+        std::array<float, 3> edgeA, edgeB, edgeC; //edge(x, y) = A * x + B * y + C
+        float depthA, depthB, depthC; //1 / w = A * x + B * y + C
+        int minX, maxX, minY, maxY; //The pixels whose centers can be in the triangle, clamped to the screen
+    };
+
+    JPH::JobSystem& m_jobSystem;
+    JPH::JobSystem::Barrier* m_barrier;
+
+    std::vector<OccluderCandidate> m_occluderCandidates; //Freed by FinalizeOccluders()
+    std::vector<JPH::Vec3> m_occluderPositions;
+    std::vector<uint> m_occluderIndices;
+
+    //These are rebuilt every frame, but are kept around to avoid allocating
+    std::vector<JPH::Float3> m_screenVertices; //x, y in pixels and 1 / w, or a negative 1 / w if the vertex is too close
+    std::vector<Triangle> m_triangles;
+    std::vector<float> m_depth;
+
+    JPH::Mat44 m_projViewMatrix;
+    bool m_valid;
+
+    void SetUpTriangles();
+    void RasterizeRows(uint firstRow, uint endRow);
+    void WaitForRasterization();
+
+public:
+    explicit SoftwareOcclusionCuller(JPH::JobSystem& jobSystem);
+    ~SoftwareOcclusionCuller();
+
+    SoftwareOcclusionCuller(const SoftwareOcclusionCuller&) = delete;
+    SoftwareOcclusionCuller& operator=(const SoftwareOcclusionCuller&) = delete;
+
+    //positions are in world space. Must not be called after FinalizeOccluders()
+    void AddOccluderCandidate(std::span<const JPH::Vec3> positions, std::span<const uint> indices);
+
+    //Picks the occluders out of the candidates (within what is left of maxOccluderTriangles) and frees the rest
+    void FinalizeOccluders();
+
+    //Queues the jobs that rasterize the occluders as seen with projViewMatrix, and returns right away
+    void Rasterize(const JPH::Mat44& projViewMatrix);
+
+    //For when the depth buffer would not match the frame (such as when this is turned off and on again)
+    void Invalidate() { m_valid = false; }
+
+    //Waits for Rasterize() to finish, then removes the meshes whose bounds are occluded from meshes
+    void RemoveOccluded(const AABBCullKernel::Bounds& bounds, std::vector<uint>& meshes);
+
+    bool IsOccluded(const JPH::AABox& box) const;
+
+    bool IsValid() const { return m_valid; }
+    uint GetNumOccluderTriangles() const { return m_occluderIndices.size() / 3; }
+};
+
+
+
+#endif //SOFTWAREOCCLUSIONCULLER_H
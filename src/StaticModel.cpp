@@ -5,82 +5,188 @@
 #include "Texture.h"
 #include "Mesh.h"
 
-#include <assimp/Importer.hpp>
-#include <assimp/scene.h>
-#include <assimp/postprocess.h>
-
 #include "FrustumCulling.h"
 
-StaticModel::StaticModel(Renderer &renderer, const std::string &sceneFilepath, Physics &physics, FrustumCuller& frustumCuller, bool processModel)
+#include <algorithm>
+#include <bit>
+
+StaticModel::StaticModel(
+    Renderer &renderer, const std::string &sceneFilepath, Physics &physics, FrustumCuller& frustumCuller,
+    bool processModel /* = true */, SoftwareOcclusionCuller* occlusionCuller /* = nullptr */,
+    JPH::JobSystem* jobSystem /* = nullptr */)
     :   Model(renderer),
         m_physics(physics),
-        m_frustumCuller(frustumCuller)
+        m_frustumCuller(frustumCuller),
+        m_occlusionCuller(occlusionCuller),
+        m_jobSystem(jobSystem)
 {
-    //TODO: BIGGEST HACK OF ALL TIME. If the number of textures exceeds this
-    //then all textures for this model break as the memory of the vector gets reallocated, and so the pointers become invalid
-    //We could heap allocated the textures using unique_pointer but that adds double indirection so this should be good enough
-    m_loadedTextures.reserve(500);
-    Assimp::Importer importer;
-    const aiScene* scene = importer.ReadFile(
-        sceneFilepath,
-        aiProcess_Triangulate | aiProcess_FlipUVs |
-        aiProcess_GenNormals | aiProcess_JoinIdenticalVertices |
-        aiProcess_FindDegenerates | aiProcess_FindInvalidData |
-        aiProcess_OptimizeMeshes
-    );
-
-    ASSERT_LOG(
-        !(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode),
-        "Error with loading model:" << importer.GetErrorString() << " with path " << sceneFilepath
-    );
-
     if (processModel)
-        ProcessNode(scene->mRootNode, scene, sceneFilepath.substr(0, sceneFilepath.find_last_of('/')), JPH::Mat44::sIdentity());
+    {
+        LoadScene(sceneFilepath, physicsPostProcessFlags);
+        m_multiDrawBatch.Finalize();
+
+        if (m_occlusionCuller != nullptr)
+            m_occlusionCuller->FinalizeOccluders();
+    }
 }
 
-void StaticModel::Draw(Shader &shader, const JPH::Mat44 &projectionMatrix, const JPH::Mat44 &viewMatrix)
+//Maps the bodies found by the broadphase query back to the meshes of the model, and keeps the visible ones
+class StaticModel::VisibleMeshCollector : public JPH::CollideShapeBodyCollector
 {
-    JPH::Mat44 LookViewMatrix = JPH::Mat44::sLookAt({0, 13, 0}, {20, 1, 0}, {0, 1, 0});
-    LookViewMatrix = viewMatrix;
-    shader.SetUniform("u_viewMatrix", LookViewMatrix); //TODO: Get rid of the code here that I used to test for frustum culling
+private:
+    StaticModel& m_model;
 
-    std::vector<JPH::BodyID> allBodyIDs(m_objects.size());
-    for (int i = 0; i < m_objects.size(); ++i)
+public:
+    explicit VisibleMeshCollector(StaticModel& model) : m_model(model) {}
+
+    void AddHit(const JPH::BodyID &bodyID) override
     {
-        allBodyIDs[i] = m_objects[i].bodyID;
+        uint bodyIndex = bodyID.GetIndex();
+        if (bodyIndex >= m_model.m_bodyIndexToMesh.size())
+            return;
+
+        //The body can belong to another model, or be the player
+        uint meshIndex = m_model.m_bodyIndexToMesh[bodyIndex];
+        if (meshIndex == noMesh || m_model.m_objects[meshIndex].bodyID != bodyID)
+            return;
+
+        uint64& testedBits = m_model.m_testedMeshMask[meshIndex / 64];
+        uint64 meshBit = uint64(1) << (meshIndex % 64);
+        if (testedBits & meshBit)
+            return;
+        testedBits |= meshBit;
+
+        //Static meshes have their bounds at hand, which is a lot cheaper than locking the body
+        bool visible;
+        if (meshIndex < m_model.m_meshBounds.GetNumBoxes() && !Util::options.preciseShapeCulling)
+        {
+            visible = m_model.m_frustumCuller.IsAABBVisible(m_model.m_meshBounds.Get(meshIndex));
+        }
+        else
+        {
+            JPH::BodyLockRead lock(m_model.m_physics.GetBodyManager(), bodyID);
+            visible = lock.Succeeded() && m_model.m_frustumCuller.IsBodyVisible(lock.GetBody());
+        }
+
+        if (visible)
+            m_model.m_visibleMeshes.push_back(meshIndex);
     }
+};
 
-    std::vector<JPH::BodyID> toDraw = StaticModel::m_frustumCuller.GetVisibleBodies(m_physics.GetBodyManager(), allBodyIDs, viewMatrix, projectionMatrix);
-    //TODO: Fix all of this mess, it makes a performance difference
+void StaticModel::BuildBodyIndexToMesh()
+{
+    m_bodyIndexToMesh.clear();
 
-    auto contains = [&](std::vector<JPH::BodyID> &vector, JPH::BodyID target) -> bool {
-        for (int i = 0; i < vector.size(); ++i)
-        {
-            if (vector[i] == target)
-                return true;
-        }
+    for (uint meshIndex = 0; meshIndex < m_objects.size(); meshIndex++)
+    {
+        uint bodyIndex = m_objects[meshIndex].bodyID.GetIndex();
+        if (bodyIndex >= m_bodyIndexToMesh.size())
+            m_bodyIndexToMesh.resize(bodyIndex + 1, noMesh);
 
-        return false;
-    };
+        m_bodyIndexToMesh[bodyIndex] = meshIndex;
+    }
+}
 
-    //Find which objects we want to draw
-    for (int i = 0; i < allBodyIDs.size(); ++i)
+void StaticModel::FindVisibleMeshes(const JPH::Mat44 &projectionMatrix, const JPH::Mat44 &viewMatrix)
+{
+    FindMeshesInFrustum(projectionMatrix, viewMatrix);
+#ifdef ENABLE_IMGUI
+    m_numInFrustum = m_visibleMeshes.size();
+#endif
+
+    //The occluders only cover static meshes, and RemoveOccluded() needs their bounds
+    bool canOcclusionCull = m_occlusionCuller != nullptr && m_meshBounds.GetNumBoxes() == m_meshes.size();
+    if (Util::options.softwareOcclusionCulling && canOcclusionCull && m_occlusionCuller->IsValid())
+        m_occlusionCuller->RemoveOccluded(m_meshBounds, m_visibleMeshes);
+}
+
+void StaticModel::FindMeshesInFrustum(const JPH::Mat44 &projectionMatrix, const JPH::Mat44 &viewMatrix)
+{
+    //DynamicModel does not fill m_meshBounds, as its meshes move with their bodies
+    if (Util::options.broadPhaseCulling || m_meshBounds.GetNumBoxes() != m_meshes.size())
     {
-        if (contains(toDraw, allBodyIDs[i]))
-            m_objects[i].draw = true;
+        if (m_bodyIndexToMesh.empty())
+            BuildBodyIndexToMesh();
+
+        m_testedMeshMask.assign(AABBCullKernel::GetMaskSize(m_objects.size()), 0);
+        m_visibleMeshes.clear();
+
+        VisibleMeshCollector collector(*this);
+        m_frustumCuller.QueryFrustum(m_physics.GetBroadPhaseQuery(), viewMatrix, projectionMatrix, collector);
+
+        //The slices of the frustum are queried from near to far, sorting keeps the draw order stable from frame to frame
+        std::sort(m_visibleMeshes.begin(), m_visibleMeshes.end());
+        return;
     }
 
-    for (int i = 0; i < m_meshes.size(); ++i)
+    m_frustumCuller.GetVisibleMask(m_meshBounds, viewMatrix, projectionMatrix, m_visibleMeshMask, m_jobSystem);
+
+    m_visibleMeshes.clear();
+    for (uint word = 0; word < m_visibleMeshMask.size(); word++)
     {
-        if (m_objects[i].draw)
-            m_meshes[i].Draw(m_renderer, shader, projectionMatrix * LookViewMatrix);
+        for (uint64 bits = m_visibleMeshMask[word]; bits != 0; bits &= bits - 1)
+            m_visibleMeshes.push_back(word * 64 + std::countr_zero(bits));
     }
+}
+
+void StaticModel::Draw(Shader &shader, const JPH::Mat44 &projectionMatrix, const JPH::Mat44 &viewMatrix)
+{
+    JPH::Mat44 LookViewMatrix = JPH::Mat44::sLookAt({0, 13, 0}, {20, 1, 0}, {0, 1, 0});
+    LookViewMatrix = viewMatrix;
+    m_renderer.SetFrameUniforms(LookViewMatrix, projectionMatrix); //TODO: Get rid of the code here that I used to test for frustum culling
+
+    FindVisibleMeshes(projectionMatrix, viewMatrix);
+    m_lastDraw = LastDraw::meshes;
+    m_lastProjViewMatrix = projectionMatrix * LookViewMatrix;
 
-    for (int i = 0; i < m_objects.size(); ++i)
+    for (uint meshIndex : m_visibleMeshes)
+        m_meshes[meshIndex].Draw(m_renderer, shader, m_lastProjViewMatrix);
+}
+
+void StaticModel::DrawMultiIndirect(Shader &shader, const JPH::Mat44 &projectionMatrix, const JPH::Mat44 &viewMatrix)
+{
+    m_renderer.SetFrameUniforms(viewMatrix, projectionMatrix);
+
+    FindVisibleMeshes(projectionMatrix, viewMatrix);
+    m_lastDraw = LastDraw::multiIndirect;
+    m_multiDrawBatch.Draw(m_renderer, shader, m_visibleMeshes);
+}
+
+void StaticModel::DrawMultiIndirectGPUCulled(
+    Shader &shader, Shader &cullShader, const JPH::Mat44 &projectionMatrix, const JPH::Mat44 &viewMatrix,
+    const HiZBuffer* hiZBuffer /* = nullptr */)
+{
+    m_renderer.SetFrameUniforms(viewMatrix, projectionMatrix);
+    m_multiDrawBatch.DrawGPUCulled(m_renderer, shader, cullShader, hiZBuffer);
+    m_lastDraw = LastDraw::multiIndirectGPUCulled;
+}
+
+void StaticModel::Redraw(Shader &shader)
+{
+    if (m_lastDraw != LastDraw::meshes)
     {
-        m_objects[i].draw = false;
+        m_multiDrawBatch.Redraw(m_renderer, shader);
+        return;
     }
+
+    //Mesh::SelectLod() picks the same level again, as nothing it depends on has changed
+    for (uint meshIndex : m_visibleMeshes)
+        m_meshes[meshIndex].Draw(m_renderer, shader, m_lastProjViewMatrix);
+}
+
+#ifdef ENABLE_IMGUI
+MultiDrawBatch::CullStats StaticModel::GetLastCullStats() const
+{
+    if (m_lastDraw == LastDraw::multiIndirectGPUCulled)
+        return m_multiDrawBatch.GetLastCullStats();
+
+    MultiDrawBatch::CullStats stats;
+    stats.numInFrustum = m_numInFrustum;
+    stats.numVisible = m_visibleMeshes.size();
+    stats.numMeshes = m_meshes.size();
+    return stats;
 }
+#endif
 
 void StaticModel::Draw(Shader &shader, const JPH::Mat44 &projectionMatrix, const JPH::Mat44 &viewMatrix,
     const JPH::Mat44 &modelMatrix)
@@ -93,85 +199,37 @@ void StaticModel::Draw(Shader &shader, const JPH::Mat44 &projectionMatrix, const
         // mesh.Draw(m_renderer, shader, projectionMatrix * JPH::Mat44::sLookAt({0, 13, 0}, {20, 1, 0}, {0, 1, 0}), modelMatrix);
 }
 
-void StaticModel::ProcessNode(aiNode *node, const aiScene *scene, const std::string &directory, const JPH::Mat44& parentTransformation)
+void StaticModel::AddMesh(
+    std::span<const vertexUVNormalPacked> vertices, std::span<const uint> indices, const MeshLods& lods,
+    const std::vector<const Texture*> &textures, bool doubleSided, const JPH::Mat44 &transform)
 {
-    m_meshes.reserve(m_meshes.size() + node->mNumMeshes);
+    //Physics, the batch and the occluders always use the full mesh
+    std::span<const uint> fullIndices = lods.GetIndices(indices, 0);
+    std::vector<JPH::Vec3> positions = GetPositions(vertices);
 
-    aiMatrix4x4 aiLocal = node->mTransformation;
-    JPH::Mat44 local = ConvertAssimpMatrix(aiLocal);
-    JPH::Mat44 globalTransform = parentTransformation * local;
+    //Static objects's mass should not matter
+    m_objects.emplace_back(PhysicsObjectFactory::ConstructStaticMesh(1000, m_physics, positions, fullIndices, transform));
 
-    for (int i = 0; i < node->mNumMeshes; i++)
+    if (m_occlusionCuller != nullptr)
     {
-        aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
-
-        std::vector<vertexUVNormal> vertices;
-        std::vector<uint> indices;
-        std::vector<const Texture*> textures;
-
-        ProcessMesh(mesh, scene, directory, vertices, indices, textures, globalTransform);
-
-        Error error;
-        m_meshes.emplace_back(vertices, indices, textures, globalTransform, error);
+        for (JPH::Vec3& position : positions)
+            position = transform * position;
 
-        HANDLE_ERROR(error,
-            ASSERT_LOG(false, "Unable to process a mesh. Canceling Mesh processing.");
-        );
+        m_occlusionCuller->AddOccluderCandidate(positions, fullIndices);
     }
 
-    for(unsigned int i = 0; i < node->mNumChildren; i++)
-    {
-        ProcessNode(node->mChildren[i], scene, directory, globalTransform);
-    }
+    Model::AddMesh(vertices, indices, lods, textures, doubleSided, transform);
+    m_multiDrawBatch.AddMesh(vertices, fullIndices, textures, doubleSided, transform);
+    m_meshBounds.Add(Mesh::ComputeBounds(vertices).Transformed(transform));
 }
 
-void StaticModel::ProcessMesh(
-    aiMesh *mesh, const aiScene *scene, const std::string &directory,
-    std::vector<vertexUVNormal> &outVertices, std::vector<uint> &outIndices,
-    std::vector<const Texture *> &outTextures, JPH::Mat44 &transform)
+/*static*/ std::vector<JPH::Vec3> StaticModel::GetPositions(std::span<const vertexUVNormalPacked> vertices)
 {
-    aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-
-    outVertices.reserve(mesh->mNumVertices);
-    //Roughly preallocate some memory so that lots of tiny allocations are not made
-    outIndices.reserve(mesh->mFaces[0].mNumIndices * 2);
-    outTextures.reserve(material->GetTextureCount(aiTextureType_DIFFUSE) + material->GetTextureCount(aiTextureType_SPECULAR));
-
     std::vector<JPH::Vec3> positions;
+    positions.reserve(vertices.size());
 
-    for (uint i = 0; i < mesh->mNumVertices; i++)
-    {
-        vertexUVNormal vertex{};
-        vertex.posX = mesh->mVertices[i].x;
-        vertex.posY = mesh->mVertices[i].y;
-        vertex.posZ = mesh->mVertices[i].z;
-
-        vertex.normalX = mesh->mNormals[i].x;
-        vertex.normalY = mesh->mNormals[i].y;
-        vertex.normalZ = mesh->mNormals[i].z;
-
-        if (mesh->mTextureCoords[0])
-        {
-            vertex.texcoordX = mesh->mTextureCoords[0][i].x;
-            vertex.texcoordY = mesh->mTextureCoords[0][i].y;
-        }
-
-        positions.emplace_back(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
-        outVertices.push_back(vertex);
-    }
-
-    for(uint i = 0; i < mesh->mNumFaces; i++)
-    {
-        aiFace face = mesh->mFaces[i];
-        for(uint j = 0; j < face.mNumIndices; j++)
-            outIndices.emplace_back(face.mIndices[j]);
-    }
-
-    outIndices.shrink_to_fit();
-
-    //Static objects's mass should not matter
-    m_objects.emplace_back(PhysicsObjectFactory::ConstructStaticMesh(1000, m_physics, positions, outIndices, transform));
+    for (const vertexUVNormalPacked& vertex : vertices)
+        positions.emplace_back(vertex.posX, vertex.posY, vertex.posZ);
 
-    LoadMaterialTextures(material, aiTextureType_DIFFUSE, Texture::TextureType::diffuse, directory, outTextures);
-    LoadMaterialTextures(material, aiTextureType_SPECULAR, Texture::TextureType::specular, directory, outTextures);
+    return positions;
 }
@@ -3,9 +3,11 @@
 
 #include "FrustumCulling.h"
 #include "Model.h"
+#include "MultiDrawBatch.h"
 
 #include "Physics.h"
 #include "PhysicsObjectFactory.h"
+#include "SoftwareOcclusionCuller.h"
 
 /*
  * This model is intended as a way to add model meshes to the physics engine. Use normal model if you do not want the
@@ -16,34 +18,112 @@ class StaticModel : public Model
 protected:
 
     /**
-     * This function is the same as the prent ProcessNode function but it now calls the overridden ProcessMesh function,
-     * so that it can pass along the model matrix
+     * Adds the mesh to the physics engine (with StaticObjectFactory) and to the multi draw batch, and then does the
+     * same as the parent AddMesh function
      */
-    virtual void ProcessNode(aiNode* node, const aiScene* scene, const std::string &directory, const JPH::Mat44& parentTransformation) override;
+    virtual void AddMesh(
+        std::span<const vertexUVNormalPacked> vertices, std::span<const uint> indices, const MeshLods& lods,
+        const std::vector<const Texture*>& textures, bool doubleSided, const JPH::Mat44& transform
+    ) override;
+
+    //The positions of the vertices, for building the physics shapes
+    static std::vector<JPH::Vec3> GetPositions(std::span<const vertexUVNormalPacked> vertices);
 
     /**
-     * This function is the same as the parent ProcessMesh function but uses StaticObjectFactory to add the meshes to
-     * the physics engine
+     * Frustum culls the meshes and fills m_visibleMeshes with the indices of the meshes that should be drawn this frame.
+     * With Util::options.broadPhaseCulling (or when the meshes can move) the physics broadphase is queried, so only the
+     * bodies near the frustum are tested. Otherwise the world space bounds of all meshes are tested at once (see AABBCullKernel).
+     * With Util::options.softwareOcclusionCulling the meshes hidden behind the occluders are removed afterwards
      */
-    virtual void ProcessMesh(
-        aiMesh* mesh, const aiScene* scene, const std::string &directory,
-        std::vector<vertexUVNormal> &outVertices,
-        std::vector<uint> &outIndices,
-        std::vector<const Texture*> &outTextures,
-        JPH::Mat44 &transform
-    );
+    void FindVisibleMeshes(const JPH::Mat44& projectionMatrix, const JPH::Mat44& viewMatrix);
 
     Physics& m_physics;
     std::vector<PhysicsObjectFactory::Object> m_objects;
     FrustumCuller& m_frustumCuller;
+    SoftwareOcclusionCuller* m_occlusionCuller; //Can be nullptr
+    JPH::JobSystem* m_jobSystem; //Splits the culling of large models over worker threads, can be nullptr
+
+    MultiDrawBatch m_multiDrawBatch; //Holds a copy of every mesh in m_meshes, in the same order
+    //These are rebuilt every frame, but are kept around to avoid allocating
+    std::vector<uint> m_visibleMeshes;
+    std::vector<uint64> m_visibleMeshMask;
+#ifdef ENABLE_IMGUI
+    uint m_numInFrustum = 0; //Before occlusion culling
+#endif
+
+    //Which of the Draw functions was called last, and with what matrix, for Redraw()
+    enum class LastDraw : uint8
+    {
+        meshes,
+        multiIndirect,
+        multiIndirectGPUCulled,
+    };
+
+    LastDraw m_lastDraw = LastDraw::meshes;
+    JPH::Mat44 m_lastProjViewMatrix = JPH::Mat44::sIdentity();
+
+    AABBCullKernel::Bounds m_meshBounds; //World space, one per mesh in m_meshes. The meshes never move, so this is built once
+
+private:
+    class VisibleMeshCollector;
+
+    static constexpr uint noMesh = ~0u;
+
+    //Maps BodyID::GetIndex() to the index of the mesh with that body (or noMesh), built the first time it is needed
+    std::vector<uint> m_bodyIndexToMesh;
+    std::vector<uint64> m_testedMeshMask; //The broadphase query can find a body more than once
+
+    void BuildBodyIndexToMesh();
+    void FindMeshesInFrustum(const JPH::Mat44& projectionMatrix, const JPH::Mat44& viewMatrix);
 
 public:
-    StaticModel(Renderer& renderer, const std::string& sceneFilepath, Physics& physics, FrustumCuller& frustumCuller, bool processModel = true);
+    //NOTE: Changing these rebuilds the mesh caches, as the flags are part of the cache
+    static constexpr uint physicsPostProcessFlags =
+        aiProcess_Triangulate | aiProcess_FlipUVs |
+        aiProcess_GenNormals | aiProcess_JoinIdenticalVertices |
+        aiProcess_FindDegenerates | aiProcess_FindInvalidData |
+        aiProcess_OptimizeMeshes;
+
+    //The meshes are offered to occlusionCuller as occluders, and are occlusion culled with it.
+    //jobSystem must not be the one of Physics, which is single threaded and busy with the physics update while we draw
+    StaticModel(
+        Renderer& renderer, const std::string& sceneFilepath, Physics& physics, FrustumCuller& frustumCuller,
+        bool processModel = true, SoftwareOcclusionCuller* occlusionCuller = nullptr, JPH::JobSystem* jobSystem = nullptr
+    );
     virtual void Draw(Shader& shader, const JPH::Mat44& projectionMatrix, const JPH::Mat44& viewMatrix) override;
     virtual void Draw(
         Shader& shader, const JPH::Mat44& projectionMatrix,
         const JPH::Mat44& viewMatrix, const JPH::Mat44& modelMatrix
     ) override;
+
+    /**
+     * Same as Draw(shader, projectionMatrix, viewMatrix) but draws all visible meshes from one merged vertex/index buffer
+     * with one glMultiDrawElementsIndirect call per texture set. The shader must have the INSTANCING feature
+     * (ModelVertex.glsl), see MultiDrawBatch.
+     */
+    void DrawMultiIndirect(Shader& shader, const JPH::Mat44& projectionMatrix, const JPH::Mat44& viewMatrix);
+
+    /**
+     * Same as DrawMultiIndirect(), but the meshes are frustum culled on the GPU by cullShader (FrustumCullCompute.glsl)
+     * instead of against their physics bodies on the CPU. With a valid hiZBuffer they are occlusion culled as well
+     */
+    void DrawMultiIndirectGPUCulled(
+        Shader& shader, Shader& cullShader, const JPH::Mat44& projectionMatrix, const JPH::Mat44& viewMatrix,
+        const HiZBuffer* hiZBuffer = nullptr
+    );
+
+    /**
+     * Draws the meshes that the last Draw(shader, projectionMatrix, viewMatrix), DrawMultiIndirect() or
+     * DrawMultiIndirectGPUCulled() drew again with another shader (which must read the same buffers as the shader of that
+     * draw), without culling them again. Used for the lighting pass after a depth pre-pass, which must draw exactly the same
+     * triangles to pass the GL_EQUAL depth test
+     */
+    void Redraw(Shader& shader);
+
+#ifdef ENABLE_IMGUI
+    //What the last draw culled. The GPU culled draws report theirs a few frames late, see MultiDrawBatch::GetLastCullStats()
+    MultiDrawBatch::CullStats GetLastCullStats() const;
+#endif
 };
 
 
@@ -0,0 +1,60 @@
+#include "StreamBuffer.h"
+
+StreamBuffer::StreamBuffer(uint target, uint regionSize)
+	:	m_buffer(target),
+		m_mapping(nullptr),
+		m_regionSize(regionSize),
+		m_region(0),
+		m_usedSize(0),
+		m_fences()
+{
+	constexpr uint mapFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	uint bufferSize = regionSize * numRegions;
+
+	m_buffer.InitStorage(nullptr, bufferSize, mapFlags);
+	m_mapping = static_cast<uint8*>(m_buffer.Map(0, bufferSize, mapFlags));
+
+	ASSERT_LOG(m_mapping != nullptr, "Unable to persistently map a stream buffer of " << bufferSize << " bytes");
+}
+
+StreamBuffer::~StreamBuffer()
+{
+	for (GLsync fence : m_fences)
+		glDeleteSync(fence);
+}
+
+void StreamBuffer::BeginFrame()
+{
+	m_region = (m_region + 1) % numRegions;
+	m_usedSize = 0;
+
+	GLsync& fence = m_fences[m_region];
+	if (fence != nullptr)
+	{
+		//This should almost never actually wait, as the region was last used numRegions frames ago
+		while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1'000'000) == GL_TIMEOUT_EXPIRED)
+		{}
+
+		glDeleteSync(fence);
+		fence = nullptr;
+	}
+}
+
+void StreamBuffer::EndFrame()
+{
+	m_fences[m_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+StreamBuffer::Allocation StreamBuffer::Allocate(uint size, uint alignment /* = 16 */)
+{
+	ASSERT_LOG(std::has_single_bit(alignment), "The alignment of a stream buffer allocation must be a power of 2, not " << alignment);
+
+	uint start = (m_usedSize + alignment - 1) & ~(alignment - 1);
+	if (start + size > m_regionSize)
+		return {nullptr, 0};
+
+	m_usedSize = start + size;
+
+	uint offset = GetRegionOffset() + start;
+	return {m_mapping + offset, offset};
+}
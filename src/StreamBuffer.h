@@ -0,0 +1,65 @@
+#ifndef STREAMBUFFER_H
+#define STREAMBUFFER_H
+
+#include "Util.h"
+
+#include "Buffer.h"
+
+/*
+ * A buffer for data that the CPU writes every frame, such as debug geometry and per frame uniforms. It is split into one
+ * region per frame in flight, and the whole buffer is persistently mapped (GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT),
+ * so writing to it is a memcpy into the mapping. Nothing is reallocated and the driver never has to copy or wait.
+ *
+ * Allocate() hands out consecutive ranges of the current frame's region. EndFrame() puts a fence after the frame's
+ * commands, and BeginFrame() moves on to the next region, waiting on the fence of the frame that last used it first.
+ */
+class StreamBuffer
+{
+public:
+	static constexpr uint numRegions = 3;
+
+	struct Allocation
+	{
+		void* data; //Null if the region is full
+		uint offset; //In bytes from the start of the buffer, for BindRange() or as a vertex buffer offset
+	};
+
+private:
+	Buffer m_buffer;
+	uint8* m_mapping;
+
+	uint m_regionSize;
+	uint m_region;
+	uint m_usedSize; //Of the current region
+
+	GLsync m_fences[numRegions];
+
+public:
+	//target is only used to create the buffer, the ranges can be bound to any target
+	StreamBuffer(uint target, uint regionSize);
+	~StreamBuffer();
+
+	StreamBuffer(const StreamBuffer&) = delete; //No copying!!! Leads to use after free issues
+	StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+	//Must be called at the start and end of every frame, Renderer does this for the buffers it owns
+	void BeginFrame();
+	void EndFrame();
+
+	//alignment must be a power of 2, such as GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT for ranges that are bound as uniforms
+	Allocation Allocate(uint size, uint alignment = 16);
+
+	//For data that is indexed from the start of the region instead of allocated, such as Renderer's object uniforms
+	void* GetRegionData() const { return m_mapping + GetRegionOffset(); }
+	uint GetRegionOffset() const { return m_region * m_regionSize; }
+	uint GetRegionSize() const { return m_regionSize; }
+
+	uint GetUsedSize() const { return m_usedSize; }
+
+	const Buffer& GetBuffer() const { return m_buffer; }
+	uint GetRendererID() const { return m_buffer.GetRendererID(); }
+};
+
+
+
+#endif //STREAMBUFFER_H
@@ -1,8 +1,11 @@
 #include "Texture.h"
+#include "TextureArray.h"
 #include <stb_image/stb_image.h>
 
 Texture::Texture()
 	:	m_rendererID(-1),
+		m_layer(0),
+		m_ownsTexture(false),
 		m_width(0),
 		m_height(0),
 		m_bytesPerPixel(0),
@@ -12,6 +15,8 @@ Texture::Texture()
 
 Texture::Texture(const std::string &path, TextureType texType, bool flipVertically, bool mip)
 	:	m_rendererID(-1),
+		m_layer(0),
+		m_ownsTexture(false),
 		m_width(0),
 		m_height(0),
 		m_bytesPerPixel(0)
@@ -21,7 +26,8 @@ Texture::Texture(const std::string &path, TextureType texType, bool flipVertical
 
 Texture::~Texture()
 {
-	glDeleteTextures(1, &m_rendererID);
+	if (m_ownsTexture)
+		glDeleteTextures(1, &m_rendererID);
 	m_rendererID = -1; //Yes this wraps around
 }
 
@@ -29,30 +35,32 @@ void Texture::Init(const std::string &path, TextureType texType, bool flipVertic
 {
 	m_filepath = path;
 	m_texType = texType;
+	m_layer = 0;
+	m_ownsTexture = true;
 
 	stbi_set_flip_vertically_on_load(flipVertically);
 	unsigned char* buffer = stbi_load(path.c_str(), &m_width, &m_height, &m_bytesPerPixel, 4);
 
-	glGenTextures(1, &m_rendererID);
-	glBindTexture(GL_TEXTURE_2D, m_rendererID);
+	glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &m_rendererID);
 
 	if (mip)
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTextureParameteri(m_rendererID, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 	else
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTextureParameteri(m_rendererID, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTextureParameteri(m_rendererID, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTextureParameteri(m_rendererID, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTextureParameteri(m_rendererID, GL_TEXTURE_WRAP_T, GL_REPEAT);
 
 	if (buffer)
 	{
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, m_width, m_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, buffer);
+		uint numLevels = mip ? TextureArray::GetNumMipLevels(m_width, m_height) : 1;
+		glTextureStorage3D(m_rendererID, numLevels, GL_RGBA8, m_width, m_height, 1);
+		glTextureSubImage3D(m_rendererID, 0, 0, 0, 0, m_width, m_height, 1, GL_RGBA, GL_UNSIGNED_BYTE, buffer);
 
 		if (mip)
-			glGenerateMipmap(GL_TEXTURE_2D);
+			glGenerateTextureMipmap(m_rendererID);
 
-		glBindTexture(GL_TEXTURE_2D, 0);
 		stbi_image_free(buffer);
 	}
 	else
@@ -63,16 +71,28 @@ void Texture::Init(const std::string &path, TextureType texType, bool flipVertic
 	}
 }
 
+void Texture::InitAsLayer(uint arrayRendererID, uint layer, int width, int height, const std::string& path, TextureType texType)
+{
+	m_rendererID = arrayRendererID;
+	m_layer = layer;
+	m_ownsTexture = false;
+
+	m_width = width;
+	m_height = height;
+	m_bytesPerPixel = 4;
+
+	m_filepath = path;
+	m_texType = texType;
+}
+
 void Texture::Bind(uint slot /* = 0 */) const
 {
-	//We can add to get to the correct slot because the #defines in opengl are consecutive integers
-	glActiveTexture(GL_TEXTURE0 + slot);
-	glBindTexture(GL_TEXTURE_2D, m_rendererID);
+	glBindTextureUnit(slot, m_rendererID);
 }
 
 void Texture::Unbind() const
 {
-	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindTextureUnit(0, 0);
 }
 
 std::string Texture::ConvertTextureTypeToString(TextureType texType)
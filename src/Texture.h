@@ -3,6 +3,10 @@
 
 #include "Util.h"
 
+/*
+ * Every texture is a layer of a GL_TEXTURE_2D_ARRAY, so that the shaders only need one kind of sampler. A texture either
+ * owns a single layer array (Init), or refers to a layer of a TextureArray that it does not own (InitAsLayer).
+ */
 class Texture {
 public:
 	enum class TextureType : int8
@@ -14,6 +18,8 @@ public:
 
 private:
 	uint m_rendererID;
+	uint m_layer;
+	bool m_ownsTexture;
 
 	int m_width, m_height;
 	int m_bytesPerPixel;
@@ -30,11 +36,16 @@ public:
 
 	void Init(const std::string& path, TextureType texType = TextureType::diffuse, bool flipVertically = false, bool mip = true);
 
+	//Makes this texture refer to a layer of a TextureArray, which must outlive it
+	void InitAsLayer(uint arrayRendererID, uint layer, int width, int height, const std::string& path, TextureType texType);
+
 	void Bind(uint slot = 0) const;
 	void Unbind() const;
 
 	int GetWidth() const { return m_width; }
 	int GetHeight() const { return m_height; }
+	uint GetRendererID() const { return m_rendererID; }
+	uint GetLayer() const { return m_layer; }
 	TextureType GetType() const { return m_texType; }
 	std::string GetFilePath() const { return m_filepath; }
 
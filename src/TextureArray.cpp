@@ -0,0 +1,122 @@
+#include "TextureArray.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+TextureArray::TextureArray(int width, int height, CompressedTexture::Format format /* = rgba8 */, bool mip /* = true */)
+	:	m_rendererID(0),
+		m_width(width),
+		m_height(height),
+		m_mip(mip),
+		m_format(format),
+		m_numLevels(mip ? GetNumMipLevels(width, height) : 1),
+		m_uploaded(false),
+		m_loader(nullptr),
+		m_loaderBatchID(0)
+{
+	glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &m_rendererID);
+}
+
+TextureArray::~TextureArray()
+{
+	//Otherwise the loader might upload into a deleted texture (or another texture that was given the same name)
+	if (m_loader != nullptr)
+		m_loader->CancelBatch(m_loaderBatchID);
+
+	glDeleteTextures(1, &m_rendererID);
+	m_rendererID = 0;
+}
+
+TextureArray::TextureArray(TextureArray&& other) noexcept
+	:	m_rendererID(other.m_rendererID),
+		m_width(other.m_width),
+		m_height(other.m_height),
+		m_mip(other.m_mip),
+		m_format(other.m_format),
+		m_numLevels(other.m_numLevels),
+		m_layerPaths(std::move(other.m_layerPaths)),
+		m_uploaded(other.m_uploaded),
+		m_loader(other.m_loader),
+		m_loaderBatchID(other.m_loaderBatchID)
+{
+	other.m_rendererID = 0;
+	other.m_loader = nullptr;
+}
+
+uint TextureArray::AddLayer(const std::string& path, uint numLevels /* = max */)
+{
+	ASSERT_LOG(!m_uploaded, "Layers can not be added to a TextureArray after it has been uploaded");
+	ASSERT_LOG(numLevels > 0, "A layer must have at least one level");
+
+	m_numLevels = std::min(m_numLevels, numLevels);
+	m_layerPaths.push_back(path);
+	return m_layerPaths.size() - 1;
+}
+
+void TextureArray::Upload(TextureLoader& loader)
+{
+	ASSERT_LOG(!m_uploaded, "TextureArray has already been uploaded");
+	m_uploaded = true;
+
+	if (m_layerPaths.empty())
+		return;
+
+	int maxLayers = 0;
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+	ASSERT_LOG(m_layerPaths.size() <= static_cast<size_t>(maxLayers), "Too many layers in texture array: " << m_layerPaths.size() << " max: " << maxLayers);
+
+	glTextureParameteri(m_rendererID, GL_TEXTURE_MIN_FILTER, m_numLevels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTextureParameteri(m_rendererID, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTextureParameteri(m_rendererID, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTextureParameteri(m_rendererID, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+	glTextureStorage3D(m_rendererID, m_numLevels, CompressedTexture::GetGLInternalFormat(m_format), m_width, m_height, m_layerPaths.size());
+
+	FillWithPlaceholder();
+
+	m_loader = &loader;
+	m_loaderBatchID = loader.CreateBatch();
+
+	for (uint layer = 0; layer < m_layerPaths.size(); layer++)
+		loader.Load(m_loaderBatchID, m_rendererID, layer, m_width, m_height, m_numLevels, m_format, m_layerPaths[layer]);
+}
+
+void TextureArray::FillWithPlaceholder()
+{
+	const uint8* placeholder = CompressedTexture::GetPlaceholderBlock(m_format);
+
+	if (m_format == CompressedTexture::Format::rgba8)
+	{
+		for (uint level = 0; level < m_numLevels; level++)
+			glClearTexImage(m_rendererID, level, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+
+		return;
+	}
+
+	//Compressed textures can not be cleared, so the placeholder block is repeated over one layer and uploaded layer by layer
+	uint blockSize = CompressedTexture::GetBlockSize(m_format);
+	std::vector<uint8> blocks(CompressedTexture::GetLevelSize(m_format, m_width, m_height));
+	for (uint64 offset = 0; offset < blocks.size(); offset += blockSize)
+		std::memcpy(blocks.data() + offset, placeholder, blockSize);
+
+	uint internalFormat = CompressedTexture::GetGLInternalFormat(m_format);
+	int width = m_width;
+	int height = m_height;
+
+	for (uint level = 0; level < m_numLevels; level++)
+	{
+		uint64 levelSize = CompressedTexture::GetLevelSize(m_format, width, height);
+
+		for (uint layer = 0; layer < m_layerPaths.size(); layer++)
+			glCompressedTextureSubImage3D(m_rendererID, level, 0, 0, layer, width, height, 1, internalFormat, levelSize, blocks.data());
+
+		width = std::max(width / 2, 1);
+		height = std::max(height / 2, 1);
+	}
+}
+
+/*static*/ uint TextureArray::GetNumMipLevels(int width, int height)
+{
+	return std::bit_width(static_cast<uint>(std::max(width, height)));
+}
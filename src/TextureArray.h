@@ -0,0 +1,74 @@
+#ifndef TEXTUREARRAY_H
+#define TEXTUREARRAY_H
+
+#include "Util.h"
+
+#include "CompressedTexture.h"
+#include "TextureLoader.h"
+
+#include <limits>
+#include <string>
+#include <vector>
+
+/*
+ * A GL_TEXTURE_2D_ARRAY that textures of the same size are packed into, so that meshes with different textures can
+ * share one texture binding and only differ in the layer they sample.
+ *
+ * The texture name exists as soon as the array is constructed, so Texture objects can refer to their layer right away,
+ * but no storage is allocated until Upload() is called, because the number of layers is not known until then.
+ *
+ * The images themselves are loaded asynchronously by a TextureLoader. Until a layer is resident it holds a placeholder.
+ *
+ * Every layer has to be in the same format, so cooked (block compressed) textures go into different arrays than the
+ * png/jpeg ones, even if they are the same size.
+ */
+class TextureArray
+{
+private:
+	uint m_rendererID;
+
+	int m_width, m_height;
+	bool m_mip;
+	CompressedTexture::Format m_format;
+	uint m_numLevels;
+
+	std::vector<std::string> m_layerPaths;
+	bool m_uploaded;
+
+	TextureLoader* m_loader;
+	uint64 m_loaderBatchID;
+
+	void FillWithPlaceholder();
+
+public:
+	TextureArray(int width, int height, CompressedTexture::Format format = CompressedTexture::Format::rgba8, bool mip = true);
+	~TextureArray();
+
+	TextureArray(const TextureArray&) = delete; //No copying!!! Leads to use after free issues
+	TextureArray& operator=(const TextureArray&) = delete;
+
+	TextureArray(TextureArray&& other) noexcept;
+
+	/*
+	 * Returns the layer the image will be in. The image is not loaded until Upload() is called.
+	 * Cooked textures might not have the whole mip chain, so numLevels limits the levels of the whole array.
+	 */
+	uint AddLayer(const std::string& path, uint numLevels = std::numeric_limits<uint>::max());
+
+	//Allocates the storage for all layers and fills it with a placeholder, then queues every image to be loaded by loader
+	void Upload(TextureLoader& loader);
+
+	uint GetRendererID() const { return m_rendererID; }
+	int GetWidth() const { return m_width; }
+	int GetHeight() const { return m_height; }
+	uint GetNumLayers() const { return m_layerPaths.size(); }
+	bool IsUploaded() const { return m_uploaded; }
+	CompressedTexture::Format GetFormat() const { return m_format; }
+	uint GetNumLevels() const { return m_numLevels; }
+
+	static uint GetNumMipLevels(int width, int height);
+};
+
+
+
+#endif //TEXTUREARRAY_H
@@ -0,0 +1,213 @@
+#include "TextureLoader.h"
+#include <stb_image/stb_image.h>
+
+#include <algorithm>
+#include <cstring>
+
+TextureLoader::TextureLoader()
+	:	m_pixelUnpackBuffer(GL_PIXEL_UNPACK_BUFFER)
+{
+	uint numWorkers = std::clamp(std::thread::hardware_concurrency() / 2, 1u, 8u);
+
+	m_workers.reserve(numWorkers);
+	for (uint i = 0; i < numWorkers; i++)
+		m_workers.emplace_back(&TextureLoader::WorkerThread, this);
+}
+
+TextureLoader::~TextureLoader()
+{
+	{
+		std::lock_guard lock(m_mutex);
+		m_stop = true;
+	}
+
+	m_jobAvailable.notify_all();
+
+	for (std::thread& worker : m_workers)
+		worker.join();
+}
+
+uint64 TextureLoader::CreateBatch()
+{
+	return m_nextBatchID++;
+}
+
+void TextureLoader::CancelBatch(uint64 batchID)
+{
+	std::lock_guard lock(m_mutex);
+
+	std::erase_if(m_jobs, [batchID](const DecodeJob& job) { return job.batchID == batchID; });
+	std::erase_if(m_decodedImages, [batchID](const DecodedImage& image) { return image.batchID == batchID; });
+
+	//A worker might be decoding an image from this batch right now
+	m_cancelledBatches.insert(batchID);
+}
+
+void TextureLoader::Load(
+	uint64 batchID, uint textureID, uint layer, int width, int height, uint numLevels,
+	CompressedTexture::Format format, const std::string& path)
+{
+	{
+		std::lock_guard lock(m_mutex);
+		m_jobs.push_back({batchID, textureID, layer, width, height, numLevels, format, path});
+	}
+
+	m_jobAvailable.notify_one();
+}
+
+uint TextureLoader::GetNumPending()
+{
+	std::lock_guard lock(m_mutex);
+	return m_jobs.size() + m_numJobsInFlight + m_decodedImages.size();
+}
+
+void TextureLoader::WorkerThread()
+{
+	while (true)
+	{
+		DecodeJob job;
+		{
+			std::unique_lock lock(m_mutex);
+			m_jobAvailable.wait(lock, [this] { return m_stop || !m_jobs.empty(); });
+
+			if (m_stop)
+				return;
+
+			job = std::move(m_jobs.front());
+			m_jobs.pop_front();
+			m_numJobsInFlight++;
+		}
+
+		DecodedImage image;
+		bool decoded = Decode(job, image);
+
+		std::lock_guard lock(m_mutex);
+		m_numJobsInFlight--;
+
+		if (decoded && !m_cancelledBatches.contains(job.batchID))
+			m_decodedImages.push_back(std::move(image));
+	}
+}
+
+/*static*/ bool TextureLoader::Decode(const DecodeJob& job, DecodedImage& outImage)
+{
+	if (job.format != CompressedTexture::Format::rgba8)
+		return ReadCompressed(job, outImage);
+
+	int width, height, bytesPerPixel;
+
+	//stbi_set_flip_vertically_on_load is global state, so the thread safe version has to be used here
+	stbi_set_flip_vertically_on_load_thread(false);
+	unsigned char* buffer = stbi_load(job.path.c_str(), &width, &height, &bytesPerPixel, 4);
+
+	if (!buffer)
+	{
+		std::cerr << "[ERROR, TextureLoader.cpp, Decode] Failed to load texture with path: \"" << job.path << "\"" << std::endl;
+		std::cerr << "STBI Error message: " << stbi_failure_reason() << std::endl;
+		return false;
+	}
+
+	if (width != job.width || height != job.height)
+	{
+		std::cerr << "[ERROR, TextureLoader.cpp, Decode] Texture \"" << job.path << "\" does not match the size of its texture" << std::endl;
+		stbi_image_free(buffer);
+		return false;
+	}
+
+	outImage.batchID = job.batchID;
+	outImage.textureID = job.textureID;
+	outImage.layer = job.layer;
+	outImage.width = width;
+	outImage.height = height;
+	outImage.numLevels = job.numLevels;
+	outImage.format = CompressedTexture::Format::rgba8;
+
+	outImage.pixels.assign(buffer, buffer + static_cast<uint64>(width) * height * 4);
+	stbi_image_free(buffer);
+
+	CompressedTexture::GenerateMipChain(outImage.pixels, width, height, job.numLevels);
+	return true;
+}
+
+/*static*/ bool TextureLoader::ReadCompressed(const DecodeJob& job, DecodedImage& outImage)
+{
+	CompressedTexture::Info info;
+	if (!CompressedTexture::Load(job.path, info, outImage.pixels))
+		return false;
+
+	if (info.format != job.format || info.width != job.width || info.height != job.height || info.numLevels < job.numLevels)
+	{
+		std::cerr << "[ERROR, TextureLoader.cpp, ReadCompressed] Texture \"" << job.path << "\" does not match the format, size or number of levels of its texture" << std::endl;
+		return false;
+	}
+
+	outImage.batchID = job.batchID;
+	outImage.textureID = job.textureID;
+	outImage.layer = job.layer;
+	outImage.width = job.width;
+	outImage.height = job.height;
+	outImage.numLevels = job.numLevels;
+	outImage.format = job.format;
+
+	//Levels past the ones the texture has storage for are dropped
+	outImage.pixels.resize(CompressedTexture::GetMipChainSize(job.format, job.width, job.height, job.numLevels));
+	return true;
+}
+
+void TextureLoader::UploadFinished()
+{
+	uint uploadedBytes = 0;
+
+	while (uploadedBytes < maxUploadBytesPerFrame)
+	{
+		DecodedImage image;
+		{
+			std::lock_guard lock(m_mutex);
+			if (m_decodedImages.empty())
+				break;
+
+			image = std::move(m_decodedImages.front());
+			m_decodedImages.pop_front();
+		}
+
+		UploadImage(image);
+		uploadedBytes += image.pixels.size();
+	}
+}
+
+void TextureLoader::UploadImage(const DecodedImage& image)
+{
+	//The buffer is orphaned by SetData, so we never wait for the GPU to finish reading the previous image
+	m_pixelUnpackBuffer.SetData(image.pixels.data(), image.pixels.size(), GL_STREAM_DRAW);
+
+	uint64 offset = 0;
+	int width = image.width;
+	int height = image.height;
+
+	for (uint level = 0; level < image.numLevels; level++)
+	{
+		uint64 levelSize = CompressedTexture::GetLevelSize(image.format, width, height);
+
+		//With a pixel unpack buffer bound, the data pointer is an offset into the buffer
+		if (image.format == CompressedTexture::Format::rgba8)
+		{
+			glTextureSubImage3D(
+				image.textureID, level, 0, 0, image.layer, width, height, 1,
+				GL_RGBA, GL_UNSIGNED_BYTE, reinterpret_cast<const void*>(offset)
+			);
+		}
+		else
+		{
+			glCompressedTextureSubImage3D(
+				image.textureID, level, 0, 0, image.layer, width, height, 1,
+				CompressedTexture::GetGLInternalFormat(image.format), levelSize, reinterpret_cast<const void*>(offset)
+			);
+		}
+
+		offset += levelSize;
+		width = std::max(width / 2, 1);
+		height = std::max(height / 2, 1);
+	}
+
+	m_pixelUnpackBuffer.Unbind();
+}
@@ -0,0 +1,103 @@
+#ifndef TEXTURELOADER_H
+#define TEXTURELOADER_H
+
+#include "Util.h"
+
+#include "Buffer.h"
+#include "CompressedTexture.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+/*
+ * Decodes images (and builds their mip chains) on worker threads, then uploads them into texture array layers on the
+ * GL thread through a pixel unpack buffer. Nothing here blocks on image decoding.
+ *
+ * Cooked textures (see CompressedTexture) are read the same way, but they already hold every mip level as compressed
+ * blocks, so the workers only have to read the file.
+ *
+ * Textures are expected to already have immutable storage filled with a placeholder (see TextureArray::Upload()), so
+ * they can be drawn right away and the real image just replaces the placeholder once it is resident.
+ */
+class TextureLoader
+{
+public:
+	static constexpr uint maxUploadBytesPerFrame = 32 * 1024 * 1024; //Stops one frame from getting all of the uploads
+
+private:
+	struct DecodeJob
+	{
+		uint64 batchID;
+		uint textureID;
+		uint layer;
+		int width, height;
+		uint numLevels;
+		CompressedTexture::Format format;
+		std::string path;
+	};
+
+	struct DecodedImage
+	{
+		uint64 batchID;
+		uint textureID;
+		uint layer;
+		int width, height;
+		uint numLevels;
+		CompressedTexture::Format format;
+		std::vector<uint8> pixels; //Every mip level, one after the other
+	};
+
+	std::vector<std::thread> m_workers;
+
+	std::mutex m_mutex;
+	std::condition_variable m_jobAvailable;
+	std::deque<DecodeJob> m_jobs;
+	std::deque<DecodedImage> m_decodedImages;
+	std::unordered_set<uint64> m_cancelledBatches;
+	uint m_numJobsInFlight = 0;
+	bool m_stop = false;
+
+	uint64 m_nextBatchID = 1;
+
+	Buffer m_pixelUnpackBuffer;
+
+	void WorkerThread();
+	static bool Decode(const DecodeJob& job, DecodedImage& outImage);
+	static bool ReadCompressed(const DecodeJob& job, DecodedImage& outImage);
+
+	void UploadImage(const DecodedImage& image);
+
+public:
+	TextureLoader();
+	~TextureLoader();
+
+	TextureLoader(const TextureLoader&) = delete;
+	TextureLoader& operator=(const TextureLoader&) = delete;
+
+	//A batch groups the layers of one texture array, so that they can all be cancelled if the array is destroyed
+	uint64 CreateBatch();
+	void CancelBatch(uint64 batchID);
+
+	/*
+	 * The texture must already have storage for numLevels levels of width x height in the given format. For rgba8 the
+	 * path is any image stb_image can load, otherwise it is a cooked DDS or KTX2 file with at least numLevels levels
+	 */
+	void Load(
+		uint64 batchID, uint textureID, uint layer, int width, int height, uint numLevels,
+		CompressedTexture::Format format, const std::string& path
+	);
+
+	//Called once a frame on the GL thread, uploads the images that have finished decoding
+	void UploadFinished();
+
+	uint GetNumPending();
+};
+
+
+
+#endif //TEXTURELOADER_H
@@ -19,9 +19,15 @@
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <unordered_map>
 #include <string>
+#include <vector>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -75,10 +81,30 @@ struct vertexUVNormal
 	float normalY;
 	float normalZ;
 };
+
+/*
+ * The vertex format of models, 20 bytes instead of the 32 of vertexUVNormal.
+ * The position stays as floats, as it is also used for physics and the bounds of the mesh.
+ * The UVs are half floats (see Util::FloatToHalf()), which are precise to 1/1024 of a texture repeat for UVs between -2 and 2.
+ * The normal is a GL_INT_2_10_10_10_REV (see Util::PackNormal()), and the shader reads it as a normalized vec3.
+ */
+struct vertexUVNormalPacked
+{
+	float posX;
+	float posY;
+	float posZ;
+
+	uint16 texcoordX;
+	uint16 texcoordY;
+
+	uint32 normal;
+};
 #pragma pack(pop)
 
 static_assert(std::is_trivial_v<vertexUV>,  "The vertexUV struct is not trivial");
 static_assert(std::is_trivial_v<vertexUVNormal>,  "The vertexUVNormal struct is not trivial");
+static_assert(std::is_trivial_v<vertexUVNormalPacked>,  "The vertexUVNormalPacked struct is not trivial");
+static_assert(sizeof(vertexUVNormalPacked) == 20,  "The vertexUVNormalPacked struct has padding");
 
 namespace Util
 {
@@ -95,10 +121,100 @@ namespace Util
 		const char* windowTitle = "OpenGL";
 		bool vsync = true;
 		bool fullscreen = true; //IMPORTANT: Fullscreen causes computer to freeze when using GDB
+
+		bool multiDrawIndirect = false; //Draw static models with glMultiDrawElementsIndirect instead of one draw call per mesh
+		bool gpuFrustumCulling = false; //Frustum cull the multi draw indirect meshes in a compute shader instead of on the CPU
+		bool broadPhaseCulling = true; //Frustum cull models through the physics broadphase tree instead of testing every mesh
+		bool preciseShapeCulling = false; //Also test the physics shapes of the bodies against a hull of the frustum, not just their bounds
+		bool occlusionCulling = true; //Also cull the meshes hidden in the last frame's depth buffer, only with gpuFrustumCulling
+		bool softwareOcclusionCulling = false; //Cull the meshes hidden behind the largest static meshes on the CPU, when not culling on the GPU
+		bool meshLods = true; //Draw the simplified levels of detail of meshes (see MeshSimplifier) when they are far enough away
+		float lodErrorPixels = 1.0f; //How far on screen a level of detail may move the vertices of a mesh
+		bool depthPrePass = false; //Draw the depth of the city first, so the lighting pass only shades the visible fragments
+		bool backFaceCulling = true; //Cull the back faces of meshes whose materials are not double sided
+		int numTestLights = 0; //Extra point lights scattered around the city, to see how the lighting scales with the number of lights
+		float debugPhysicsDrawDistance = 200.0f; //Bodies further away from the camera are not drawn when drawing debug physics, 0 draws all of them
 	};
 
 	inline Options options;
 
+	//Converts to an IEEE half float (GL_HALF_FLOAT), rounding to the nearest even value like the GPU does
+	inline uint16 FloatToHalf(float value)
+	{
+		uint32 bits = std::bit_cast<uint32>(value);
+		uint32 sign = bits >> 16 & 0x8000;
+		int32 exponent = static_cast<int32>(bits >> 23 & 0xFF) - 127 + 15;
+		uint32 mantissa = bits & 0x7FFFFF;
+
+		//Too large for a half, infinity or NaN
+		if (exponent >= 31)
+		{
+			bool isNaN = (bits >> 23 & 0xFF) == 0xFF && mantissa != 0;
+			return static_cast<uint16>(sign | 0x7C00 | (isNaN ? 0x200 : 0));
+		}
+
+		//Too small for a normal half, so it becomes a denormal (or 0)
+		if (exponent <= 0)
+		{
+			if (exponent < -10)
+				return static_cast<uint16>(sign);
+
+			mantissa |= 0x800000;
+			uint32 shift = 14 - exponent;
+			uint32 half = mantissa >> shift;
+			uint32 remainder = mantissa & ((1u << shift) - 1);
+			uint32 halfway = 1u << (shift - 1);
+
+			if (remainder > halfway || (remainder == halfway && (half & 1)))
+				half++;
+
+			return static_cast<uint16>(sign | half);
+		}
+
+		uint32 half = sign | static_cast<uint32>(exponent) << 10 | mantissa >> 13;
+		uint32 remainder = mantissa & 0x1FFF;
+
+		//A carry out of the mantissa correctly rounds up into the exponent
+		if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+			half++;
+
+		return static_cast<uint16>(half);
+	}
+
+	//Packs a unit vector into a GL_INT_2_10_10_10_REV, x is in the lowest bits and w is 0
+	inline uint32 PackNormal(float x, float y, float z)
+	{
+		auto packComponent = [](float value) -> uint32
+		{
+			int32 snorm = static_cast<int32>(std::lround(std::clamp(value, -1.0f, 1.0f) * 511.0f));
+			return static_cast<uint32>(snorm) & 0x3FF;
+		};
+
+		return packComponent(x) | packComponent(y) << 10 | packComponent(z) << 20;
+	}
+
+	//Writes to a temporary file first and then renames it, so a crash while writing never leaves a broken file behind
+	inline bool WriteFileAtomic(const std::string& path, const std::vector<uint8>& data)
+	{
+		std::string tempPath = path + ".tmp";
+
+		{
+			std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+			file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+
+			if (!file)
+				return false;
+		}
+
+		std::error_code error;
+		std::filesystem::rename(tempPath, path, error);
+
+		if (error)
+			std::filesystem::remove(tempPath, error);
+
+		return !error;
+	}
+
 	/**
 	* @brief Handles cleaning up resources during termination of the program.
 	*
@@ -43,6 +43,6 @@ void VertexArray::AddBuffer(const VertexBuffer& vb, IndexBuffer &ib, const Verte
 		glEnableVertexAttribArray(i);
 		glVertexAttribPointer(i, element.count, element.type, element.normalized, layout.GetStride(), (const void*)offset);
 
-		offset += element.count * VertexBufferElement::GetSizeOfType(element.type);
+		offset += element.GetSize();
 	}
 }
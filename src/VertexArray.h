@@ -20,6 +20,8 @@ public:
 
 	void Bind() const;
 	static void Unbind();
+
+	uint GetRendererID() const { return m_RendererID; }
 	void AddBuffer(const VertexBuffer& vb, IndexBuffer &ib, const VertexBufferLayout& layout);
 };
 
@@ -36,6 +36,21 @@ void VertexBufferLayout::Push<unsigned char>(uint count)
 	m_Stride += count * VertexBufferElement::GetSizeOfType(GL_UNSIGNED_BYTE);
 }
 
+template<>
+void VertexBufferLayout::Push<HalfFloat>(uint count)
+{
+	m_Elements.emplace_back(GL_HALF_FLOAT, count, GL_FALSE);
+	m_Stride += count * VertexBufferElement::GetSizeOfType(GL_HALF_FLOAT);
+}
+
+template<>
+void VertexBufferLayout::Push<Int2_10_10_10Rev>(uint count)
+{
+	ASSERT_LOG(count == 4, "GL_INT_2_10_10_10_REV always has 4 components, the shader can still read it as a vec3");
+	m_Elements.emplace_back(GL_INT_2_10_10_10_REV, count, GL_TRUE);
+	m_Stride += VertexBufferElement::GetSizeOfType(GL_INT_2_10_10_10_REV);
+}
+
 
 uint VertexBufferLayout::GetStride() const
 {
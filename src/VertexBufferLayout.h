@@ -3,6 +3,10 @@
 
 #include "Util.h"
 
+//Tag types for VertexBufferLayout::Push(), for the vertex formats that have no C++ type
+struct HalfFloat {};
+struct Int2_10_10_10Rev {}; //4 signed normalized components packed into 32 bits, see Util::PackNormal()
+
 struct VertexBufferElement
 {
 	uint type;
@@ -22,6 +26,13 @@ struct VertexBufferElement
 			case GL_UNSIGNED_BYTE:
 				return sizeof(GLubyte);
 
+			case GL_HALF_FLOAT:
+				return sizeof(GLhalf);
+
+			//Packed, so this is the size of all 4 components together
+			case GL_INT_2_10_10_10_REV:
+				return sizeof(GLuint);
+
 			default: break;
 		}
 
@@ -29,6 +40,15 @@ struct VertexBufferElement
 		__debugbreak();
 		return 0;
 	}
+
+	//The size of the whole element in bytes
+	uint GetSize() const
+	{
+		if (type == GL_INT_2_10_10_10_REV)
+			return GetSizeOfType(type);
+
+		return count * GetSizeOfType(type);
+	}
 };
 
 class VertexBufferLayout
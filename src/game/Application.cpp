@@ -10,7 +10,9 @@
 #include <Jolt/Core/Factory.h>
 
 //Stl includes
+#include <algorithm>
 #include <cstdarg>
+#include <thread>
 
 //Anonymous namespace for most callbacks (so that they cannot be accessed outside this file)
 namespace
@@ -102,7 +104,9 @@ Application::Application(GLFWwindow* window)
         m_input(m_window),
         m_player(m_input, nullptr),
         m_viewMatrix(m_player.GetViewMatrix()),
-        m_physics(m_physicsShader, m_renderer, m_projMatrix, m_viewMatrix, m_player.GetPosition())
+        m_physics(m_physicsShader, m_renderer, m_projMatrix, m_viewMatrix, m_player.GetPosition()),
+        //Leaves a core each for the render and physics threads
+        m_jobSystem(JPH::cMaxPhysicsJobs, JPH::cMaxPhysicsBarriers, std::max(1, static_cast<int>(std::thread::hardware_concurrency()) - 2))
 {
     m_player.SetCharacterHandler(m_physics.GetCharacterHandler());
 }
@@ -161,7 +165,7 @@ void Application::Run()
     if (sceneNum == 1)
     {
         Scene1 scene{
-            m_input, m_physics,
+            m_input, m_physics, m_jobSystem,
             m_renderer, m_player,
             m_projMatrix, m_viewMatrix,
             m_window
@@ -230,9 +234,16 @@ void Application::InitOpenGL()
         glEnable(GL_MULTISAMPLE);
 
     glEnable(GL_DEPTH_TEST);
-    // glEnable(GL_CULL_FACE);
-    // glCullFace(GL_BACK);
-    // glFrontFace(GL_CCW);
+
+    //Culling is turned on and off by the renderer, as double sided materials are drawn without it (see Material)
+    glCullFace(GL_BACK);
+    glFrontFace(GL_CCW);
+
+    //Let the driver compile shaders on as many threads as it likes, see Shader::FinishLinking()
+    if (GLEW_KHR_parallel_shader_compile)
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+    else if (GLEW_ARB_parallel_shader_compile)
+        glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
 
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
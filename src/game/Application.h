@@ -5,6 +5,8 @@
 #include "Player.h"
 #include "Util.h"
 
+#include <Jolt/Core/JobSystemThreadPool.h>
+
 class Application
 {
 public:
@@ -41,6 +43,9 @@ public:
     Physics     m_physics;
     Renderer    m_renderer;
 
+    //Worker threads for jobs from the render thread, physics updates on its own thread with its own job system
+    JPH::JobSystemThreadPool m_jobSystem;
+
     //Calls all of the other private init functions
     explicit Application(GLFWwindow* window);
     ~Application();
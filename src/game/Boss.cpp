@@ -42,13 +42,13 @@ bool Boss::CheckForHit(Player &player, float deltaTime)
     return hit;
 }
 
-void Boss::DrawHealthBar(Shader& shader, Renderer& renderer, const JPH::Mat44 &projMatrix, const std::string &textureUniformName)
+void Boss::DrawHealthBar(Shader& shader, Renderer& renderer, const JPH::Mat44 &projMatrix, UniformID textureUniform)
 {
-    m_crosshairBorderTexture.Bind(m_crosshairBorderTextureSlot);
-    shader.SetUniform(textureUniformName, m_crosshairBorderTextureSlot);
+    renderer.BindTexture(m_crosshairBorderTextureSlot, m_crosshairBorderTexture);
+    shader.SetUniform(textureUniform, m_crosshairBorderTextureSlot);
     m_healthBarBorder.Draw(shader, renderer, projMatrix);
 
-    m_crosshairTexture.Bind(m_crosshairTextureSlot);
-    shader.SetUniform(textureUniformName, m_crosshairTextureSlot);
+    renderer.BindTexture(m_crosshairTextureSlot, m_crosshairTexture);
+    shader.SetUniform(textureUniform, m_crosshairTextureSlot);
     m_healthBar.Draw(shader, renderer, projMatrix, m_modelMatrixHealthBar);
 }
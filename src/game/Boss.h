@@ -34,7 +34,7 @@ public:
     //Did the player hit the boss?
     bool CheckForHit(Player& player, float deltaTime);
 
-    void DrawHealthBar(Shader& shader, Renderer& renderer, const JPH::Mat44 &projMatrix, const std::string &textureUniformName);
+    void DrawHealthBar(Shader& shader, Renderer& renderer, const JPH::Mat44 &projMatrix, UniformID textureUniform);
 };
 
 #endif //BOSS_H
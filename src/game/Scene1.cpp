@@ -1,6 +1,7 @@
 #include "Scene1.h"
 
 #include <future>
+#include <random>
 
 #include "Graphics/Font.hpp"
 #include "Graphics/Text.hpp"
@@ -14,20 +15,29 @@
 #endif
 
 Scene1::Scene1(
-    Input& input, Physics& physics,
+    Input& input, Physics& physics, JPH::JobSystem& jobSystem,
     Renderer& renderer, Player& player,
     const JPH::Mat44& projMatrix, JPH::Mat44& viewMatrix,
     GLFWwindow* window
 )
     :   m_modelShader(
             "../resources/shaders/ModelVertex.glsl",
-            "../resources/shaders/ModelFrag.glsl"
+            "../resources/shaders/ModelFrag.glsl",
+            ShaderFeature::lighting
         ),
+        m_modelDepthShader(
+            "../resources/shaders/ModelDepthVertex.glsl",
+            "../resources/shaders/DepthFrag.glsl"
+        ),
+        m_frustumCullShader("../resources/shaders/FrustumCullCompute.glsl"),
+        m_hiZBuildShader("../resources/shaders/HiZBuildCompute.glsl"),
+        m_lightClusterShader("../resources/shaders/LightClusterCompute.glsl"),
+        m_occlusionCuller(jobSystem),
         m_input(input),
         m_physics(physics),
         m_renderer(renderer),
         m_player(player),
-        m_cityModel(m_renderer, "../resources/models/city/scene.gltf", m_physics, m_frustumCuller),
+        m_cityModel(m_renderer, "../resources/models/city/scene.gltf", m_physics, m_frustumCuller, true, &m_occlusionCuller, &jobSystem),
         m_ar15(m_renderer, "../resources/models/ar15/scene.gltf"),
         m_spaceship1(m_renderer, "../resources/models/spaceship/scene.gltf", m_physics, m_frustumCuller),
         m_spaceship2(m_renderer, "../resources/models/spaceship2/scene.gltf", m_physics, m_frustumCuller, JPH::Mat44::sScale(2.5)),
@@ -50,6 +60,9 @@ Scene1::Scene1(
 
     m_physics.OptimizeBroadphase();
 
+    //The shaders were compiling in the background while the models above loaded
+    Shader::FinishLinking({&m_modelShader, &m_modelDepthShader, &m_frustumCullShader, &m_hiZBuildShader, &m_lightClusterShader});
+
     m_spaceship1.SetRotation({0, 0, AI_MATH_HALF_PI_F});
     m_spaceship2.SetRotation({0, AI_MATH_HALF_PI_F, 0});
 
@@ -96,11 +109,18 @@ void Scene1::MainLoop()
     {
         time1 = clock::now();
 
+        m_renderer.BeginFrame();
         m_renderer.Clear();
         ImGuiFrameStart(drawDebugPhysics);
 
         UpdatePlayer(deltaTimeMs);
 
+        //The occluders are rasterized on the worker threads while physics updates, the city waits for them when it is culled
+        if (Util::options.softwareOcclusionCulling && !(Util::options.multiDrawIndirect && Util::options.gpuFrustumCulling))
+            m_occlusionCuller.Rasterize(m_projMatrix * m_viewMatrix);
+        else
+            m_occlusionCuller.Invalidate();
+
         auto start = clock::now();
         m_deltaTime.store(deltaTimeMs, std::memory_order_release);
         m_updatePhysicsNow.store(true, std::memory_order_release); //We have called m_physics.Update() here
@@ -121,6 +141,7 @@ void Scene1::MainLoop()
         m_renderAndPhysicsTimings.emplace_back(duration_cast<microseconds>(end - start).count() / 1000.f);
 
         ImGuiFrameEnd(drawDebugPhysics);
+        m_renderer.EndFrame();
 
         start = clock::now();
         HandleEventsAndBuffers();
@@ -158,6 +179,19 @@ void Scene1::ImGuiFrameStart(bool& drawDebugPhysics)
 
     if (ImGui::Button("Dump Statistics"))
         DumpStatistics();
+
+    ImGui::Checkbox("Multi Draw Indirect", &Util::options.multiDrawIndirect);
+    ImGui::Checkbox("GPU Frustum Culling", &Util::options.gpuFrustumCulling);
+    ImGui::Checkbox("Broadphase Frustum Culling", &Util::options.broadPhaseCulling);
+    ImGui::Checkbox("Precise Shape Culling", &Util::options.preciseShapeCulling);
+    ImGui::Checkbox("Occlusion Culling (GPU culling only)", &Util::options.occlusionCulling);
+    ImGui::Checkbox("Software Occlusion Culling (CPU culling only)", &Util::options.softwareOcclusionCulling);
+    ImGui::Checkbox("Mesh LODs", &Util::options.meshLods);
+    ImGui::SliderFloat("LOD Error (pixels)", &Util::options.lodErrorPixels, 0.25f, 8.0f);
+    ImGui::Checkbox("Depth Pre-Pass", &Util::options.depthPrePass);
+    ImGui::Checkbox("Back Face Culling", &Util::options.backFaceCulling);
+    ImGui::SliderInt("Test Lights", &Util::options.numTestLights, 0, ClusteredLights::maxLights - 16);
+    ImGui::SliderFloat("Debug Physics Distance", &Util::options.debugPhysicsDrawDistance, 0.0f, 1000.0f);
 #endif
 }
 
@@ -167,6 +201,31 @@ void Scene1::ImGuiFrameEnd(bool &drawDebugPhysics)
     ImGui::Text("drawDebugPhysics: %s", drawDebugPhysics ? "true" : "false");
     ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / m_imGuiIo->Framerate, m_imGuiIo->Framerate);
 
+    const StateCacheStats& stats = m_renderer.GetLastFrameStats();
+    ImGui::Text("Filtered program binds: %u/%u", stats.programBindsFiltered, stats.programBinds);
+    ImGui::Text("Filtered VAO binds: %u/%u", stats.vertexArrayBindsFiltered, stats.vertexArrayBinds);
+    ImGui::Text("Filtered texture binds: %u/%u", stats.textureBindsFiltered, stats.textureBinds);
+    ImGui::Text("Filtered depth/blend/cull changes: %u/%u", stats.stateChangesFiltered, stats.stateChanges);
+    ImGui::Text("Textures loading: %u", m_renderer.GetTextureLoader().GetNumPending());
+    ImGui::Text("Lights: %u", m_lights.GetNumLights());
+
+    const std::vector<double>& cityTimings = m_cityGpuTimings[GetCityVariant()];
+    if (!cityTimings.empty())
+    {
+        //Averaged over the last few frames, as a single query jumps around too much to read
+        uint numAveraged = std::min<uint>(cityTimings.size(), 60);
+        double cityMs = std::accumulate(cityTimings.end() - numAveraged, cityTimings.end(), 0.0) / numAveraged;
+        ImGui::Text("City GPU time: %.3f ms (%s)", cityMs, GetCityVariantName(GetCityVariant()).c_str());
+    }
+
+    MultiDrawBatch::CullStats cullStats = m_cityModel.GetLastCullStats();
+    uint numCulled = cullStats.numMeshes - cullStats.numVisible;
+    ImGui::Text(
+        "City meshes culled: %.1f%% (%u/%u, %u by the frustum, %u by occlusion)",
+        cullStats.numMeshes > 0 ? 100.0f * numCulled / cullStats.numMeshes : 0.0f, numCulled, cullStats.numMeshes,
+        cullStats.numMeshes - cullStats.numInFrustum, cullStats.numInFrustum - cullStats.numVisible
+    );
+
     ImGui::End();
     ImGui::Render();
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
@@ -255,10 +314,58 @@ void Scene1::UpdatePhysics(float deltaTimeMs)
     m_physics.Update(deltaTimeMs);
 }
 
+void Scene1::UpdateLights(bool gunFlash)
+{
+    m_lights.Clear();
+
+    //The light that has always been above the middle of the city
+    m_lights.AddLight({JPH::Vec3(0, 10, 0), 65.0f, JPH::Vec3(1.0f, 1.0f, 1.0f), 1.5f});
+
+    if (gunFlash)
+    {
+        //Just in front of the barrel, which is drawn in view space
+        JPH::Vec3 muzzlePosition = m_viewMatrix.InversedRotationTranslation() * JPH::Vec3(0.18f, -0.12f, -1.2f);
+        m_lights.AddLight({muzzlePosition, 12.0f, JPH::Vec3(1.0f, 0.75f, 0.4f), 2.5f});
+    }
+
+    if (m_testLights.size() != static_cast<uint>(Util::options.numTestLights))
+    {
+        //The same seed every time, so the lights do not move around when the number changes
+        std::mt19937 random(1234);
+        std::uniform_real_distribution<float> horizontal(-150.0f, 150.0f);
+        std::uniform_real_distribution<float> height(1.0f, 12.0f);
+        std::uniform_real_distribution<float> radius(6.0f, 20.0f);
+        std::uniform_real_distribution<float> channel(0.2f, 1.0f);
+
+        m_testLights.clear();
+        for (int i = 0; i < Util::options.numTestLights; i++)
+        {
+            //One at a time, as the order that function arguments are evaluated in is not specified
+            float x = horizontal(random);
+            float y = height(random);
+            float z = horizontal(random);
+            float lightRadius = radius(random);
+            float red = channel(random);
+            float green = channel(random);
+            float blue = channel(random);
+
+            m_testLights.push_back({JPH::Vec3(x, y, z), lightRadius, JPH::Vec3(red, green, blue), 1.0f});
+        }
+    }
+
+    for (const ClusteredLights::PointLight& light : m_testLights)
+        m_lights.AddLight(light);
+
+    m_lights.Update(m_renderer, m_lightClusterShader, m_viewMatrix, m_projMatrix, Util::options.scrWidth, Util::options.scrHeight);
+}
+
 void Scene1::DrawModels()
 {
-    m_modelShader.Bind();
-    m_modelShader.SetUniform("u_lightPos", {0, 10, 0});
+    //Decided up front, as the flash also lights up the scene
+    bool drawGunFlash = m_input.IsKeyCurrentlyPressed(GLFW_MOUSE_BUTTON_LEFT) && std::rand() % 2 == 0;
+    UpdateLights(drawGunFlash);
+
+    m_renderer.BindShader(m_modelShader);
 
     static const JPH::Vec3 gunPos{0.18, -0.19, -0.55};
     static const JPH::Vec3 gunScale{0.0010, 0.0010, 0.0010};
@@ -271,9 +378,42 @@ void Scene1::DrawModels()
         JPH::Mat44::sRotation({0, 1, 0}, gunRotation[1]) *
         JPH::Mat44::sRotation({0, 0, 1}, gunRotation[2]);
 
-    m_modelShader.SetUniform("u_enableLighting", true);
+    //The city is flushed on its own, so that the timer only covers it
+    m_cityTimer.Begin(GetCityVariant());
+
+    if (Util::options.depthPrePass)
+    {
+        m_renderer.SetColorWrite(false);
+        DrawCity(m_modelDepthShader);
+        m_renderer.FlushRenderQueue();
+
+        //Only the nearest fragment of every pixel has the same depth as the depth buffer, so only it is shaded
+        m_renderer.SetColorWrite(true);
+        m_renderer.SetDepthWrite(false);
+        m_renderer.SetDepthFunc(GL_EQUAL);
+
+        if (Util::options.multiDrawIndirect)
+            m_cityModel.Redraw(m_modelShader.GetVariant(m_modelShader.GetFeatures() | ShaderFeature::instancing));
+        else
+            m_cityModel.Redraw(m_modelShader);
+        m_renderer.FlushRenderQueue();
+
+        m_renderer.SetDepthFunc(GL_LESS);
+        m_renderer.SetDepthWrite(true);
+    }
+    else
+    {
+        DrawCity(m_modelShader);
+        m_renderer.FlushRenderQueue();
+    }
+
+    m_cityTimer.End();
 
-    m_cityModel.Draw(m_modelShader, m_projMatrix, m_viewMatrix);
+    GpuTimer::Result timerResult;
+    while (m_cityTimer.PopResult(timerResult))
+        m_cityGpuTimings[timerResult.tag].push_back(timerResult.ms);
+
+    m_renderer.BindShader(m_modelShader);
 
     if (m_spaceship1Boss.GetHealth() > 0.05)
     {
@@ -301,30 +441,71 @@ void Scene1::DrawModels()
         }
     }
 
+    //The models are only pushed into the render queue, so they have to be drawn before the depth buffer is cleared
+    m_renderer.FlushRenderQueue();
+
+    //The gun and the overlays are drawn after this, so they never hide anything
+    if (Util::options.multiDrawIndirect && Util::options.gpuFrustumCulling && Util::options.occlusionCulling)
+        m_hiZBuffer.Build(m_renderer, m_hiZBuildShader, m_projMatrix * m_viewMatrix, Util::options.scrWidth, Util::options.scrHeight);
+    else
+        m_hiZBuffer.Invalidate(); //Otherwise turning it back on would cull against an old view
+
     glClear(GL_DEPTH_BUFFER_BIT);
 
     m_ar15.Draw(m_modelShader, m_projMatrix, JPH::Mat44::sIdentity(), modelMatrixGun);
 
+    m_renderer.FlushRenderQueue();
     glClear(GL_DEPTH_BUFFER_BIT);
-    glDisable(GL_DEPTH_TEST);
+    m_renderer.SetDepthTest(false);
+
+    //The overlays are not lit
+    Shader& overlayShader = m_modelShader.GetVariant(ShaderFeature::none);
+
+    m_renderer.BindTexture(m_crosshairTextureSlot, m_crosshairTexture);
+    overlayShader.SetUniform("u_textureDiffuse0"_uniform, m_crosshairTextureSlot);
+    m_crosshair.Draw(overlayShader, m_renderer, m_projMatrix);
+
+    if (drawGunFlash)
+    {
+        m_renderer.BindTexture(m_gunFlashTextureSlot, m_gunFlashTexture);
+        overlayShader.SetUniform("u_textureDiffuse0"_uniform, m_gunFlashTextureSlot);
+        m_gunFlash.Draw(overlayShader, m_renderer, m_projMatrix);
+    }
 
-    m_modelShader.SetUniform("u_enableLighting", false);
+    m_spaceship1Boss.DrawHealthBar(overlayShader, m_renderer, m_projMatrix, "u_textureDiffuse0"_uniform);
+    m_spaceship2Boss.DrawHealthBar(overlayShader, m_renderer, m_projMatrix, "u_textureDiffuse0"_uniform);
 
-    m_crosshairTexture.Bind(m_crosshairTextureSlot);
-    m_modelShader.SetUniform("u_textureDiffuse0", m_crosshairTextureSlot);
-    m_crosshair.Draw(m_modelShader, m_renderer, m_projMatrix);
+    m_renderer.SetDepthTest(true);
+}
+
+void Scene1::DrawCity(Shader &shader)
+{
+    if (Util::options.multiDrawIndirect)
+    {
+        Shader& batchedShader = shader.GetVariant(shader.GetFeatures() | ShaderFeature::instancing);
 
-    if (m_input.IsKeyCurrentlyPressed(GLFW_MOUSE_BUTTON_LEFT) && std::rand() % 2 == 0)
+        if (Util::options.gpuFrustumCulling)
+            m_cityModel.DrawMultiIndirectGPUCulled(
+                batchedShader, m_frustumCullShader, m_projMatrix, m_viewMatrix,
+                Util::options.occlusionCulling ? &m_hiZBuffer : nullptr
+            );
+        else
+            m_cityModel.DrawMultiIndirect(batchedShader, m_projMatrix, m_viewMatrix);
+    }
+    else
     {
-        m_gunFlashTexture.Bind(m_gunFlashTextureSlot);
-        m_modelShader.SetUniform("u_textureDiffuse0", m_gunFlashTextureSlot);
-        m_gunFlash.Draw(m_modelShader, m_renderer, m_projMatrix);
+        m_cityModel.Draw(shader, m_projMatrix, m_viewMatrix);
     }
+}
 
-    m_spaceship1Boss.DrawHealthBar(m_modelShader, m_renderer, m_projMatrix, "u_textureDiffuse0");
-    m_spaceship2Boss.DrawHealthBar(m_modelShader, m_renderer, m_projMatrix, "u_textureDiffuse0");
+/*static*/ uint Scene1::GetCityVariant()
+{
+    return (Util::options.depthPrePass ? 1 : 0) | (Util::options.backFaceCulling ? 2 : 0);
+}
 
-    glEnable(GL_DEPTH_TEST);
+/*static*/ std::string Scene1::GetCityVariantName(uint variant)
+{
+    return std::string("depth pre-pass ") + (variant & 1 ? "on" : "off") + ", back face culling " + (variant & 2 ? "on" : "off");
 }
 
 void Scene1::HandleEventsAndBuffers()
@@ -366,7 +547,16 @@ void Scene1::DumpStatistics()
     printStats("Physics + Render frame timings", m_renderAndPhysicsTimings);
     printStats("Events + Swap buffer frame timings", m_eventsSwapBuffersTimings);
 
+    for (uint variant = 0; variant < m_cityGpuTimings.size(); variant++)
+    {
+        if (!m_cityGpuTimings[variant].empty())
+            printStats("City GPU timings (" + GetCityVariantName(variant) + ")", m_cityGpuTimings[variant]);
+    }
+
     m_frameTimings.clear();
     m_renderAndPhysicsTimings.clear();
     m_eventsSwapBuffersTimings.clear();
+
+    for (std::vector<double>& timings : m_cityGpuTimings)
+        timings.clear();
 }
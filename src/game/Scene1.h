@@ -2,12 +2,16 @@
 #define SCENE1_H
 
 #include "Boss.h"
+#include "ClusteredLights.h"
 #include "DynamicModel.h"
+#include "GpuTimer.h"
+#include "HiZBuffer.h"
 #include "Util.h"
 #include "Input.h"
 #include "Physics.h"
 #include "Player.h"
 #include "Shader.h"
+#include "SoftwareOcclusionCuller.h"
 #include "Model.h"
 #include "Quads2D.h"
 #include "Quads3D.h"
@@ -17,8 +21,16 @@
 class Scene1
 {
 private:
-    Shader          m_modelShader;
+    Shader          m_modelShader; //Lit, its INSTANCING variant reads model matrices from a buffer for multi draw indirect
+    Shader          m_modelDepthShader; //Position only version of m_modelShader, for the depth pre-pass
+    Shader          m_frustumCullShader; //Compute shader for StaticModel::DrawMultiIndirectGPUCulled()
+    Shader          m_hiZBuildShader; //Compute shader for HiZBuffer::Build()
+    Shader          m_lightClusterShader; //Compute shader for ClusteredLights::Update()
+    HiZBuffer       m_hiZBuffer; //The depth of the last frame, for occlusion culling the city
     FrustumCuller   m_frustumCuller;
+    ClusteredLights m_lights;
+    std::vector<ClusteredLights::PointLight> m_testLights; //Util::options.numTestLights of them, made when the option changes
+    SoftwareOcclusionCuller m_occlusionCuller; //Occludes the city with its largest meshes when it is culled on the CPU
 
     Input&          m_input;
     Physics&        m_physics;
@@ -53,6 +65,10 @@ private:
     std::vector<double> m_renderAndPhysicsTimings;
     std::vector<double> m_eventsSwapBuffersTimings;
 
+    //How long the GPU takes to draw the opaque city, for each combination of the depth pre-pass and back face culling
+    GpuTimer m_cityTimer;
+    std::array<std::vector<double>, 4> m_cityGpuTimings; //Indexed by GetCityVariant()
+
     bool m_removedBoss1FromPhysics = false;
     bool m_removedBoss2FromPhysics = false;
 
@@ -72,7 +88,15 @@ private:
     void UpdatePhysicsThread();
     void UpdatePhysics(float deltaTimeMs);
 
+    //Adds every light of this frame to m_lights and assigns them to the clusters
+    void UpdateLights(bool gunFlash);
+
     void DrawModels();
+    void DrawCity(Shader& shader); //With the INSTANCING variant of shader for multi draw indirect
+
+    //Which of m_cityGpuTimings the current options draw the city with
+    static uint GetCityVariant();
+    static std::string GetCityVariantName(uint variant);
 
     void HandleEventsAndBuffers();
 
@@ -81,7 +105,7 @@ private:
 public:
 
     Scene1(
-        Input& input, Physics& physics,
+        Input& input, Physics& physics, JPH::JobSystem& jobSystem,
         Renderer& renderer, Player& player,
         const JPH::Mat44& projMatrix, JPH::Mat44& viewMatrix,
         GLFWwindow* window
@@ -0,0 +1,223 @@
+/*
+ * Compares the ways of frustum culling boxes: FrustumCuller::GetVisibleBodies(), which locks every physics body and
+ * tests its bounds one at a time, AABBCullKernel, which tests the same bounds from SoA arrays 4 or 8 at a time, and
+ * FrustumCuller::QueryFrustum(), which only tests the bodies that the broadphase tree finds near the frustum.
+ *
+ * Usage: cullBenchmark
+ * Runs with 1k, 10k and 100k static boxes scattered around the camera, and checks that all of them find the same boxes.
+ * The plane test keeps some boxes near the corners of the frustum that are outside of it, QueryFrustum() can skip those,
+ * so it is allowed to find fewer boxes.
+ */
+
+#include "Util.h"
+
+#include "AABBCullKernel.h"
+#include "FrustumCulling.h"
+#include "JPHImpls.h"
+
+#include <Jolt/Core/Memory.h>
+
+#include <bit>
+#include <chrono>
+#include <iomanip>
+#include <random>
+
+namespace
+{
+	struct BenchmarkResult
+	{
+		double currentPathMs;
+		double kernelMs;
+		double broadPhaseMs;
+		uint numVisibleCurrentPath;
+		uint numVisibleKernel;
+		uint numVisibleBroadPhase;
+	};
+
+	//Counts the bodies that QueryFrustum() finds, the same way as StaticModel does for its static meshes
+	class VisibleBodyCollector : public JPH::CollideShapeBodyCollector
+	{
+	private:
+		const FrustumCuller& m_frustumCuller;
+		const AABBCullKernel::Bounds& m_bounds; //Indexed by BodyID::GetIndex(), the bodies are created in order
+		std::vector<uint64> m_testedMask;
+
+	public:
+		uint numVisible = 0;
+
+		VisibleBodyCollector(const FrustumCuller& frustumCuller, const AABBCullKernel::Bounds& bounds)
+			: m_frustumCuller(frustumCuller), m_bounds(bounds), m_testedMask(AABBCullKernel::GetMaskSize(bounds.GetNumBoxes()))
+		{
+		}
+
+		void Reset()
+		{
+			std::fill(m_testedMask.begin(), m_testedMask.end(), 0);
+			numVisible = 0;
+		}
+
+		void AddHit(const JPH::BodyID& bodyID) override
+		{
+			uint index = bodyID.GetIndex();
+			uint64 bit = uint64(1) << (index % 64);
+			if (m_testedMask[index / 64] & bit)
+				return;
+			m_testedMask[index / 64] |= bit;
+
+			if (m_frustumCuller.IsAABBVisible(m_bounds.Get(index)))
+				numVisible++;
+		}
+	};
+
+	template<typename Function>
+	double TimeAverageMs(uint iterations, Function&& function)
+	{
+		auto start = std::chrono::steady_clock::now();
+		for (uint i = 0; i < iterations; i++)
+			function();
+
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+		return elapsed.count() / iterations;
+	}
+
+	BenchmarkResult RunBenchmark(uint numBoxes, FrustumCuller& frustumCuller, const JPH::Mat44& viewMatrix, const JPH::Mat44& projectionMatrix)
+	{
+		JPHImpls::BPLayerInterfaceImpl broadPhaseLayerInterface;
+		JPHImpls::ObjectVsBroadPhaseLayerFilterImpl objectVsBroadPhaseLayerFilter;
+		JPHImpls::ObjectLayerPairCollisionFilterImpl objectLayerPairCollisionFilter;
+
+		JPH::PhysicsSystem physicsSystem;
+		physicsSystem.Init(numBoxes, 0, 1024, 1024, broadPhaseLayerInterface, objectVsBroadPhaseLayerFilter, objectLayerPairCollisionFilter);
+		JPH::BodyInterface& bodyInterface = physicsSystem.GetBodyInterfaceNoLock();
+
+		//The same seed every run, so the results can be compared between runs
+		std::mt19937 random(numBoxes);
+		std::uniform_real_distribution<float> positionDistribution(-500.0f, 500.0f);
+		std::uniform_real_distribution<float> sizeDistribution(0.5f, 5.0f);
+
+		std::vector<JPH::BodyID> bodyIDs;
+		bodyIDs.reserve(numBoxes);
+
+		AABBCullKernel::Bounds bounds;
+		bounds.Reserve(numBoxes);
+
+		for (uint i = 0; i < numBoxes; i++)
+		{
+			JPH::Vec3 halfExtent(sizeDistribution(random), sizeDistribution(random), sizeDistribution(random));
+			JPH::Vec3 position(positionDistribution(random), positionDistribution(random), positionDistribution(random));
+
+			JPH::BodyCreationSettings settings(
+				new JPH::BoxShape(halfExtent), position, JPH::Quat::sIdentity(),
+				JPH::EMotionType::Static, JPHImpls::ObjectLayers::NON_MOVING
+			);
+
+			JPH::BodyID bodyID = bodyInterface.CreateAndAddBody(settings, JPH::EActivation::DontActivate);
+			ASSERT_LOG(bodyID.GetIndex() == i, "The bodies should be created in order");
+			bodyIDs.push_back(bodyID);
+			bounds.Add(bodyInterface.GetTransformedShape(bodyID).GetWorldSpaceBounds());
+		}
+
+		//Like the game does after loading the scene
+		physicsSystem.OptimizeBroadPhase();
+
+		//Roughly the same amount of work for every size, and enough iterations that the timer resolution does not matter
+		uint iterations = std::max(20u, 5'000'000 / numBoxes);
+
+		std::vector<JPH::BodyID> visibleBodies;
+		std::vector<uint64> visibleMask;
+
+		BenchmarkResult result{};
+		result.currentPathMs = TimeAverageMs(iterations, [&]()
+		{
+			frustumCuller.GetVisibleBodies(physicsSystem.GetBodyLockInterface(), bodyIDs, viewMatrix, projectionMatrix, visibleBodies);
+		});
+
+		result.kernelMs = TimeAverageMs(iterations, [&]()
+		{
+			frustumCuller.GetVisibleMask(bounds, viewMatrix, projectionMatrix, visibleMask);
+		});
+
+		VisibleBodyCollector collector(frustumCuller, bounds);
+		result.broadPhaseMs = TimeAverageMs(iterations, [&]()
+		{
+			collector.Reset();
+			frustumCuller.QueryFrustum(physicsSystem.GetBroadPhaseQuery(), viewMatrix, projectionMatrix, collector);
+		});
+
+		result.numVisibleBroadPhase = collector.numVisible;
+		result.numVisibleCurrentPath = visibleBodies.size();
+		for (uint64 word : visibleMask)
+			result.numVisibleKernel += std::popcount(word);
+
+		bodyInterface.RemoveBodies(bodyIDs.data(), bodyIDs.size());
+		bodyInterface.DestroyBodies(bodyIDs.data(), bodyIDs.size());
+
+		return result;
+	}
+}
+
+int main()
+{
+	JPH::RegisterDefaultAllocator();
+	JPH::Factory::sInstance = new JPH::Factory();
+	JPH::RegisterTypes();
+
+#ifdef JPH_USE_AVX
+	std::cout << "AABBCullKernel is using AVX (8 boxes per iteration)" << std::endl;
+#else
+	std::cout << "AABBCullKernel is using JPH::Vec4 (4 boxes per iteration)" << std::endl;
+#endif
+
+	//Looking along a diagonal so that the frustum is not aligned with the axes
+	JPH::Mat44 viewMatrix = JPH::Mat44::sLookAt(JPH::Vec3(-100, 20, -50), JPH::Vec3(200, 0, 150), JPH::Vec3::sAxisY());
+
+	//The same projection as the game, and one that sees a lot less of the scene, as the cost of QueryFrustum() depends
+	//on how many boxes are near the frustum instead of on how many there are in total
+	std::pair<const char*, float> frustums[] = {{"Far plane at 1000 (as in the game)", 1000.0f}, {"Far plane at 100", 100.0f}};
+
+	FrustumCuller frustumCuller;
+	bool allMatched = true;
+
+	for (auto [frustumName, farPlane] : frustums)
+	{
+		JPH::Mat44 projectionMatrix = JPH::Mat44::sPerspective(JPH::DegreesToRadians(75.0f), 16.0f / 9.0f, 0.1f, farPlane);
+
+		std::cout << std::endl << frustumName << std::endl;
+		std::cout << std::setw(8) << "Boxes" << std::setw(20) << "GetVisibleBodies" << std::setw(16) << "Kernel"
+			<< std::setw(16) << "QueryFrustum" << std::setw(10) << "Speedup" << std::setw(10) << "Visible"
+			<< std::setw(10) << "Queried" << std::endl;
+
+		for (uint numBoxes : {1'000u, 10'000u, 100'000u})
+		{
+			BenchmarkResult result = RunBenchmark(numBoxes, frustumCuller, viewMatrix, projectionMatrix);
+
+			std::cout << std::fixed << std::setprecision(4)
+				<< std::setw(8) << numBoxes
+				<< std::setw(17) << result.currentPathMs << " ms"
+				<< std::setw(13) << result.kernelMs << " ms"
+				<< std::setw(13) << result.broadPhaseMs << " ms"
+				<< std::setprecision(1) << std::setw(9) << result.currentPathMs / result.kernelMs << "x"
+				<< std::setw(10) << result.numVisibleKernel
+				<< std::setw(10) << result.numVisibleBroadPhase << std::endl;
+
+			if (result.numVisibleCurrentPath != result.numVisibleKernel)
+			{
+				std::cerr << "Mismatch with " << numBoxes << " boxes: GetVisibleBodies found " << result.numVisibleCurrentPath
+					<< " visible boxes, the kernel found " << result.numVisibleKernel << std::endl;
+				allMatched = false;
+			}
+			if (result.numVisibleBroadPhase > result.numVisibleCurrentPath)
+			{
+				std::cerr << "Mismatch with " << numBoxes << " boxes: GetVisibleBodies found " << result.numVisibleCurrentPath
+					<< " visible boxes, QueryFrustum found " << result.numVisibleBroadPhase << std::endl;
+				allMatched = false;
+			}
+		}
+	}
+
+	JPH::UnregisterTypes();
+	delete JPH::Factory::sInstance;
+	JPH::Factory::sInstance = nullptr;
+
+	return allMatched ? 0 : 1;
+}
@@ -0,0 +1,332 @@
+#include "BlockEncoder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace
+{
+	constexpr uint numTexels = 16;
+
+	//Finds the two ends of the line that best fits the texels (the principal axis), using the first numChannels channels
+	void FindEndpoints(const uint8* block, uint numChannels, float* outLow, float* outHigh)
+	{
+		float mean[4] = {};
+		for (uint i = 0; i < numTexels; i++)
+		{
+			for (uint c = 0; c < numChannels; c++)
+				mean[c] += block[i * 4 + c];
+		}
+
+		for (uint c = 0; c < numChannels; c++)
+			mean[c] /= numTexels;
+
+		float covariance[4][4] = {};
+		for (uint i = 0; i < numTexels; i++)
+		{
+			for (uint a = 0; a < numChannels; a++)
+			{
+				for (uint b = 0; b < numChannels; b++)
+					covariance[a][b] += (block[i * 4 + a] - mean[a]) * (block[i * 4 + b] - mean[b]);
+			}
+		}
+
+		//Power iteration, a few steps are plenty for 16 texels
+		float axis[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+		for (uint iteration = 0; iteration < 8; iteration++)
+		{
+			float next[4] = {};
+			for (uint a = 0; a < numChannels; a++)
+			{
+				for (uint b = 0; b < numChannels; b++)
+					next[a] += covariance[a][b] * axis[b];
+			}
+
+			float length = 0.0f;
+			for (uint c = 0; c < numChannels; c++)
+				length += next[c] * next[c];
+
+			//Every texel is the same colour (or lies on a line perpendicular to the guess), any axis works
+			if (length < 1e-6f)
+				break;
+
+			length = std::sqrt(length);
+			for (uint c = 0; c < numChannels; c++)
+				axis[c] = next[c] / length;
+		}
+
+		float minT = 0.0f;
+		float maxT = 0.0f;
+		for (uint i = 0; i < numTexels; i++)
+		{
+			float t = 0.0f;
+			for (uint c = 0; c < numChannels; c++)
+				t += (block[i * 4 + c] - mean[c]) * axis[c];
+
+			minT = std::min(minT, t);
+			maxT = std::max(maxT, t);
+		}
+
+		for (uint c = 0; c < numChannels; c++)
+		{
+			outLow[c] = std::clamp(mean[c] + axis[c] * minT, 0.0f, 255.0f);
+			outHigh[c] = std::clamp(mean[c] + axis[c] * maxT, 0.0f, 255.0f);
+		}
+	}
+
+	//Returns the index of the palette entry closest to the texel
+	uint FindClosest(const uint8* texel, const uint8 (*palette)[4], uint paletteSize, uint numChannels)
+	{
+		uint bestIndex = 0;
+		int bestError = std::numeric_limits<int>::max();
+
+		for (uint i = 0; i < paletteSize; i++)
+		{
+			int error = 0;
+			for (uint c = 0; c < numChannels; c++)
+				error += (texel[c] - palette[i][c]) * (texel[c] - palette[i][c]);
+
+			if (error < bestError)
+			{
+				bestError = error;
+				bestIndex = i;
+			}
+		}
+
+		return bestIndex;
+	}
+
+	uint16 PackRGB565(const float* color)
+	{
+		uint r = std::lround(color[0] * 31.0f / 255.0f);
+		uint g = std::lround(color[1] * 63.0f / 255.0f);
+		uint b = std::lround(color[2] * 31.0f / 255.0f);
+		return static_cast<uint16>(r << 11 | g << 5 | b);
+	}
+
+	void UnpackRGB565(uint16 packed, uint8* outColor)
+	{
+		uint r = packed >> 11 & 31;
+		uint g = packed >> 5 & 63;
+		uint b = packed & 31;
+
+		outColor[0] = static_cast<uint8>(r << 3 | r >> 2);
+		outColor[1] = static_cast<uint8>(g << 2 | g >> 4);
+		outColor[2] = static_cast<uint8>(b << 3 | b >> 2);
+		outColor[3] = 255;
+	}
+
+	//Writes bits from the lowest bit of the block up, which is how BC7 blocks are laid out
+	class BitWriter
+	{
+	private:
+		uint8* m_block;
+		uint m_position = 0;
+
+	public:
+		explicit BitWriter(uint8* block) : m_block(block) { std::memset(m_block, 0, 16); }
+
+		void Write(uint value, uint numBits)
+		{
+			for (uint i = 0; i < numBits; i++, m_position++)
+				m_block[m_position / 8] |= ((value >> i) & 1) << (m_position % 8);
+		}
+	};
+}
+
+/*static*/ std::vector<uint8> BlockEncoder::EncodeLevel(CompressedTexture::Format format, const uint8* pixels, int width, int height)
+{
+	ASSERT_LOG(format != CompressedTexture::Format::rgba8, "Can not block compress to an uncompressed format");
+
+	uint blockSize = CompressedTexture::GetBlockSize(format);
+	int blocksWide = std::max((width + 3) / 4, 1);
+	int blocksHigh = std::max((height + 3) / 4, 1);
+
+	std::vector<uint8> outBlocks(CompressedTexture::GetLevelSize(format, width, height));
+	uint8 block[numTexels * 4];
+
+	for (int blockY = 0; blockY < blocksHigh; blockY++)
+	{
+		for (int blockX = 0; blockX < blocksWide; blockX++)
+		{
+			for (int y = 0; y < 4; y++)
+			{
+				for (int x = 0; x < 4; x++)
+				{
+					int pixelX = std::min(blockX * 4 + x, width - 1);
+					int pixelY = std::min(blockY * 4 + y, height - 1);
+					std::memcpy(&block[(y * 4 + x) * 4], &pixels[(pixelY * width + pixelX) * 4], 4);
+				}
+			}
+
+			uint8* outBlock = outBlocks.data() + (static_cast<uint64>(blockY) * blocksWide + blockX) * blockSize;
+			switch (format)
+			{
+				case CompressedTexture::Format::bc1: EncodeBC1(block, outBlock); break;
+				case CompressedTexture::Format::bc3: EncodeBC3(block, outBlock); break;
+				case CompressedTexture::Format::bc5: EncodeBC5(block, outBlock); break;
+				case CompressedTexture::Format::bc7: EncodeBC7(block, outBlock); break;
+				default: break;
+			}
+		}
+	}
+
+	return outBlocks;
+}
+
+/*static*/ void BlockEncoder::EncodeBC1(const uint8* block, uint8* outBlock)
+{
+	float low[4], high[4];
+	FindEndpoints(block, 3, low, high);
+
+	uint16 color0 = PackRGB565(high);
+	uint16 color1 = PackRGB565(low);
+
+	//color0 > color1 selects the 4 colour mode, otherwise the last palette entry is transparent black
+	if (color0 < color1)
+		std::swap(color0, color1);
+
+	uint32 indices = 0;
+	if (color0 != color1)
+	{
+		uint8 palette[4][4];
+		UnpackRGB565(color0, palette[0]);
+		UnpackRGB565(color1, palette[1]);
+
+		for (uint c = 0; c < 3; c++)
+		{
+			palette[2][c] = static_cast<uint8>((2 * palette[0][c] + palette[1][c]) / 3);
+			palette[3][c] = static_cast<uint8>((palette[0][c] + 2 * palette[1][c]) / 3);
+		}
+
+		for (uint i = 0; i < numTexels; i++)
+			indices |= FindClosest(&block[i * 4], palette, 4, 3) << (i * 2);
+	}
+
+	outBlock[0] = color0 & 0xFF;
+	outBlock[1] = color0 >> 8;
+	outBlock[2] = color1 & 0xFF;
+	outBlock[3] = color1 >> 8;
+	std::memcpy(outBlock + 4, &indices, sizeof(indices)); //Both the file and every platform we build for are little endian
+}
+
+/*static*/ void BlockEncoder::EncodeBC3(const uint8* block, uint8* outBlock)
+{
+	EncodeBC4(block, 3, outBlock);
+	EncodeBC1(block, outBlock + 8);
+}
+
+/*static*/ void BlockEncoder::EncodeBC5(const uint8* block, uint8* outBlock)
+{
+	EncodeBC4(block, 0, outBlock);
+	EncodeBC4(block, 1, outBlock + 8);
+}
+
+/*static*/ void BlockEncoder::EncodeBC4(const uint8* block, uint channel, uint8* outBlock)
+{
+	uint8 minValue = 255;
+	uint8 maxValue = 0;
+	for (uint i = 0; i < numTexels; i++)
+	{
+		minValue = std::min(minValue, block[i * 4 + channel]);
+		maxValue = std::max(maxValue, block[i * 4 + channel]);
+	}
+
+	//value0 > value1 selects the mode with 6 interpolated values, instead of 4 and then 0 and 255
+	outBlock[0] = maxValue;
+	outBlock[1] = minValue;
+
+	uint64 indices = 0;
+	if (maxValue != minValue)
+	{
+		uint8 palette[8][4];
+		palette[0][0] = maxValue;
+		palette[1][0] = minValue;
+		for (uint i = 1; i < 7; i++)
+			palette[i + 1][0] = static_cast<uint8>(((7 - i) * maxValue + i * minValue) / 7);
+
+		for (uint i = 0; i < numTexels; i++)
+			indices |= static_cast<uint64>(FindClosest(&block[i * 4 + channel], palette, 8, 1)) << (i * 3);
+	}
+
+	for (uint i = 0; i < 6; i++)
+		outBlock[2 + i] = static_cast<uint8>(indices >> (i * 8));
+}
+
+/*static*/ void BlockEncoder::EncodeBC7(const uint8* block, uint8* outBlock)
+{
+	static constexpr uint weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+	float low[4], high[4];
+	FindEndpoints(block, 4, low, high);
+
+	//Mode 6 endpoints are 7 bits per channel plus one p-bit shared by the channels of the endpoint
+	uint endpoints[2][4];
+	uint pBits[2];
+	const float* targets[2] = {low, high};
+
+	for (uint e = 0; e < 2; e++)
+	{
+		float bestError = std::numeric_limits<float>::max();
+		for (uint p = 0; p < 2; p++)
+		{
+			uint quantized[4];
+			float error = 0.0f;
+
+			for (uint c = 0; c < 4; c++)
+			{
+				quantized[c] = std::clamp(static_cast<int>(std::lround((targets[e][c] - p) / 2.0f)), 0, 127);
+				float difference = static_cast<float>(quantized[c] << 1 | p) - targets[e][c];
+				error += difference * difference;
+			}
+
+			if (error < bestError)
+			{
+				bestError = error;
+				pBits[e] = p;
+				std::copy_n(quantized, 4, endpoints[e]);
+			}
+		}
+	}
+
+	uint8 palette[16][4];
+	for (uint i = 0; i < 16; i++)
+	{
+		for (uint c = 0; c < 4; c++)
+		{
+			uint value0 = endpoints[0][c] << 1 | pBits[0];
+			uint value1 = endpoints[1][c] << 1 | pBits[1];
+			palette[i][c] = static_cast<uint8>(((64 - weights[i]) * value0 + weights[i] * value1 + 32) >> 6);
+		}
+	}
+
+	uint indices[numTexels];
+	for (uint i = 0; i < numTexels; i++)
+		indices[i] = FindClosest(&block[i * 4], palette, 16, 4);
+
+	//The highest bit of the first index is not stored, so it has to be 0, which swapping the endpoints guarantees
+	if (indices[0] & 8)
+	{
+		std::swap(endpoints[0], endpoints[1]);
+		std::swap(pBits[0], pBits[1]);
+		for (uint& index : indices)
+			index = 15 - index;
+	}
+
+	BitWriter writer(outBlock);
+	writer.Write(1 << 6, 7); //Mode 6
+
+	for (uint c = 0; c < 4; c++)
+	{
+		writer.Write(endpoints[0][c], 7);
+		writer.Write(endpoints[1][c], 7);
+	}
+
+	writer.Write(pBits[0], 1);
+	writer.Write(pBits[1], 1);
+
+	writer.Write(indices[0], 3);
+	for (uint i = 1; i < numTexels; i++)
+		writer.Write(indices[i], 4);
+}
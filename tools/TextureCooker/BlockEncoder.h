@@ -0,0 +1,34 @@
+#ifndef BLOCKENCODER_H
+#define BLOCKENCODER_H
+
+#include "Util.h"
+
+#include "CompressedTexture.h"
+
+#include <vector>
+
+/*
+ * A small block compressor for the texture cooker. It is made to be simple rather than to be the best quality, the
+ * endpoints are the extremes of the colours along their principal axis, and every texel picks the closest palette entry.
+ * BC7 only uses mode 6 (one subset, RGBA endpoints), which is good enough for textures without sharp colour edges.
+ */
+class BlockEncoder
+{
+public:
+	//pixels is one level of RGBA8. Edge blocks of sizes that are not a multiple of 4 repeat the last row/column
+	static std::vector<uint8> EncodeLevel(CompressedTexture::Format format, const uint8* pixels, int width, int height);
+
+	//block is 16 RGBA8 texels, row by row
+	static void EncodeBC1(const uint8* block, uint8* outBlock);
+	static void EncodeBC3(const uint8* block, uint8* outBlock);
+	static void EncodeBC5(const uint8* block, uint8* outBlock);
+	static void EncodeBC7(const uint8* block, uint8* outBlock);
+
+private:
+	//BC4 is one channel, and is used for the alpha of BC3 and both channels of BC5
+	static void EncodeBC4(const uint8* block, uint channel, uint8* outBlock);
+};
+
+
+
+#endif //BLOCKENCODER_H
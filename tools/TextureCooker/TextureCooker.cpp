@@ -0,0 +1,209 @@
+/*
+ * Converts the png/jpeg textures of the models into block compressed DDS files with their whole mip chain, which the
+ * game loads instead of the source image when it finds one next to it (see CompressedTexture::FindCookedPath()).
+ *
+ * Usage: textureCooker [--bc7] [--force] [texture directories...]
+ * With no directories, every resources/models/<model>/textures directory is cooked. Run it from the repository root.
+ *
+ * Textures with "normal" in their name become BC5, textures with any transparency become BC3, and everything else
+ * becomes BC1. --bc7 uses BC7 instead of BC1 and BC3, which looks better but is twice the size of BC1.
+ */
+
+#include "Util.h"
+
+#include "BlockEncoder.h"
+#include "CompressedTexture.h"
+
+#include <stb_image/stb_image.h>
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <filesystem>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+namespace
+{
+	struct CookOptions
+	{
+		bool useBC7 = false;
+		bool force = false; //Cook textures even if their cooked version is up to date
+	};
+
+	bool IsSourceImage(const std::filesystem::path& path)
+	{
+		std::string extension = path.extension().string();
+		std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return std::tolower(c); });
+
+		return extension == ".png" || extension == ".jpg" || extension == ".jpeg" || extension == ".tga" || extension == ".bmp";
+	}
+
+	CompressedTexture::Format ChooseFormat(const std::filesystem::path& path, const uint8* pixels, int width, int height, const CookOptions& options)
+	{
+		std::string name = path.filename().string();
+		std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::tolower(c); });
+
+		if (name.find("normal") != std::string::npos)
+			return CompressedTexture::Format::bc5;
+
+		if (options.useBC7)
+			return CompressedTexture::Format::bc7;
+
+		for (uint64 i = 0; i < static_cast<uint64>(width) * height; i++)
+		{
+			if (pixels[i * 4 + 3] != 255)
+				return CompressedTexture::Format::bc3;
+		}
+
+		return CompressedTexture::Format::bc1;
+	}
+
+	bool CookTexture(const std::filesystem::path& sourcePath, const std::filesystem::path& cookedPath, const CookOptions& options, std::string& outMessage)
+	{
+		int width, height, bytesPerPixel;
+
+		//Not flipped, to match TextureLoader (the models are loaded with aiProcess_FlipUVs instead)
+		stbi_set_flip_vertically_on_load_thread(false);
+		uint8* buffer = stbi_load(sourcePath.string().c_str(), &width, &height, &bytesPerPixel, 4);
+
+		if (!buffer)
+		{
+			outMessage = "Failed to load \"" + sourcePath.string() + "\": " + stbi_failure_reason();
+			return false;
+		}
+
+		CompressedTexture::Info info;
+		info.width = width;
+		info.height = height;
+		info.numLevels = std::bit_width(static_cast<uint>(std::max(width, height))); //The whole chain, like TextureArray
+		info.format = ChooseFormat(sourcePath, buffer, width, height, options);
+
+		std::vector<uint8> pixels(buffer, buffer + static_cast<uint64>(width) * height * 4);
+		stbi_image_free(buffer);
+
+		CompressedTexture::GenerateMipChain(pixels, width, height, info.numLevels);
+
+		std::vector<uint8> levels;
+		levels.reserve(CompressedTexture::GetMipChainSize(info.format, width, height, info.numLevels));
+
+		uint64 offset = 0;
+		int levelWidth = width;
+		int levelHeight = height;
+
+		for (uint level = 0; level < info.numLevels; level++)
+		{
+			std::vector<uint8> blocks = BlockEncoder::EncodeLevel(info.format, pixels.data() + offset, levelWidth, levelHeight);
+			levels.insert(levels.end(), blocks.begin(), blocks.end());
+
+			offset += CompressedTexture::GetLevelSize(CompressedTexture::Format::rgba8, levelWidth, levelHeight);
+			levelWidth = std::max(levelWidth / 2, 1);
+			levelHeight = std::max(levelHeight / 2, 1);
+		}
+
+		if (!CompressedTexture::WriteDDS(cookedPath.string(), info, levels))
+		{
+			outMessage = "Failed to write \"" + cookedPath.string() + "\"";
+			return false;
+		}
+
+		uint64 sourceSize = CompressedTexture::GetMipChainSize(CompressedTexture::Format::rgba8, width, height, info.numLevels);
+		std::ostringstream message;
+		message << cookedPath.string() << " (" << CompressedTexture::FormatToString(info.format) << ", " << width << "x" << height
+			<< ", " << std::fixed << std::setprecision(1) << static_cast<double>(sourceSize) / levels.size() << "x smaller)";
+		outMessage = message.str();
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	CookOptions options;
+	std::vector<std::filesystem::path> directories;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string argument = argv[i];
+
+		if (argument == "--bc7")
+			options.useBC7 = true;
+		else if (argument == "--force")
+			options.force = true;
+		else
+			directories.emplace_back(argument);
+	}
+
+	if (directories.empty())
+	{
+		std::error_code error;
+		for (const std::filesystem::directory_entry& model : std::filesystem::directory_iterator("resources/models", error))
+		{
+			if (std::filesystem::is_directory(model.path() / "textures"))
+				directories.push_back(model.path() / "textures");
+		}
+
+		if (error)
+		{
+			std::cerr << "Could not open resources/models, run the texture cooker from the repository root" << std::endl;
+			return 1;
+		}
+	}
+
+	//Work out what has to be cooked first, so that it can be split over every core
+	std::vector<std::pair<std::filesystem::path, std::filesystem::path>> jobs; //Source, cooked
+	uint numUpToDate = 0;
+
+	for (const std::filesystem::path& directory : directories)
+	{
+		for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(directory))
+		{
+			if (!entry.is_regular_file() || !IsSourceImage(entry.path()))
+				continue;
+
+			std::filesystem::path cookedPath = entry.path();
+			cookedPath.replace_extension(".dds");
+
+			if (!options.force && std::filesystem::exists(cookedPath) &&
+				std::filesystem::last_write_time(cookedPath) >= entry.last_write_time())
+			{
+				numUpToDate++;
+				continue;
+			}
+
+			jobs.emplace_back(entry.path(), cookedPath);
+		}
+	}
+
+	std::atomic<uint> nextJob = 0;
+	std::atomic<uint> numFailed = 0;
+	std::mutex outputMutex;
+
+	auto worker = [&]()
+	{
+		for (uint job = nextJob++; job < jobs.size(); job = nextJob++)
+		{
+			std::string message;
+			bool cooked = CookTexture(jobs[job].first, jobs[job].second, options, message);
+
+			if (!cooked)
+				numFailed++;
+
+			std::lock_guard lock(outputMutex);
+			(cooked ? std::cout : std::cerr) << message << std::endl;
+		}
+	};
+
+	std::vector<std::thread> workers;
+	uint numWorkers = std::clamp(std::thread::hardware_concurrency(), 1u, static_cast<uint>(std::max<size_t>(jobs.size(), 1)));
+
+	for (uint i = 0; i < numWorkers; i++)
+		workers.emplace_back(worker);
+
+	for (std::thread& thread : workers)
+		thread.join();
+
+	std::cout << "Cooked " << jobs.size() - numFailed << " textures, " << numUpToDate << " were up to date, " << numFailed << " failed" << std::endl;
+	return numFailed == 0 ? 0 : 1;
+}